@@ -0,0 +1,184 @@
+
+#include "GL_CorePipeline.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+// Texture modulated by vertex color, as GL_MODULATE. Untextured shapes use
+// the atlas' solid texel, so one program does for everything. Packed
+// vertices are unpacked by origin and unit, as GL_VertexBatch::Layout.
+static const char * kVertexShader =
+    "#version 330 core\n"
+    "uniform vec2 viewSize;\n"
+    "uniform mat3x2 transform;\n"
+    "uniform vec4 unpack;\n"
+    "layout(location = 0) in vec2 position;\n"
+    "layout(location = 1) in vec2 texCoord;\n"
+    "layout(location = 2) in vec4 color;\n"
+    "out vec2 uv;\n"
+    "out vec4 rgba;\n"
+    "void main() {\n"
+    "    uv = unpack.w*texCoord;\n"
+    "    rgba = color;\n"
+    "    vec2 p = transform*vec3(unpack.xy + unpack.z*position, 1.0);\n"
+    "    gl_Position = vec4(2.0*p/viewSize - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char * kFragmentShader =
+    "#version 330 core\n"
+    "uniform sampler2D tex;\n"
+    "in vec2 uv;\n"
+    "in vec4 rgba;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "    fragColor = texture(tex, uv)*rgba;\n"
+    "}\n";
+
+GL_CorePipeline::GL_CorePipeline():
+    program(0),
+    viewSizeLoc(-1),
+    transformLoc(-1),
+    unpackLoc(-1),
+    vbo(0),
+    vboBytes(0),
+    pixelTex(0)
+{
+    GLuint vs = Compile(GL_VERTEX_SHADER, kVertexShader);
+    GLuint fs = Compile(GL_FRAGMENT_SHADER, kFragmentShader);
+    if(vs && fs) {
+        program = glCreateProgram();
+        glAttachShader(program, vs);
+        glAttachShader(program, fs);
+        glLinkProgram(program);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if(!linked) {
+            GLint length = 0;
+            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+            std::vector<char> log(std::max(length, 1));
+            glGetProgramInfoLog(program, log.size(), nullptr, &log[0]);
+            cerr << "GL_CorePipeline: program failed to link: " << &log[0] << endl;
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    if(vs)
+        glDeleteShader(vs);
+    if(fs)
+        glDeleteShader(fs);
+    
+    if(program) {
+        GLint prevProgram;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &prevProgram);
+        glUseProgram(program);
+        viewSizeLoc = glGetUniformLocation(program, "viewSize");
+        transformLoc = glGetUniformLocation(program, "transform");
+        const GLfloat identity[6] = {1, 0, 0, 1, 0, 0};
+        glUniformMatrix3x2fv(transformLoc, 1, GL_FALSE, identity);
+        unpackLoc = glGetUniformLocation(program, "unpack");
+        glUniform4f(unpackLoc, 0, 0, 1, 1);
+        glUniform1i(glGetUniformLocation(program, "tex"), 0);
+        glUseProgram(prevProgram);
+    }
+    
+    glGenBuffers(1, &vbo);
+}
+
+GL_CorePipeline & GL_CorePipeline::shared()
+{
+    // Never destroyed, as with the glyph atlas
+    static GL_CorePipeline * pipeline = new GL_CorePipeline;
+    return *pipeline;
+}
+
+GLuint GL_CorePipeline::Compile(GLenum type, const char * source)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if(!compiled) {
+        GLint length = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::vector<char> log(std::max(length, 1));
+        glGetShaderInfoLog(shader, log.size(), nullptr, &log[0]);
+        cerr << "GL_CorePipeline: shader failed to compile: " << &log[0] << endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint GL_CorePipeline::vertex_array()
+{
+    // Attribute pointers are set by draw(), as layouts differ between batches
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(2);
+    return vao;
+}
+
+void GL_CorePipeline::use(int w, int h)
+{
+    glUseProgram(program);
+    if(program)
+        glUniform2f(viewSizeLoc, w, h);
+}
+
+void GL_CorePipeline::transform(const float m[6])
+{
+    // Column major, so the columns are (a, b), (c, d) and (x, y)
+    if(program)
+        glUniformMatrix3x2fv(transformLoc, 1, GL_FALSE, m);
+}
+
+void GL_CorePipeline::draw(GLenum mode, const GL_VertexBatch::Layout & layout)
+{
+    size_t bytes = layout.count*layout.stride;
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    // Orphan the storage each time, so we never wait for a draw still
+    // reading the last batch.
+    if(bytes > vboBytes)
+        vboBytes = std::max(bytes, 2*vboBytes);
+    glBufferData(GL_ARRAY_BUFFER, vboBytes, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, layout.data);
+    
+    glVertexAttribPointer(0, 2, layout.type, GL_FALSE, layout.stride, (const GLvoid *)0);
+    if(layout.uvOffset >= 0) {
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, layout.type, GL_FALSE, layout.stride, (const GLvoid *)(size_t)layout.uvOffset);
+    }
+    else {
+        glDisableVertexAttribArray(1);
+        glVertexAttrib2f(1, layout.solidUV[0], layout.solidUV[1]);
+    }
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, layout.stride, (const GLvoid *)(size_t)layout.rgbaOffset);
+    if(program)
+        glUniform4f(unpackLoc, layout.origin[0], layout.origin[1], layout.unit, layout.uvUnit);
+    glDrawArrays(mode, 0, layout.count);
+}
+
+GLuint GL_CorePipeline::pixel_texture()
+{
+    if(!pixelTex) {
+        // Keep the binding a driver may be relying on
+        GLint prevTex;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTex);
+        glGenTextures(1, &pixelTex);
+        glBindTexture(GL_TEXTURE_2D, pixelTex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, prevTex);
+    }
+    return pixelTex;
+}
+
@@ -0,0 +1,58 @@
+
+#ifndef GL_COREPIPELINE_H
+#define GL_COREPIPELINE_H
+
+#include "GL_Ext.h"
+#include "GL_VertexBatch.h"
+#include <cstddef>
+
+// What GL_GraphicsDriver uses in place of the fixed-function pipeline in core
+// profile (3.3 and later) contexts: one shader program doing what vertex
+// colors with GL_MODULATE texturing did, a vertex buffer batches are streamed
+// through, and the projection, modelview transform and unpacking of packed
+// vertices as uniforms. Pixels drawn once go through a texture rather than
+// glDrawPixels().
+//
+// The program and buffer are shared by all drivers, like the glyph atlas.
+// Vertex array objects can't be shared between contexts, so each driver makes
+// its own with vertex_array().
+class GL_CorePipeline {
+  private:
+    GLuint program;
+    GLint viewSizeLoc;
+    GLint transformLoc;
+    GLint unpackLoc;
+    GLuint vbo;
+    size_t vboBytes;
+    GLuint pixelTex;
+    
+    static GLuint Compile(GLenum type, const char * source);
+    
+    GL_CorePipeline();
+    
+  public:
+    static GL_CorePipeline & shared();
+    
+    // False if the shaders failed to build
+    bool valid() const {return program != 0;}
+    
+    // A new vertex array reading vertices from the stream buffer, left bound.
+    // The caller deletes it.
+    GLuint vertex_array();
+    
+    // Use the program, mapping 0..w, 0..h onto the viewport as glOrtho() did
+    void use(int w, int h);
+    
+    // Transform vertices by a, b, c, d, x, y, as GL_StateCache::transform()
+    void transform(const float m[6]);
+    
+    // Stream vertices laid out as layout and draw them as mode. A
+    // vertex_array() must be bound.
+    void draw(GLenum mode, const GL_VertexBatch::Layout & layout);
+    
+    // Texture for pixels drawn once, to be redefined with GL_TexImage() by
+    // each use. Anything queued from it must be drawn first.
+    GLuint pixel_texture();
+};
+
+#endif // GL_COREPIPELINE_H
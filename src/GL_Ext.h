@@ -0,0 +1,172 @@
+
+#ifndef GL_EXT_H
+#define GL_EXT_H
+
+// GL entry points beyond 1.1 (buffer objects and so on). The Makefile defines
+// GL_GLEXT_PROTOTYPES so Mesa's gl.h declares them; Apple's headers declare
+// everything up to 2.1 anyway.
+#include "fltk3gl/gl.h"
+#ifdef __APPLE__
+#include <OpenGL/glext.h>
+#else
+#include <GL/glext.h>
+#endif
+
+#include <cstdio>
+#include <string>
+
+// True if the current context is at least GL major.minor or has extension.
+// Major 0 for an extension no version includes. False without a context.
+inline bool GL_HaveFeature(int major, int minor, const char * extension)
+{
+    const char * version = (const char *)glGetString(GL_VERSION);
+    if(!version)
+        return false;
+    int glMajor = 0, glMinor = 0;
+    sscanf(version, "%d.%d", &glMajor, &glMinor);
+    if(major > 0 && (glMajor > major || (glMajor == major && glMinor >= minor)))
+        return true;
+    if(glMajor >= 3) {
+        // Core profiles have no GL_EXTENSIONS string
+        GLint n = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+        for(GLint j = 0; j < n; ++j) {
+            const char * name = (const char *)glGetStringi(GL_EXTENSIONS, j);
+            if(name && std::string(name) == extension)
+                return true;
+        }
+        return false;
+    }
+    const char * available = (const char *)glGetString(GL_EXTENSIONS);
+    if(!available)
+        return false;
+    std::string all = std::string(" ") + available + " ";
+    return all.find(std::string(" ") + extension + " ") != std::string::npos;
+}
+
+// True if the current context is a core profile, without the fixed-function
+// pipeline
+inline bool GL_CoreProfile()
+{
+    const char * version = (const char *)glGetString(GL_VERSION);
+    int glMajor = 0, glMinor = 0;
+    if(!version || sscanf(version, "%d.%d", &glMajor, &glMinor) != 2)
+        return false;
+    if(glMajor < 3 || (glMajor == 3 && glMinor < 2))
+        return false;
+    GLint mask = 0;
+    glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &mask);
+    return (mask & GL_CONTEXT_CORE_PROFILE_BIT) != 0;
+}
+
+// The checks below are made once, as FLTK's contexts all share a driver,
+// unless there's no context yet.
+
+// Pixel buffer objects
+inline bool GL_HavePixelBuffers()
+{
+    static int have = -1;
+    if(have < 0 && glGetString(GL_VERSION))
+        have = GL_HaveFeature(2, 1, "GL_ARB_pixel_buffer_object");
+    return have > 0;
+}
+
+// Fence sync objects, through the 3.2/ARB entry points
+inline bool GL_HaveSync()
+{
+    static int have = -1;
+    if(have < 0 && glGetString(GL_VERSION))
+        have = GL_HaveFeature(3, 2, "GL_ARB_sync");
+    return have > 0;
+}
+
+// Framebuffer objects, through the 3.0/ARB entry points
+inline bool GL_HaveFramebuffers()
+{
+    static int have = -1;
+    if(have < 0 && glGetString(GL_VERSION))
+        have = GL_HaveFeature(3, 0, "GL_ARB_framebuffer_object");
+    return have > 0;
+}
+
+// GL_MULTISAMPLE_FILTER_HINT_NV, an error to set without the extension
+inline bool GL_HaveMultisampleFilterHint()
+{
+    static int have = -1;
+    if(have < 0 && glGetString(GL_VERSION))
+        have = GL_HaveFeature(0, 0, "GL_NV_multisample_filter_hint");
+    return have > 0;
+}
+
+// GL_MAX_TEXTURE_SIZE, 0 without a context
+inline GLint GL_MaxTextureSize()
+{
+    static GLint size = 0;
+    if(size <= 0 && glGetString(GL_VERSION))
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &size);
+    return size;
+}
+
+// Whether the alpha and luminance texture formats, which core profiles lack,
+// are stored as red or red-green and swizzled back on sampling. Only done in
+// core profiles, as the fixed-function texture environment goes by the stored
+// format and ignores swizzles. Textures are shared between windows, so they
+// must all have the same profile anyway.
+inline bool GL_SwizzledTextures()
+{
+    static int swizzled = -1;
+    if(swizzled < 0 && glGetString(GL_VERSION))
+        swizzled = GL_CoreProfile() && GL_HaveFeature(3, 3, "GL_ARB_texture_swizzle");
+    return swizzled > 0;
+}
+
+// Pixel format to upload to a texture made by GL_TexImage() in format
+inline GLenum GL_TexFormat(GLenum format)
+{
+    if(GL_SwizzledTextures()) {
+        switch(format) {
+            case GL_ALPHA:
+            case GL_LUMINANCE: return GL_RED;
+            case GL_LUMINANCE_ALPHA: return GL_RG;
+        }
+    }
+    return format;
+}
+
+// glTexImage2D() for the bound texture in one of GL_ALPHA, GL_LUMINANCE,
+// GL_LUMINANCE_ALPHA, GL_RGB or GL_RGBA, 8 bits per channel, swizzled if need
+// be to sample the same in core profiles.
+inline void GL_TexImage(GLenum format, int w, int h, const GLvoid * pixels)
+{
+    GLenum internal = GL_RGBA8;
+    switch(format) {
+        case GL_ALPHA: internal = GL_ALPHA8; break;
+        case GL_LUMINANCE: internal = GL_LUMINANCE8; break;
+        case GL_LUMINANCE_ALPHA: internal = GL_LUMINANCE8_ALPHA8; break;
+        case GL_RGB: internal = GL_RGB8; break;
+    }
+    if(GL_SwizzledTextures()) {
+        GLint swizzle[4] = {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+        switch(format) {
+            case GL_ALPHA:
+                internal = GL_R8;
+                swizzle[0] = swizzle[1] = swizzle[2] = GL_ONE;
+                swizzle[3] = GL_RED;
+                break;
+            case GL_LUMINANCE:
+                internal = GL_R8;
+                swizzle[1] = swizzle[2] = GL_RED;
+                swizzle[3] = GL_ONE;
+                break;
+            case GL_LUMINANCE_ALPHA:
+                internal = GL_RG8;
+                swizzle[1] = swizzle[2] = GL_RED;
+                swizzle[3] = GL_GREEN;
+                break;
+        }
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+    glTexImage2D(GL_TEXTURE_2D, 0, internal, w, h, 0, GL_TexFormat(format), GL_UNSIGNED_BYTE, pixels);
+}
+
+#endif // GL_EXT_H
@@ -0,0 +1,122 @@
+
+#include "GL_FontMetrics.h"
+#include "utf8.h"
+
+#include <cmath>
+
+GL_FontMetrics::GL_FontMetrics(fltk3::Font font, int size):
+    font(font),
+    size(size),
+    hasKerning(false),
+    height_(size),
+    descent_(0)
+{
+    for(int c = 0; c < 128; ++c)
+        ascii[c] = 0;
+    
+    FT_Face face = Face();
+    if(!face)
+        return;
+    
+    for(int c = 32; c < 127; ++c)
+        ascii[c] = LoadAdvance(c);
+    
+    FT_Size_Metrics & m = face->size->metrics;
+    height_ = (int)ceil((m.ascender - m.descender)/64.0);
+    descent_ = (int)ceil(-m.descender/64.0);
+    
+    hasKerning = FT_HAS_KERNING(face);
+    if(hasKerning) {
+        FT_UInt index[128];
+        for(int c = 0; c < 128; ++c)
+            index[c] = (c >= 32)? FT_Get_Char_Index(face, c) : 0;
+        asciiKerning.assign(128*128, 0);
+        for(int l = 32; l < 127; ++l)
+        for(int r = 32; r < 127; ++r) {
+            FT_Vector k;
+            if(index[l] && index[r] && FT_Get_Kerning(face, index[l], index[r], FT_KERNING_DEFAULT, &k) == 0)
+                asciiKerning[l*128 + r] = k.x;
+        }
+    }
+}
+
+GL_FontMetrics * GL_FontMetrics::get(fltk3::Font font, int size)
+{
+    static std::unordered_map<uint32_t, GL_FontMetrics *> tables;
+    static GL_FontMetrics * last = nullptr;
+    if(last && last->font == font && last->size == size)
+        return last;
+    
+    if(!GL_GlyphAtlas::shared().has_face(font))
+        return nullptr;
+    
+    uint32_t key = ((uint32_t)(font & 0xFFFF) << 16) | (size & 0xFFFF);
+    GL_FontMetrics *& table = tables[key];
+    if(!table)
+        table = new GL_FontMetrics(font, size);
+    last = table;
+    return table;
+}
+
+FT_Face GL_FontMetrics::Face()
+{
+    // Faces are shared between sizes, this sets the size if needed
+    return GL_GlyphAtlas::shared().face(font, size);
+}
+
+float GL_FontMetrics::LoadAdvance(uint32_t c)
+{
+    float a = 0;
+    FT_Face face = Face();
+    if(face && FT_Load_Char(face, c, FT_LOAD_DEFAULT) == 0)
+        a = face->glyph->advance.x/64.0f;
+    if(c >= 128)
+        advances[c] = a;
+    return a;
+}
+
+float GL_FontMetrics::LoadKerning(uint32_t left, uint32_t right)
+{
+    float k = 0;
+    FT_Face face = Face();
+    FT_Vector v;
+    if(face && FT_Get_Kerning(face, FT_Get_Char_Index(face, left), FT_Get_Char_Index(face, right),
+                              FT_KERNING_DEFAULT, &v) == 0)
+        k = v.x/64.0f;
+    kernings[((uint64_t)left << 32) | right] = k;
+    return k;
+}
+
+double GL_FontMetrics::width(const char * str, int n)
+{
+    const char * p = str, * end = str + n;
+    float w = 0;
+    uint32_t prev = 0;
+    while(p < end) {
+        // Runs of ASCII go straight to the tables
+        size_t run = utf8::ascii_run(p, end);
+        const uint8_t * s = (const uint8_t *)p;
+        if(hasKerning) {
+            for(size_t j = 0; j < run; ++j) {
+                w += ascii[s[j]];
+                if(prev)
+                    w += kerning(prev, s[j]);
+                prev = s[j];
+            }
+        }
+        else {
+            for(size_t j = 0; j < run; ++j)
+                w += ascii[s[j]];
+        }
+        p += run;
+    
+        if(p < end) {
+            uint32_t c = utf8::decode(p, end);
+            w += advance(c);
+            if(prev)
+                w += kerning(prev, c);
+            prev = c;
+        }
+    }
+    return w;
+}
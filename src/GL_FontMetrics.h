@@ -0,0 +1,63 @@
+
+#ifndef GL_FONTMETRICS_H
+#define GL_FONTMETRICS_H
+
+#include "fltk3/Device.h"
+#include "GL_GlyphAtlas.h"
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+// Advance, kerning and line metrics for one font at one size, read from the
+// same FreeType face the glyph atlas renders from so measured and drawn text
+// agree. ASCII advances and kerning pairs live in flat tables filled when the
+// font is first used; other code points go through hash maps filled on demand.
+// Measuring a string is then a table walk with no allocation.
+class GL_FontMetrics {
+    fltk3::Font font;
+    int size;
+    
+    float ascii[128];
+    std::unordered_map<uint32_t, float> advances;
+    
+    bool hasKerning;
+    std::vector<int16_t> asciiKerning;// 128x128, 26.6 fixed point
+    std::unordered_map<uint64_t, float> kernings;
+    
+    int height_, descent_;
+    
+    FT_Face Face();
+    float LoadAdvance(uint32_t c);
+    float LoadKerning(uint32_t left, uint32_t right);
+    
+  public:
+    GL_FontMetrics(fltk3::Font font, int size);
+    
+    // Returns null if the font has no FreeType face
+    static GL_FontMetrics * get(fltk3::Font font, int size);
+    
+    float advance(uint32_t c) {
+        if(c < 128)
+            return ascii[c];
+        auto a = advances.find(c);
+        return (a != advances.end())? a->second : LoadAdvance(c);
+    }
+    
+    // Adjustment between left and right, in pixels
+    float kerning(uint32_t left, uint32_t right) {
+        if(!hasKerning)
+            return 0;
+        if(left < 128 && right < 128)
+            return asciiKerning[left*128 + right]/64.0f;
+        auto k = kernings.find(((uint64_t)left << 32) | right);
+        return (k != kernings.end())? k->second : LoadKerning(left, right);
+    }
+    
+    // Width of n bytes of UTF-8, kerning included
+    double width(const char * str, int n);
+    int height() const {return height_;}
+    int descent() const {return descent_;}
+};
+
+#endif // GL_FONTMETRICS_H
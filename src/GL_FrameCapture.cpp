@@ -0,0 +1,181 @@
+
+#include "GL_FrameCapture.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// Nanoseconds to wait on a fence at a time, when waiting
+static const GLuint64 kWaitTimeout = 1000000000;
+
+GL_FrameCapture::Pool::~Pool()
+{
+    for(Frame * frame: free)
+        delete frame;
+}
+
+GL_FrameCapture::GL_FrameCapture(int buffers):
+    numBuffers(min(max(buffers, 2), (int)kMaxBuffers)),
+    nextSlot(0),
+    oldestSlot(0),
+    initialized(false),
+    usePBOs(false),
+    useFences(false),
+    frames(0),
+    pool(make_shared<Pool>())
+{
+    for(Slot & slot: slots) {
+        slot.pbo = 0;
+        slot.fence = 0;
+        slot.pending = false;
+        slot.bytes = 0;
+        slot.w = slot.h = 0;
+        slot.number = 0;
+    }
+}
+
+GL_FrameCapture::~GL_FrameCapture()
+{
+    for(Slot & slot: slots) {
+        if(slot.fence)
+            glDeleteSync(slot.fence);
+        if(slot.pbo)
+            glDeleteBuffers(1, &slot.pbo);
+    }
+}
+
+// A frame from the pool, back to it when the last pointer to it is gone
+std::shared_ptr<GL_FrameCapture::Frame> GL_FrameCapture::NewFrame(int w, int h, uint64_t number)
+{
+    Frame * frame = nullptr;
+    {
+        lock_guard<mutex> guard(pool->lock);
+        if(!pool->free.empty()) {
+            frame = pool->free.back();
+            pool->free.pop_back();
+        }
+    }
+    if(!frame)
+        frame = new Frame;
+    frame->w = w;
+    frame->h = h;
+    frame->number = number;
+    frame->rgba.resize(4*w*h);
+    
+    std::shared_ptr<Pool> owner = pool;
+    return std::shared_ptr<Frame>(frame, [owner](Frame * f) {
+        lock_guard<mutex> guard(owner->lock);
+        owner->free.push_back(f);
+    });
+}
+
+// Wait for the oldest slot's pixels and queue them for next()
+void GL_FrameCapture::Collect(Slot & slot)
+{
+    if(slot.fence) {
+        GLenum result;
+        do {
+            result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, kWaitTimeout);
+        } while(result == GL_TIMEOUT_EXPIRED);
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+    }
+    
+    std::shared_ptr<Frame> frame = NewFrame(slot.w, slot.h, slot.number);
+    GLint prevBuffer = 0;
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &prevBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    const uint8_t * pixels = (const uint8_t *)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if(pixels) {
+        memcpy(&frame->rgba[0], pixels, frame->rgba.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    else {
+        fill(frame->rgba.begin(), frame->rgba.end(), 0);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, prevBuffer);
+    
+    ready.push_back(frame);
+    slot.pending = false;
+    oldestSlot = (oldestSlot + 1)%numBuffers;
+}
+
+void GL_FrameCapture::read(int x, int y, int w, int h)
+{
+    if(!initialized) {
+        // Deferred to here so there's a GL context to ask
+        usePBOs = GL_HavePixelBuffers();
+        useFences = usePBOs && GL_HaveSync();
+        if(usePBOs) {
+            for(int j = 0; j < numBuffers; ++j)
+                glGenBuffers(1, &slots[j].pbo);
+        }
+        initialized = true;
+    }
+    uint64_t number = frames++;
+    
+    GLint prevAlignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &prevAlignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    
+    if(!usePBOs) {
+        std::shared_ptr<Frame> frame = NewFrame(w, h, number);
+        glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, &frame->rgba[0]);
+        ready.push_back(frame);
+        glPixelStorei(GL_PACK_ALIGNMENT, prevAlignment);
+        return;
+    }
+    
+    Slot & slot = slots[nextSlot];
+    if(slot.pending)
+        Collect(slot);// ring full, so it's the oldest
+    
+    GLint prevBuffer = 0;
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &prevBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    size_t bytes = 4*w*h;
+    if(slot.bytes != bytes) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+        slot.bytes = bytes;
+    }
+    glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);// into the buffer
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, prevBuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, prevAlignment);
+    
+    if(useFences)
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.pending = true;
+    slot.w = w;
+    slot.h = h;
+    slot.number = number;
+    nextSlot = (nextSlot + 1)%numBuffers;
+}
+
+GL_FrameCapture::FramePtr GL_FrameCapture::next(bool wait)
+{
+    // Everything finished, in order. Without fences nothing can be known to
+    // have finished, so only waiting collects before the ring is full.
+    while(slots[oldestSlot].pending) {
+        Slot & slot = slots[oldestSlot];
+        bool done = useFences &&
+            glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) != GL_TIMEOUT_EXPIRED;
+        if(!done && !(wait && ready.empty()))
+            break;
+        Collect(slot);
+    }
+    
+    if(ready.empty())
+        return nullptr;
+    FramePtr frame = ready.front();
+    ready.pop_front();
+    return frame;
+}
+
+size_t GL_FrameCapture::in_flight() const
+{
+    size_t n = ready.size();
+    for(int j = 0; j < numBuffers; ++j)
+        n += slots[j].pending;
+    return n;
+}
@@ -0,0 +1,91 @@
+
+#ifndef GL_FRAMECAPTURE_H
+#define GL_FRAMECAPTURE_H
+
+#include "GL_Ext.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+// Reads frames back from GL without waiting for them. read() starts copying
+// the framebuffer into one of a ring of pixel buffer objects and sets a fence
+// after it; next() hands back frames whose fences have signalled, so with
+// three buffers frame N's pixels are usually had while drawing frame N + 2,
+// when the GPU has long finished with them:
+//
+//     capture.read(0, 0, w(), h());// after drawing, before swapping
+//     while(GL_FrameCapture::FramePtr frame = capture.next())
+//         record(frame);
+//
+// Frames come from a pool and go back to it once the last FramePtr to them
+// is gone, which may be on another thread, so recording at frame rate
+// allocates nothing once the pool is warm.
+//
+// Without fences a buffer is mapped once the ring comes round to it, which
+// may wait; without pixel buffer objects read() reads at once, as
+// glReadPixels() always does. read() and next() need the same current GL
+// context as the constructor and destructor.
+class GL_FrameCapture {
+  public:
+    struct Frame {
+        int w, h;
+        uint64_t number;// counting read() calls from 0
+        std::vector<uint8_t> rgba;// rows bottom up, as GL has them
+    };
+    typedef std::shared_ptr<const Frame> FramePtr;
+    
+  private:
+    enum {kMaxBuffers = 4};
+    
+    struct Pool {
+        std::mutex lock;
+        std::vector<Frame *> free;
+        ~Pool();
+    };
+    
+    struct Slot {
+        GLuint pbo;
+        GLsync fence;
+        bool pending;
+        size_t bytes;// the buffer's size
+        int w, h;
+        uint64_t number;
+    };
+    
+    Slot slots[kMaxBuffers];
+    int numBuffers;
+    int nextSlot;// the next read()'s
+    int oldestSlot;// the next next()'s
+    bool initialized;
+    bool usePBOs;
+    bool useFences;
+    uint64_t frames;
+    std::deque<FramePtr> ready;
+    std::shared_ptr<Pool> pool;
+    
+    std::shared_ptr<Frame> NewFrame(int w, int h, uint64_t number);
+    void Collect(Slot & slot);
+    
+  public:
+    // buffers pixel buffers cycled through, 2 to 4
+    explicit GL_FrameCapture(int buffers = 3);
+    ~GL_FrameCapture();
+    
+    // Start reading w*h RGBA pixels at x, y from the current read buffer.
+    // If the ring is full the oldest frame is collected first, waiting if
+    // need be.
+    void read(int x, int y, int w, int h);
+    
+    // The oldest frame read and not yet handed back, or null if none has
+    // arrived. If wait, waits for the oldest in flight instead of returning
+    // null, which is null only once all are handed back.
+    FramePtr next(bool wait = false);
+    
+    // Frames in flight or waiting for next()
+    size_t in_flight() const;
+};
+
+#endif // GL_FRAMECAPTURE_H
@@ -0,0 +1,270 @@
+
+#include "GL_GlyphAtlas.h"
+#include "GL_Ext.h"
+
+#include <iostream>
+
+using namespace std;
+
+// Candidate font files for the FLTK standard fonts, by family and style
+// (regular, bold, italic, bold italic).
+static const char * kSansFiles[4][4] = {
+    {"/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+     "/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf",
+     "/Library/Fonts/Arial.ttf", nullptr},
+    {"/usr/share/fonts/truetype/dejavu/DejaVuSans-Bold.ttf",
+     "/usr/share/fonts/truetype/liberation/LiberationSans-Bold.ttf",
+     "/Library/Fonts/Arial Bold.ttf", nullptr},
+    {"/usr/share/fonts/truetype/dejavu/DejaVuSans-Oblique.ttf",
+     "/usr/share/fonts/truetype/liberation/LiberationSans-Italic.ttf",
+     "/Library/Fonts/Arial Italic.ttf", nullptr},
+    {"/usr/share/fonts/truetype/dejavu/DejaVuSans-BoldOblique.ttf",
+     "/usr/share/fonts/truetype/liberation/LiberationSans-BoldItalic.ttf",
+     "/Library/Fonts/Arial Bold Italic.ttf", nullptr}
+};
+static const char * kMonoFiles[4][4] = {
+    {"/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf",
+     "/usr/share/fonts/truetype/liberation/LiberationMono-Regular.ttf",
+     "/Library/Fonts/Courier New.ttf", nullptr},
+    {"/usr/share/fonts/truetype/dejavu/DejaVuSansMono-Bold.ttf",
+     "/usr/share/fonts/truetype/liberation/LiberationMono-Bold.ttf",
+     "/Library/Fonts/Courier New Bold.ttf", nullptr},
+    {"/usr/share/fonts/truetype/dejavu/DejaVuSansMono-Oblique.ttf",
+     "/usr/share/fonts/truetype/liberation/LiberationMono-Italic.ttf",
+     "/Library/Fonts/Courier New Italic.ttf", nullptr},
+    {"/usr/share/fonts/truetype/dejavu/DejaVuSansMono-BoldOblique.ttf",
+     "/usr/share/fonts/truetype/liberation/LiberationMono-BoldItalic.ttf",
+     "/Library/Fonts/Courier New Bold Italic.ttf", nullptr}
+};
+static const char * kSerifFiles[4][4] = {
+    {"/usr/share/fonts/truetype/dejavu/DejaVuSerif.ttf",
+     "/usr/share/fonts/truetype/liberation/LiberationSerif-Regular.ttf",
+     "/Library/Fonts/Times New Roman.ttf", nullptr},
+    {"/usr/share/fonts/truetype/dejavu/DejaVuSerif-Bold.ttf",
+     "/usr/share/fonts/truetype/liberation/LiberationSerif-Bold.ttf",
+     "/Library/Fonts/Times New Roman Bold.ttf", nullptr},
+    {"/usr/share/fonts/truetype/dejavu/DejaVuSerif-Italic.ttf",
+     "/usr/share/fonts/truetype/liberation/LiberationSerif-Italic.ttf",
+     "/Library/Fonts/Times New Roman Italic.ttf", nullptr},
+    {"/usr/share/fonts/truetype/dejavu/DejaVuSerif-BoldItalic.ttf",
+     "/usr/share/fonts/truetype/liberation/LiberationSerif-BoldItalic.ttf",
+     "/Library/Fonts/Times New Roman Bold Italic.ttf", nullptr}
+};
+
+static vector<string> FileList(const char * const * files)
+{
+    vector<string> list;
+    for(; *files; ++files)
+        list.push_back(*files);
+    return list;
+}
+
+GL_GlyphAtlas::GL_GlyphAtlas():
+    library(nullptr),
+    tex(0),
+    packer(kAtlasSize, kAtlasSize)
+{
+    if(FT_Init_FreeType(&library)) {
+        cerr << "GL_GlyphAtlas: could not initialize FreeType" << endl;
+        library = nullptr;
+    }
+    
+    // HELVETICA, COURIER and TIMES each come in four styles, in that order.
+    for(int style = 0; style < 4; ++style) {
+        fontFiles[fltk3::HELVETICA + style] = FileList(kSansFiles[style]);
+        fontFiles[fltk3::COURIER + style] = FileList(kMonoFiles[style]);
+        fontFiles[fltk3::TIMES + style] = FileList(kSerifFiles[style]);
+    }
+    // No portable symbol fonts; SYMBOL and ZAPF_DINGBATS fall back to sans.
+    fontFiles[fltk3::SYMBOL] = FileList(kSansFiles[0]);
+    fontFiles[fltk3::SCREEN] = FileList(kMonoFiles[0]);
+    fontFiles[fltk3::SCREEN + 1] = FileList(kMonoFiles[1]);
+    fontFiles[fltk3::ZAPF_DINGBATS] = FileList(kSansFiles[0]);
+}
+
+GL_GlyphAtlas::~GL_GlyphAtlas()
+{
+    for(FT_Face face: faces)
+        if(face)
+            FT_Done_Face(face);
+    if(library)
+        FT_Done_FreeType(library);
+    if(tex)
+        glDeleteTextures(1, &tex);
+}
+
+GL_GlyphAtlas & GL_GlyphAtlas::shared()
+{
+    // Never destroyed: there's no GL context to delete the texture in at exit.
+    static GL_GlyphAtlas * atlas = new GL_GlyphAtlas;
+    return *atlas;
+}
+
+GLuint GL_GlyphAtlas::texture()
+{
+    if(!tex) {
+        CreateTexture();
+        AddSolidBlock();
+    }
+    return tex;
+}
+
+void GL_GlyphAtlas::CreateTexture()
+{
+    // Zero fill so padding between glyphs samples as transparent
+    std::vector<uint8_t> zeros(kAtlasSize*kAtlasSize, 0);
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    GL_TexImage(GL_ALPHA, kAtlasSize, kAtlasSize, &zeros[0]);
+}
+
+void GL_GlyphAtlas::AddSolidBlock()
+{
+    // 4x4 so linear filtering at the center never reaches the padding
+    const int n = 4;
+    uint8_t ones[n*n];
+    for(int j = 0; j < n*n; ++j)
+        ones[j] = 255;
+    int x, y;
+    packer.alloc(n, n, x, y);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, n, n, GL_TexFormat(GL_ALPHA), GL_UNSIGNED_BYTE, ones);
+    solidU = (x + n/2.0f)/kAtlasSize;
+    solidV = (y + n/2.0f)/kAtlasSize;
+}
+
+void GL_GlyphAtlas::clear()
+{
+    glyphs.clear();
+    packer.clear();
+    if(tex)
+        AddSolidBlock();
+}
+
+void GL_GlyphAtlas::set_font_files(fltk3::Font font, const std::vector<std::string> & files)
+{
+    fontFiles[font] = files;
+    if(font < (int)faces.size() && faces[font]) {
+        FT_Done_Face(faces[font]);
+        faces[font] = nullptr;
+    }
+    if(font < (int)faceTried.size())
+        faceTried[font] = false;
+    // Drop glyphs rasterized from the old face. Their atlas space is only
+    // reclaimed by the next clear().
+    for(auto g = glyphs.begin(); g != glyphs.end();) {
+        if((int)(g->first >> 48) == (font & 0xFFFF))
+            g = glyphs.erase(g);
+        else
+            ++g;
+    }
+}
+
+FT_Face GL_GlyphAtlas::Face(fltk3::Font font)
+{
+    if(!library || font < 0)
+        return nullptr;
+    if(font >= (int)faces.size()) {
+        faces.resize(font + 1, nullptr);
+        faceTried.resize(font + 1, false);
+    }
+    if(!faceTried[font]) {
+        faceTried[font] = true;
+        auto files = fontFiles.find(font);
+        if(files != fontFiles.end()) {
+            for(const string & file: files->second) {
+                FT_Face face;
+                if(FT_New_Face(library, file.c_str(), 0, &face) == 0) {
+                    faces[font] = face;
+                    break;
+                }
+            }
+        }
+    }
+    return faces[font];
+}
+
+FT_Face GL_GlyphAtlas::face(fltk3::Font font, int size)
+{
+    FT_Face face = Face(font);
+    if(face && face->size->metrics.y_ppem != size)
+        FT_Set_Pixel_Sizes(face, 0, size);
+    return face;
+}
+
+bool GL_GlyphAtlas::Rasterize(FT_Face face, uint32_t c, Glyph & glyph)
+{
+    if(FT_Load_Char(face, c, FT_LOAD_RENDER)) {
+        // Unrenderable, draw nothing
+        glyph.w = glyph.h = glyph.left = glyph.top = 0;
+        glyph.advance = 0;
+        glyph.u0 = glyph.v0 = glyph.u1 = glyph.v1 = 0;
+        return true;
+    }
+    
+    FT_GlyphSlot slot = face->glyph;
+    FT_Bitmap & bmp = slot->bitmap;
+    glyph.w = bmp.width;
+    glyph.h = bmp.rows;
+    glyph.left = slot->bitmap_left;
+    glyph.top = slot->bitmap_top;
+    glyph.advance = slot->advance.x/64.0f;
+    glyph.u0 = glyph.v0 = glyph.u1 = glyph.v1 = 0;
+    if(glyph.w == 0 || glyph.h == 0)
+        return true;// Whitespace, nothing to pack
+    
+    int x, y;
+    if(!packer.alloc(glyph.w, glyph.h, x, y))
+        return false;
+    
+    // Copy with a row and column of zero padding, which may still hold pixels
+    // of a glyph from before the last clear().
+    int pw = glyph.w + 1, ph = glyph.h + 1;
+    scratch.assign(pw*ph, 0);
+    for(int row = 0; row < glyph.h; ++row) {
+        const uint8_t * src = bmp.buffer + row*bmp.pitch;
+        uint8_t * dst = &scratch[row*pw];
+        if(bmp.pixel_mode == FT_PIXEL_MODE_MONO) {
+            for(int col = 0; col < glyph.w; ++col)
+                dst[col] = (src[col >> 3] & (0x80 >> (col & 7)))? 255 : 0;
+        }
+        else {
+            for(int col = 0; col < glyph.w; ++col)
+                dst[col] = src[col];
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, pw, ph, GL_TexFormat(GL_ALPHA), GL_UNSIGNED_BYTE, &scratch[0]);
+    
+    glyph.u0 = (float)x/kAtlasSize;
+    glyph.v0 = (float)y/kAtlasSize;
+    glyph.u1 = (float)(x + glyph.w)/kAtlasSize;
+    glyph.v1 = (float)(y + glyph.h)/kAtlasSize;
+    return true;
+}
+
+const GL_GlyphAtlas::Glyph * GL_GlyphAtlas::glyph(fltk3::Font font, int size, uint32_t c)
+{
+    uint64_t key = Key(font, size, c);
+    auto found = glyphs.find(key);
+    if(found != glyphs.end())
+        return &found->second;
+    
+    FT_Face f = face(font, size);
+    if(!f)
+        return nullptr;
+    
+    texture();
+    Glyph g;
+    if(!Rasterize(f, c, g))
+        return nullptr;
+    return &(glyphs[key] = g);
+}
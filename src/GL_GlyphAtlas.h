@@ -0,0 +1,96 @@
+
+#ifndef GL_GLYPHATLAS_H
+#define GL_GLYPHATLAS_H
+
+#include "fltk3/Device.h"
+#include "fltk3gl/gl.h"
+#include "GL_ShelfPacker.h"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Glyph cache for GL text rendering. Glyphs are rasterized with FreeType on
+// first use and packed into a single alpha texture, keyed by FLTK font, size
+// and code point. Text is then drawn as textured quads through the vertex
+// batch, so a run of text is one draw call no matter how many strings it has.
+//
+// The atlas also holds a block of opaque texels, so untextured primitives can
+// be drawn with the atlas bound and batch together with text.
+//
+// FLTK identifies fonts by name, not file, so faces are located through a
+// table of candidate font files per FLTK font. Fonts with no usable file are
+// reported by has_face() so the caller can fall back to another renderer.
+//
+// One atlas is shared by all drivers in the process. FLTK shares display lists
+// and textures between its GL contexts, so the texture can be too. The texture
+// is made by the first texture() call, and from then on glyph() and clear()
+// must be made with a GL context current and the atlas texture bound. Faces
+// need no GL, so fonts can be measured, or drawn by SW_GraphicsDriver, without
+// a context.
+class GL_GlyphAtlas {
+  public:
+    struct Glyph {
+        float u0, v0, u1, v1;// texture coordinates
+        int w, h;// bitmap size in pixels
+        int left, top;// bitmap offset from pen position, y up
+        float advance;// pen advance in pixels
+    };
+    
+  private:
+    enum {kAtlasSize = 1024};
+    
+    FT_Library library;
+    std::vector<FT_Face> faces;// indexed by fltk3::Font, null if not loaded
+    std::vector<bool> faceTried;
+    std::unordered_map<int, std::vector<std::string> > fontFiles;
+    
+    GLuint tex;
+    GL_ShelfPacker packer;
+    float solidU, solidV;
+    std::unordered_map<uint64_t, Glyph> glyphs;
+    std::vector<uint8_t> scratch;
+    
+    static uint64_t Key(fltk3::Font font, int size, uint32_t c) {
+        return ((uint64_t)(font & 0xFFFF) << 48) | ((uint64_t)(size & 0xFFFF) << 32) | c;
+    }
+    
+    void CreateTexture();
+    void AddSolidBlock();
+    FT_Face Face(fltk3::Font font);
+    bool Rasterize(FT_Face face, uint32_t c, Glyph & glyph);
+    
+    GL_GlyphAtlas();
+    
+  public:
+    ~GL_GlyphAtlas();
+    
+    static GL_GlyphAtlas & shared();
+    
+    // The atlas texture, made and left bound if there isn't one yet
+    GLuint texture();
+    
+    // Texture coordinates of a block of opaque texels, valid once there is a
+    // texture()
+    float solid_u() const {return solidU;}
+    float solid_v() const {return solidV;}
+    
+    // Replace the candidate files for an FLTK font. The first that FreeType
+    // can open is used.
+    void set_font_files(fltk3::Font font, const std::vector<std::string> & files);
+    bool has_face(fltk3::Font font) {return Face(font) != nullptr;}
+    FT_Face face(fltk3::Font font, int size);
+    
+    // Look up a glyph, rasterizing it if needed. Returns null if the atlas is
+    // full; flush anything drawn from the atlas, clear() and retry.
+    const Glyph * glyph(fltk3::Font font, int size, uint32_t c);
+    
+    // Discard all glyphs
+    void clear();
+};
+
+#endif // GL_GLYPHATLAS_H
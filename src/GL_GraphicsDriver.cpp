@@ -1,6 +1,9 @@
 // Notes:
 // GL_MULTISAMPLE is initially turned off and controlled by line width, being
-// enabled briefly for each solid shape drawn.
+// enabled for solid shapes. Primitives are collected in a GL_VertexBatch, so
+// multisampling is only switched (and the batch flushed) when a primitive
+// needs the other setting. In COVERAGE_AA mode multisampling stays off, and
+// the batch builds antialiased edges into the geometry instead.
 // 
 // arc(int x, int y, int w, int h, double a1, double a2)
 // gives slightly different results from the native Quartz renderer on my Mac.
@@ -10,16 +13,41 @@
 // antialiasing can also be implemented via the accumulation buffer, at a cost
 // in performance. AA settings should probably be configurable.
 // 
+// Text is drawn from a FreeType glyph atlas (GL_GlyphAtlas) as textured quads.
+// The atlas texture stays bound for untextured primitives too, which use an
+// opaque block of it, so text and shapes batch together. Fonts without a font
+// file fall back to gl_draw().
+// 
+// In core profile contexts there is no fixed-function pipeline, attribute
+// stack or glDrawPixels(). A GL_CorePipeline shader program takes the place of
+// the projection matrix and texture environment, batches are streamed through
+// a vertex buffer, images always go through textures, and gl_draw() text isn't
+// available. Everything else is shared with the compatibility path.
+// 
+// Vertices are batched in the coordinates they were drawn with. The origin,
+// FLTK's matrix for paths, and the flip to GL's upward y are the transform GL
+// applies, so what a widget draws doesn't depend on where it is. A change of
+// transform flushes the batch like any other state change.
+// 
 // Still to be done:
-// Line joins/caps
 // proper image support
-// rotated and RTL text
 
 #include "GL_GraphicsDriver.h"
+#include "GL_ImageStream.h"
+#include "GL_Offscreen.h"
+#include "GL_StagingBuffer.h"
+#include "WorkerPool.h"
 #include "fltk3/draw.h"
+#include "utf8.h"
+#include "imageconv.h"
 
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <algorithm>
 #include <iostream>
+#include <unordered_set>
 
 using namespace std;
 
@@ -28,40 +56,105 @@ using namespace std;
 #define LOG_UNIMPLEMENTED(s) cerr << "*GL_GraphicsDriver::" << __func__ << s << endl
 // #define LOG_UNIMPLEMENTED(s)
 
-GL_GraphicsDriver::GL_GraphicsDriver(fltk3::Rectangle * rect):
-    fltk3::GraphicsDriver()
+static const double kIdentity[6] = {1, 0, 0, 1, 0, 0};
+// GL window coordinates as they are, for raster positions
+static const float kWindowTransform[6] = {1, 0, 0, 1, 0, 0};
+
+GL_GraphicsDriver::GL_GraphicsDriver(fltk3::Rectangle * rect, StateSave save):
+    fltk3::GraphicsDriver(),
+    cpolyMode(TESSELLATE),
+    stencilBits(-1),
+    clipShift(0),
+    clipMask(0),
+    fillMask(0),
+    stencilTop(0),
+    clipLevel(-1),
+    aaMode(MULTISAMPLE_AA),
+    state(&batch)
 {
-    // We can't predict what some custom widgets might touch, so save everything here.
-    glPushAttrib(GL_ALL_ATTRIB_BITS);
-    glPushClientAttrib(GL_CLIENT_ALL_ATTRIB_BITS);
+    core = GL_CoreProfile();
+    pipeline = nullptr;
+    vertexArray = 0;
+    saveMode = save;
+    
+    // Nested in another GL driver, e.g. drawing to a GL_Offscreen. Its
+    // queued primitives belong under its own state, which it still needs
+    // afterwards.
+    if(GL_GraphicsDriver * outer = current()) {
+        outer->flush();
+        if(saveMode == SAVE_NONE)
+            saveMode = SAVE_TOUCHED;
+    }
     
     viewW = rect->w();
     viewH = rect->h();
     
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-    // Could use the modelview matrix to do point transformations. For simplicity, not done at present.
+    if(core) {
+        // Projection, texturing and vertex color are the pipeline's shader
+        // program.
+        if(saveMode != SAVE_NONE)
+            savedState.save(true);
+        pipeline = &GL_CorePipeline::shared();
+        vertexArray = pipeline->vertex_array();
+        pipeline->use(viewW, viewH);
+        batch.pipeline(pipeline);
+        state.pipeline(pipeline);
+    }
+    else {
+        if(saveMode == SAVE_ALL) {
+            // We can't predict what some custom widgets might touch, so save everything here.
+            glPushAttrib(GL_ALL_ATTRIB_BITS);
+            glPushClientAttrib(GL_CLIENT_ALL_ATTRIB_BITS);
+        }
+        else if(saveMode == SAVE_TOUCHED) {
+            savedState.save(false);
+        }
     
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    glOrtho(0, viewW, 0, viewH, -1, 1);
+        glMatrixMode(GL_MODELVIEW);
+        if(saveMode != SAVE_NONE)
+            glPushMatrix();
+        // Loaded with vertex transforms by the state cache
+        glLoadIdentity();
     
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_BLEND);
+        glMatrixMode(GL_PROJECTION);
+        if(saveMode != SAVE_NONE)
+            glPushMatrix();
+        glLoadIdentity();
+        glOrtho(0, viewW, 0, viewH, -1, 1);
+    }
     
+    state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    state.enable(GL_StateCache::BLEND);
+    
+    // Core profiles may not have wide GL lines, but all lines wider than a
+    // pixel are stroked anyway.
     lineWidth = 1;
-    glLineWidth(lineWidth);
-    glDisable(GL_LINE_STIPPLE);
+    if(!core)
+        state.line_width(lineWidth);
     
-    glDisable(GL_MULTISAMPLE);
-    glHint(GL_MULTISAMPLE_FILTER_HINT_NV, GL_NICEST);
+    state.disable(GL_StateCache::MULTISAMPLE);
+    state.disable(GL_StateCache::STENCIL_TEST);
+    
+    atlas = &GL_GlyphAtlas::shared();
+    if(!core) {
+        glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+        state.enable(GL_StateCache::TEXTURE_2D);
+    }
+    state.bind_texture(atlas->texture());
+    batch.solid_uv(atlas->solid_u(), atlas->solid_v());
+    
+    textures = &GL_TextureCache::shared();
+    icons = &GL_IconAtlas::shared();
+    tessellator = &GL_Tessellator::shared();
     
     glDisable(GL_DEPTH_TEST);
     glDisable(GL_CULL_FACE);
-    glDisable(GL_LIGHTING);
-    glDisable(GL_FOG);
+    if(!core) {
+        if(GL_HaveMultisampleFilterHint())
+            glHint(GL_MULTISAMPLE_FILTER_HINT_NV, GL_NICEST);
+        glDisable(GL_LIGHTING);
+        glDisable(GL_FOG);
+    }
     
     // Not a good way to do antialiasing, really need multisampling, but this may be a useful option...
     // glEnable(GL_BLEND);
@@ -71,6 +164,10 @@ GL_GraphicsDriver::GL_GraphicsDriver(fltk3::Rectangle * rect):
     // glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
     // glHint(GL_POLYGON_SMOOTH_HINT, GL_NICEST);
     
+    glFontValid = false;
+    metrics = nullptr;
+    std::copy(kIdentity, kIdentity + 6, pathMatrix);
+    
     push_no_clip();
     
     install();
@@ -78,16 +175,40 @@ GL_GraphicsDriver::GL_GraphicsDriver(fltk3::Rectangle * rect):
 
 GL_GraphicsDriver::~GL_GraphicsDriver()
 {
+    // Leave no clip levels in the stencil buffer
+    while(stencilTop > 0)
+        pop_clip();
+    batch.flush();
     uninstall();
     
-    glPopAttrib();
-    glPopClientAttrib();
+    if(core) {
+        if(saveMode != SAVE_NONE)
+            savedState.restore();
+        glDeleteVertexArrays(1, &vertexArray);
+    }
+    else if(saveMode != SAVE_NONE) {
+        if(saveMode == SAVE_ALL) {
+            glPopAttrib();
+            glPopClientAttrib();
+        }
+        else {
+            savedState.restore();
+        }
+    
+        glMatrixMode(GL_MODELVIEW);
+        glPopMatrix();
     
-    glMatrixMode(GL_MODELVIEW);
-    glPopMatrix();
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+    }
     
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
+    // Whatever an outer driver had cached may no longer hold
+    if(GL_GraphicsDriver * outer = dynamic_cast<GL_GraphicsDriver *>(replacedDriver)) {
+        outer->state.invalidate();
+        // The projection is a uniform of the shared program
+        if(outer->core)
+            outer->pipeline->use(outer->viewW, outer->viewH);
+    }
 }
 
 void GL_GraphicsDriver::install() {
@@ -101,75 +222,144 @@ void GL_GraphicsDriver::uninstall() {
     fltk3::DisplayDevice::display_device()->set_current();
 }
 
-void GL_GraphicsDriver::gl_vertex(double x, double y)
+GL_GraphicsDriver * GL_GraphicsDriver::current() {
+    return dynamic_cast<GL_GraphicsDriver *>(fltk3::SurfaceDevice::surface()->driver());
+}
+
+void GL_GraphicsDriver::ImmediateMode()
 {
-    glVertex2d(to_gl_x(x), to_gl_y(y));
+    state.bind_texture(atlas->texture());
+    state.transform(kWindowTransform);
+    batch.flush();
+    glColor4ubv(batch.color());
+    glTexCoord2f(batch.solid_u(), batch.solid_v());
 }
 
+// Color and font are only recorded here. GL color goes out with the batched
+// vertices (or in ImmediateMode()), and the gl_font() display lists are only
+// rebuilt when text is actually drawn in a new font.
 void GL_GraphicsDriver::color(fltk3::Color c) {
-    uninstall();
     GraphicsDriver::color(c);
-    gl_color(c);
-    install();
+    uchar r, g, b;
+    fltk3::get_color(c, r, g, b);
+    batch.color(r, g, b);
     LOG("(c)");
 }
 void GL_GraphicsDriver::color(uchar r, uchar g, uchar b) {
-    uninstall();
-    fltk3::Color c = fltk3::rgb_color(r, g, b);
-    GraphicsDriver::color(c);
-    gl_color(c);
-    install();
+    GraphicsDriver::color(fltk3::rgb_color(r, g, b));
+    batch.color(r, g, b);
     LOG("(r, g, b)");
 }
 
 void GL_GraphicsDriver::font(fltk3::Font face, fltk3::Fontsize size) {
-    uninstall();
     GraphicsDriver::font(face, size);
-    gl_font(face, size);
-    install();
+    metrics = GL_FontMetrics::get(face, size);
+    // Without a FreeType face, metrics come from the replaced driver, which
+    // doesn't need to be current to measure.
+    if(!metrics)
+        replacedDriver->font(face, size);
+    glFontValid = false;
     LOG("()");
 }
 
 void GL_GraphicsDriver::line_style(int style, int width, char * dashes)
 {
-    cerr << "line_style " << style << ", " << width << ", ";
-    if(dashes) {
-        while(*dashes)
-            cerr << (int)*dashes++;
-    }
-    cerr << endl;
-    
-    // FIXME finish implementation
-    // SOLID = 0, DASH = 1, DOT = 2, DASHDOT = 3, DASHDOTDOT = 4
-    // CAP_FLAT = 0x100, CAP_ROUND = 0x200, CAP_SQUARE = 0x300
-    // JOIN_MITER = 0x1000, JOIN_ROUND = 0x2000, JOIN_BEVEL = 0x3000
-    switch(style & 0xFF) {
-        case fltk3::SOLID: glDisable(GL_LINE_STIPPLE); break;
-        case fltk3::DASH: glEnable(GL_LINE_STIPPLE); glLineStipple(1, 0x7777); break;
-        case fltk3::DOT: glEnable(GL_LINE_STIPPLE); glLineStipple(1, 0x5555); break;
-        case fltk3::DASHDOT: glEnable(GL_LINE_STIPPLE); glLineStipple(1, 0x2727); break;
-        case fltk3::DASHDOTDOT: glEnable(GL_LINE_STIPPLE); glLineStipple(1, 0x5757); break;
-        default: glDisable(GL_LINE_STIPPLE); break;
-    }
-    
     lineWidth = max(1, width);
-    glLineWidth(lineWidth);
-    
-    if(lineWidth < 1.5)
-        glDisable(GL_MULTISAMPLE);
-    else
-        glEnable(GL_MULTISAMPLE);
-    
-    LOG_UNIMPLEMENTED("()");
+    if(!core)
+        state.line_width(lineWidth);
+    strokeStyle.line_style(style, lineWidth, dashes);
+    LOG("()");
 }
 
+// Thin solid lines are GL lines, crisp and cheap. Anything wider, dashed or
+// antialiased by coverage is stroked into triangles.
 void GL_GraphicsDriver::StartSolid() {
-    if(lineWidth < 1.5)
-        glEnable(GL_MULTISAMPLE);
+    state.bind_texture(atlas->texture());
+    if(aaMode == COVERAGE_AA) {
+        // Lines drawn as solid are antialiased at any width
+        state.disable(GL_StateCache::MULTISAMPLE);
+        strokeStyle.antialias = true;
+        batch.stroke(&strokeStyle);
+    }
+    else {
+        state.enable(GL_StateCache::MULTISAMPLE);
+        strokeStyle.antialias = false;
+        batch.stroke((lineWidth >= 1.5 || !strokeStyle.dashes.empty())? &strokeStyle : nullptr);
+    }
 }
-void GL_GraphicsDriver::EndSolid() {
-    if(lineWidth < 1.5)
-        glDisable(GL_MULTISAMPLE);
+void GL_GraphicsDriver::StartStroke() {
+    state.bind_texture(atlas->texture());
+    bool wide = lineWidth >= 1.5;
+    if(aaMode == COVERAGE_AA) {
+        // Thin lines too, which centered on pixels stay crisp along the axes
+        state.disable(GL_StateCache::MULTISAMPLE);
+        strokeStyle.antialias = true;
+        batch.stroke(&strokeStyle);
+    }
+    else {
+        state.enable(GL_StateCache::MULTISAMPLE, wide);
+        strokeStyle.antialias = false;
+        batch.stroke((wide || !strokeStyle.dashes.empty())? &strokeStyle : nullptr);
+    }
+}
+
+// Antialias the edges of the polygon in fringePoints, in COVERAGE_AA mode
+void GL_GraphicsDriver::Fringe() {
+    if(aaMode == COVERAGE_AA && !fringePoints.empty())
+        batch.fringe(&fringePoints[0], fringePoints.size()/2);
+}
+
+
+// ****************************************************************************
+// Transforms
+// ****************************************************************************
+
+// FLTK's current matrix, which is only to be had by transforming points
+void GL_GraphicsDriver::CurrentMatrix(double m[6])
+{
+    m[0] = transform_dx(1, 0);
+    m[1] = transform_dy(1, 0);
+    m[2] = transform_dx(0, 1);
+    m[3] = transform_dy(0, 1);
+    m[4] = transform_x(0, 0);
+    m[5] = transform_y(0, 0);
+}
+
+// Draw vertices transformed by matrix m, then offset by the origin
+void GL_GraphicsDriver::Transform(const double m[6])
+{
+    const float t[6] = {
+        (float)m[0], (float)-m[1],
+        (float)m[2], (float)-m[3],
+        (float)to_gl_x(m[4] + origin_x()), (float)to_gl_y(m[5] + origin_y())
+    };
+    state.transform(t);
+}
+
+// For all FLTK doesn't apply its matrix to: rectangles, lines, text, images
+void GL_GraphicsDriver::OriginTransform()
+{
+    Transform(kIdentity);
+}
+
+// Set the transform for points pts under matrix m and return the points to
+// draw. Strokes and coverage fringes are built in pixels, so if pixels is set
+// a matrix that would scale, shear or rotate them is applied here instead.
+const double * GL_GraphicsDriver::TransformPoints(const double m[6], const std::vector<double> & pts, bool pixels)
+{
+    if(!pixels || (m[0] == 1 && m[1] == 0 && m[2] == 0 && m[3] == 1)) {
+        Transform(m);
+        return pts.data();
+    }
+    
+    transformedPoints.resize(pts.size());
+    for(size_t j = 0; j + 1 < pts.size(); j += 2) {
+        transformedPoints[j] = m[0]*pts[j] + m[2]*pts[j + 1];
+        transformedPoints[j + 1] = m[1]*pts[j] + m[3]*pts[j + 1];
+    }
+    const double translation[6] = {1, 0, 0, 1, m[4], m[5]};
+    Transform(translation);
+    return transformedPoints.data();
 }
 
 
@@ -187,391 +377,718 @@ void GL_GraphicsDriver::RectVertices(double x, double y, double w, double h)
         h = -h;
         y -= h;
     }
-    double x0 = x + origin_x();
-    double y0 = y + origin_y();
-    double x1 = x0 + w;
-    double y1 = y0 + h;
-    gl_vertex(x0, y0);
-    gl_vertex(x0, y1);
-    gl_vertex(x1, y1);
-    gl_vertex(x1, y0);
+    batch.vertex(x, y);
+    batch.vertex(x, y + h);
+    batch.vertex(x + w, y + h);
+    batch.vertex(x + w, y);
 }
 
 
 void GL_GraphicsDriver::rect(int x, int y, int w, int h)
 {
-    glBegin(GL_LINE_LOOP);
+    OriginTransform();
+    StartStroke();
+    batch.begin(GL_LINE_LOOP);
     RectVertices(x, y, w - 1, h - 1);
-    glEnd();
+    batch.end();
     LOG("()");
 }
 
 void GL_GraphicsDriver::rectf(int x, int y, int w, int h)
 {
+    OriginTransform();
     StartSolid();
-    glBegin(GL_POLYGON);
+    batch.begin(GL_POLYGON);
     // Note offset, required for clear drawing/pixel alignment
     RectVertices(x - 0.5, y - 0.5, w, h);
-    glEnd();
-    EndSolid();
+    batch.end();
     LOG("()");
 }
 
 
 void GL_GraphicsDriver::xyline(int x, int y, int x1)
 {
-    int ox = origin_x(), oy = origin_y();
+    OriginTransform();
+    StartStroke();
     if(x1 > x)
         x1 += 1;
     else
         x1 -= 1;
     
-    glBegin(GL_LINES);
-    gl_vertex(ox + x, oy + y);
-    gl_vertex(ox + x1, oy + y);
-    glEnd();
+    batch.begin(GL_LINES);
+    batch.vertex(x, y);
+    batch.vertex(x1, y);
+    batch.end();
     LOG("(x)");
 }
 
 void GL_GraphicsDriver::xyline(int x, int y, int x1, int y2)
 {
-    int ox = origin_x(), oy = origin_y();
+    OriginTransform();
+    StartStroke();
     if(y2 > y)
         y2 += 1;
     else
         y2 -= 1;
-    glBegin(GL_LINE_STRIP);
-    gl_vertex(ox + x, oy + y);
-    gl_vertex(ox + x1, oy + y);
-    gl_vertex(ox + x1, oy + y2);
-    glEnd();
+    batch.begin(GL_LINE_STRIP);
+    batch.vertex(x, y);
+    batch.vertex(x1, y);
+    batch.vertex(x1, y2);
+    batch.end();
     LOG("(xy)");
 }
 
 void GL_GraphicsDriver::xyline(int x, int y, int x1, int y2, int x3)
 {
-    int ox = origin_x(), oy = origin_y();
+    OriginTransform();
+    StartStroke();
     if(x3 > x1)
         x3 += 1;
     else
         x3 -= 1;
-    glBegin(GL_LINE_STRIP);
-    gl_vertex(ox + x, oy + y);
-    gl_vertex(ox + x1, oy + y);
-    gl_vertex(ox + x1, oy + y2);
-    gl_vertex(ox + x3, oy + y2);
-    glEnd();
+    batch.begin(GL_LINE_STRIP);
+    batch.vertex(x, y);
+    batch.vertex(x1, y);
+    batch.vertex(x1, y2);
+    batch.vertex(x3, y2);
+    batch.end();
     LOG("(xyx)");
-    
 }
 
 void GL_GraphicsDriver::yxline(int x, int y, int y1)
 {
-    int ox = origin_x(), oy = origin_y();
+    OriginTransform();
+    StartStroke();
     if(y1 > y)
         y1 += 1;
     else
         y1 -= 1;
     
-    glBegin(GL_LINES);
-    gl_vertex(ox + x, oy + y);
-    gl_vertex(ox + x, oy + y1);
-    glEnd();
+    batch.begin(GL_LINES);
+    batch.vertex(x, y);
+    batch.vertex(x, y1);
+    batch.end();
     LOG("(y)");
 }
 
 void GL_GraphicsDriver::yxline(int x, int y, int y1, int x2)
 {
-    int ox = origin_x(), oy = origin_y();
+    OriginTransform();
+    StartStroke();
     if(x2 > x)
         x2 += 1;
     else
         x2 -= 1;
     
-    glBegin(GL_LINE_STRIP);
-    gl_vertex(ox + x, oy + y);
-    gl_vertex(ox + x, oy + y1);
-    gl_vertex(ox + x2, oy + y1);
-    glEnd();
+    batch.begin(GL_LINE_STRIP);
+    batch.vertex(x, y);
+    batch.vertex(x, y1);
+    batch.vertex(x2, y1);
+    batch.end();
     LOG("(yx)");
 }
 
 void GL_GraphicsDriver::yxline(int x, int y, int y1, int x2, int y3)
 {
-    int ox = origin_x(), oy = origin_y();
+    OriginTransform();
+    StartStroke();
     if(y3 > y1)
         y3 += 1;
     else
         y3 -= 1;
-    glBegin(GL_LINE_STRIP);
-    gl_vertex(ox + x, oy + y);
-    gl_vertex(ox + x, oy + y1);
-    gl_vertex(ox + x2, oy + y1);
-    gl_vertex(ox + x2, oy + y3);
-    glEnd();
+    batch.begin(GL_LINE_STRIP);
+    batch.vertex(x, y);
+    batch.vertex(x, y1);
+    batch.vertex(x2, y1);
+    batch.vertex(x2, y3);
+    batch.end();
     LOG("(yxy)");
 }
 
 void GL_GraphicsDriver::line(int x, int y, int x1, int y1)
 {
-    int ox = origin_x(), oy = origin_y();
+    OriginTransform();
+    StartStroke();
     
-    glBegin(GL_LINES);
-    gl_vertex(ox + x, oy + y);
-    gl_vertex(ox + x1, oy + y1);
-    glEnd();
-    // Lines consistently seem one pixel short. Plop a point down to finish them.
-    glBegin(GL_POINTS);
-    gl_vertex(ox + x1, oy + y1);
-    glEnd();
+    // GL lines leave out their last pixel, so thin ones go a step further
+    // along their major axis to finish them. That keeps them in the batch
+    // with other lines, where a point to finish them would flush it.
+    float ex = x1, ey = y1;
+    if(!batch.stroke()) {
+        int dx = x1 - x, dy = y1 - y;
+        int major = max(abs(dx), abs(dy));
+        if(major == 0) {
+            ex += 1;
+        }
+        else {
+            ex += (float)dx/major;
+            ey += (float)dy/major;
+        }
+    }
+    batch.begin(GL_LINES);
+    batch.vertex(x, y);
+    batch.vertex(ex, ey);
+    batch.end();
     LOG("()");
 }
 
 void GL_GraphicsDriver::line(int x, int y, int x1, int y1, int x2, int y2)
 {
-    int ox = origin_x(), oy = origin_y();
-    glBegin(GL_LINE_STRIP);
-    gl_vertex(ox + x, oy + y);
-    gl_vertex(ox + x1, oy + y1);
-    gl_vertex(ox + x2, oy + y2);
-    glEnd();
+    OriginTransform();
+    StartStroke();
+    batch.begin(GL_LINE_STRIP);
+    batch.vertex(x, y);
+    batch.vertex(x1, y1);
+    batch.vertex(x2, y2);
+    batch.end();
     LOG("(2)");
 }
 
 
 void GL_GraphicsDriver::point(int x, int y)
 {
-    x += origin_x();
-    y += origin_y();
-    glBegin(GL_POINTS);
-    gl_vertex(x, y);
-    glEnd();
+    OriginTransform();
+    StartStroke();
+    batch.begin(GL_POINTS);
+    batch.vertex(x, y);
+    batch.end();
     LOG("()");
 }
 
 
 void GL_GraphicsDriver::loop(int x0, int y0, int x1, int y1, int x2, int y2)
 {
-    int ox = origin_x(), oy = origin_y();
-    glBegin(GL_LINE_STRIP);
-    gl_vertex(ox + x0, oy + y0);
-    gl_vertex(ox + x1, oy + y1);
-    gl_vertex(ox + x2, oy + y2);
-    gl_vertex(ox + x0, oy + y0);
-    glEnd();
+    OriginTransform();
+    StartStroke();
+    batch.begin(GL_LINE_LOOP);
+    batch.vertex(x0, y0);
+    batch.vertex(x1, y1);
+    batch.vertex(x2, y2);
+    batch.end();
     LOG("()");
 }
 
 void GL_GraphicsDriver::loop(int x0, int y0, int x1, int y1, int x2, int y2, int x3, int y3)
 {
-    int ox = origin_x(), oy = origin_y();
-    glBegin(GL_LINE_STRIP);
-    gl_vertex(ox + x0, oy + y0);
-    gl_vertex(ox + x1, oy + y1);
-    gl_vertex(ox + x2, oy + y2);
-    gl_vertex(ox + x3, oy + y3);
-    gl_vertex(ox + x0, oy + y0);
-    glEnd();
+    OriginTransform();
+    StartStroke();
+    batch.begin(GL_LINE_LOOP);
+    batch.vertex(x0, y0);
+    batch.vertex(x1, y1);
+    batch.vertex(x2, y2);
+    batch.vertex(x3, y3);
+    batch.end();
     LOG("()");
 }
 
 void GL_GraphicsDriver::polygon(int x0, int y0, int x1, int y1, int x2, int y2)
 {
-    int ox = origin_x(), oy = origin_y();
+    OriginTransform();
     StartSolid();
-    glBegin(GL_TRIANGLES);
-    gl_vertex(ox + x0, oy + y0);
-    gl_vertex(ox + x1, oy + y1);
-    gl_vertex(ox + x2, oy + y2);
-    glEnd();
-    EndSolid();
+    batch.begin(GL_TRIANGLES);
+    batch.vertex(x0, y0);
+    batch.vertex(x1, y1);
+    batch.vertex(x2, y2);
+    batch.end();
+    if(aaMode == COVERAGE_AA) {
+        fringePoints.assign({(float)x0, (float)y0, (float)x1, (float)y1, (float)x2, (float)y2});
+        Fringe();
+    }
     LOG("()");
 }
 
 void GL_GraphicsDriver::polygon(int x0, int y0, int x1, int y1, int x2, int y2, int x3, int y3)
 {
-    int ox = origin_x(), oy = origin_y();
+    OriginTransform();
     StartSolid();
-    glBegin(GL_QUADS);
-    gl_vertex(ox + x0, oy + y0);
-    gl_vertex(ox + x1, oy + y1);
-    gl_vertex(ox + x2, oy + y2);
-    gl_vertex(ox + x3, oy + y3);
-    glEnd();
-    EndSolid();
+    batch.begin(GL_QUADS);
+    batch.vertex(x0, y0);
+    batch.vertex(x1, y1);
+    batch.vertex(x2, y2);
+    batch.vertex(x3, y3);
+    batch.end();
+    if(aaMode == COVERAGE_AA) {
+        fringePoints.assign({
+            (float)x0, (float)y0, (float)x1, (float)y1,
+            (float)x2, (float)y2, (float)x3, (float)y3
+        });
+        Fringe();
+    }
     LOG("()");
 }
 
-void GL_GraphicsDriver::circle(double x, double y, double r)
+// Curves are flattened to chords straying no more than this many pixels from
+// the true curve.
+static const double kFlatness = 0.2;
+static const int kMaxSegments = 1024;
+
+// Segments needed for an arc of radius r pixels sweeping a radians. A chord
+// spanning t radians misses the arc by r*(1 - cos(t/2)).
+static int ArcSegments(double r, double a)
 {
-    int n = min(360.0, M_PI*r);
-    double cx = x + origin_x();
-    double cy = y + origin_y();
-    glBegin(GL_LINE_LOOP);
+    a = fabs(a);
+    if(r <= kFlatness)
+        return 1;
+    double t = 2*acos(1 - kFlatness/r);
+    int n = ceil(a/t);
+    // Nothing much smaller than an octagon for whole circles
+    return max(min(n, kMaxSegments), max(1, (int)ceil(a*4/M_PI)));
+}
+
+// Call fn(cos, sin) at n + 1 evenly spaced angles from a0 to a1. Steps by
+// rotation, so a whole arc costs two sin/cos pairs however many points it has.
+template<typename fn_t>
+static void ArcPoints(double a0, double a1, int n, const fn_t & fn)
+{
+    double c = cos(a0), s = sin(a0);
+    double dc = cos((a1 - a0)/n), ds = sin((a1 - a0)/n);
     for(int j = 0; j < n; ++j) {
-        double th = (2.0*M_PI*j)/n;
-        gl_vertex(cx + cos(th)*r, cy + sin(th)*r);
+        fn(c, s);
+        double t = c*dc - s*ds;
+        s = s*dc + c*ds;
+        c = t;
     }
-    glEnd();
+    // End exactly where asked, not where rounding got to
+    fn(cos(a1), sin(a1));
+}
+
+void GL_GraphicsDriver::circle(double x, double y, double r)
+{
+    StartStroke();
+    double m[6];
+    CurrentMatrix(m);
+    // Segments enough for the larger radius once transformed
+    int n = ArcSegments(r*max(hypot(m[0], m[1]), hypot(m[2], m[3])), 2*M_PI);
+    shapePoints.clear();
+    // The last point repeats the first, the loop closes itself
+    int j = 0;
+    ArcPoints(0, 2*M_PI, n, [&](double c, double s) {
+        if(j++ < n) {
+            shapePoints.push_back(x + c*r);
+            shapePoints.push_back(y + s*r);
+        }
+    });
+    const double * p = TransformPoints(m, shapePoints, batch.stroke() != nullptr);
+    batch.begin(GL_LINE_LOOP);
+    for(j = 0; j < n; ++j)
+        batch.vertex(p[2*j], p[2*j + 1]);
+    batch.end();
     LOG("()");
 }
 
 void GL_GraphicsDriver::arc(int x, int y, int w, int h, double a1, double a2)
 {
+    OriginTransform();
+    StartStroke();
     w -= 1; h -= 1;
     // Arcs are apparently drawn 1 pixel smaller than specified...line width related?
-    int n = min(360.0, M_PI*(w + h)/4.0*(a2 - a1)/360.0);
     double xr = w/2.0;
     double yr = h/2.0;
-    double cx = x + origin_x() + xr;
-    double cy = y + origin_y() + yr;
-    glBegin(GL_LINE_STRIP);
-    for(int j = 0; j < n; ++j) {
-        double th = (2.0*M_PI/360.0)*(((double)j/(n-1))*(a2 - a1) + a1);
-        gl_vertex(cx + cos(th)*xr, cy - sin(th)*yr);
-    }
-    glEnd();
+    double cx = x + xr;
+    double cy = y + yr;
+    double th1 = a1*M_PI/180, th2 = a2*M_PI/180;
+    batch.begin(GL_LINE_STRIP);
+    ArcPoints(th1, th2, ArcSegments(max(xr, yr), th2 - th1), [&](double c, double s) {
+        batch.vertex(cx + c*xr, cy - s*yr);
+    });
+    batch.end();
     LOG("()");
 }
 
 void GL_GraphicsDriver::pie(int x, int y, int w, int h, double a1, double a2)
 {
-    int n = min(360.0, M_PI*(w + h)/4.0*(a2 - a1)/360.0);
     double xr = w/2.0;
     double yr = h/2.0;
     // Note offset, required for clear drawing/pixel alignment
-    double cx = x + origin_x() + xr - 0.5;
-    double cy = y + origin_y() + yr - 0.5;
+    double cx = x + xr - 0.5;
+    double cy = y + yr - 0.5;
+    double th1 = a1*M_PI/180, th2 = a2*M_PI/180;
+    OriginTransform();
     StartSolid();
-    glBegin(GL_TRIANGLE_FAN);
-    gl_vertex(cx, cy);
-    for(int j = 0; j < n; ++j) {
-        double th = (2.0*M_PI/360.0)*(((double)j/(n-1))*(a2 - a1) + a1);
-        gl_vertex(cx + cos(th)*xr, cy - sin(th)*yr);
-    }
-    glEnd();
-    EndSolid();
+    fringePoints.clear();
+    fringePoints.push_back(cx);
+    fringePoints.push_back(cy);
+    batch.begin(GL_TRIANGLE_FAN);
+    batch.vertex(cx, cy);
+    ArcPoints(th1, th2, ArcSegments(max(xr, yr), th2 - th1), [&](double c, double s) {
+        batch.vertex(cx + c*xr, cy - s*yr);
+        fringePoints.push_back(cx + c*xr);
+        fringePoints.push_back(cy - s*yr);
+    });
+    batch.end();
+    // A whole ellipse has no center on its outline
+    if(fabs(a2 - a1) >= 360)
+        fringePoints.erase(fringePoints.begin(), fringePoints.begin() + 2);
+    Fringe();
+    LOG("()");
+}
+
+
+// ****************************************************************************
+// Paths
+// ****************************************************************************
+
+// FLTK's own path keeps transformed points, rounded to integers on most
+// platforms. Here they stay as given, for GL to transform.
+
+void GL_GraphicsDriver::begin_points()
+{
+    pathPoints.clear();
     LOG("()");
 }
 
+void GL_GraphicsDriver::begin_line()
+{
+    pathPoints.clear();
+    LOG("()");
+}
+
+void GL_GraphicsDriver::begin_loop()
+{
+    pathPoints.clear();
+    LOG("()");
+}
+
+void GL_GraphicsDriver::begin_polygon()
+{
+    pathPoints.clear();
+    LOG("()");
+}
+
+void GL_GraphicsDriver::begin_complex_polygon()
+{
+    pathPoints.clear();
+    cpolyContours.clear();
+    LOG("()");
+}
+
+void GL_GraphicsDriver::vertex(double x, double y)
+{
+    double xf = transform_x(x, y), yf = transform_y(x, y);
+    if(pathPoints.empty())
+        CurrentMatrix(pathMatrix);
+    // Nearly always the matrix is still the path's, and the point is kept as
+    // is. If not it's brought into the path's coordinates.
+    const double * m = pathMatrix;
+    if(x*m[0] + y*m[2] + m[4] == xf && x*m[1] + y*m[3] + m[5] == yf) {
+        pathPoints.push_back(x);
+        pathPoints.push_back(y);
+    }
+    else {
+        transformed_vertex(xf, yf);
+    }
+}
+
+void GL_GraphicsDriver::transformed_vertex(double xf, double yf)
+{
+    if(pathPoints.empty())
+        CurrentMatrix(pathMatrix);
+    double * m = pathMatrix;
+    double det = m[0]*m[3] - m[1]*m[2];
+    if(det == 0) {
+        // A degenerate matrix can't be undone, so the path goes over to
+        // transformed coordinates.
+        for(size_t j = 0; j + 1 < pathPoints.size(); j += 2) {
+            double x = pathPoints[j], y = pathPoints[j + 1];
+            pathPoints[j] = x*m[0] + y*m[2] + m[4];
+            pathPoints[j + 1] = x*m[1] + y*m[3] + m[5];
+        }
+        std::copy(kIdentity, kIdentity + 6, m);
+        det = 1;
+    }
+    double dx = xf - m[4], dy = yf - m[5];
+    pathPoints.push_back((m[3]*dx - m[2]*dy)/det);
+    pathPoints.push_back((m[0]*dy - m[1]*dx)/det);
+}
+
+void GL_GraphicsDriver::curve(double X0, double Y0, double X1, double Y1,
+                              double X2, double Y2, double X3, double Y3)
+{
+    // A transformed Bezier is the Bezier of the transformed control points,
+    // so the flatness is judged by those.
+    double x0 = transform_x(X0, Y0), y0 = transform_y(X0, Y0);
+    double x1 = transform_x(X1, Y1), y1 = transform_y(X1, Y1);
+    double x2 = transform_x(X2, Y2), y2 = transform_y(X2, Y2);
+    double x3 = transform_x(X3, Y3), y3 = transform_y(X3, Y3);
+    
+    // Chords of length 1/n in t miss by at most 3/4*L/n^2, L being the
+    // largest second difference of the control points.
+    double L = max(hypot(x0 - 2*x1 + x2, y0 - 2*y1 + y2), hypot(x1 - 2*x2 + x3, y1 - 2*y2 + y3));
+    int n = min(max((int)ceil(sqrt(0.75*L/kFlatness)), 1), kMaxSegments);
+    
+    // Forward differencing, adds only
+    double t = 1.0/n, t2 = t*t, t3 = t2*t;
+    double ax = X3 - 3*X2 + 3*X1 - X0, ay = Y3 - 3*Y2 + 3*Y1 - Y0;
+    double bx = 3*(X2 - 2*X1 + X0), by = 3*(Y2 - 2*Y1 + Y0);
+    double cx = 3*(X1 - X0), cy = 3*(Y1 - Y0);
+    double dx1 = ax*t3 + bx*t2 + cx*t, dy1 = ay*t3 + by*t2 + cy*t;
+    double dx2 = 6*ax*t3 + 2*bx*t2, dy2 = 6*ay*t3 + 2*by*t2;
+    double dx3 = 6*ax*t3, dy3 = 6*ay*t3;
+    double x = X0, y = Y0;
+    vertex(x, y);
+    for(int j = 1; j < n; ++j) {
+        x += dx1; y += dy1;
+        dx1 += dx2; dy1 += dy2;
+        dx2 += dx3; dy2 += dy3;
+        vertex(x, y);
+    }
+    vertex(X3, Y3);
+}
+
+void GL_GraphicsDriver::arc(double x, double y, double r, double start, double end)
+{
+    // Segments enough for the larger radius once transformed
+    double ux = transform_dx(r, 0), uy = transform_dy(r, 0);
+    double vx = transform_dx(0, r), vy = transform_dy(0, r);
+    double scaledR = sqrt(max(ux*ux + uy*uy, vx*vx + vy*vy));
+    double th1 = start*M_PI/180, th2 = end*M_PI/180;
+    // Angles run counterclockwise with y down, as for the other arcs
+    ArcPoints(th1, th2, ArcSegments(scaledR, th2 - th1), [&](double c, double s) {
+        vertex(x + c*r, y - s*r);
+    });
+}
+
 
 void GL_GraphicsDriver::end_points()
 {
-    glBegin(GL_POINTS);
-    XPOINT * p = vertices();
-    for(int j = 0, n = vertex_no(); j < n; ++j)
-        gl_vertex(p[j].x, p[j].y);
-    glEnd();
+    StartStroke();
+    const double * p = TransformPoints(pathMatrix, pathPoints, false);
+    batch.begin(GL_POINTS);
+    for(int j = 0, n = pathPoints.size()/2; j < n; ++j)
+        batch.vertex(p[2*j], p[2*j + 1]);
+    batch.end();
     LOG("()");
 }
 
 void GL_GraphicsDriver::end_line()
 {
     StartSolid();// Not actually solid, but treated as such for AA
-    glBegin(GL_LINE_STRIP);
-    XPOINT * p = vertices();
-    for(int j = 0, n = vertex_no(); j < n; ++j)
-        gl_vertex(p[j].x, p[j].y);
-    glEnd();
-    EndSolid();
+    const double * p = TransformPoints(pathMatrix, pathPoints, batch.stroke() != nullptr);
+    batch.begin(GL_LINE_STRIP);
+    for(int j = 0, n = pathPoints.size()/2; j < n; ++j)
+        batch.vertex(p[2*j], p[2*j + 1]);
+    batch.end();
     LOG("()");
 }
 
 void GL_GraphicsDriver::end_loop()
 {
     StartSolid();// Not actually solid, but treated as such for AA
-    glBegin(GL_LINE_LOOP);
-    XPOINT * p = vertices();
-    for(int j = 0, n = vertex_no(); j < n; ++j)
-        gl_vertex(p[j].x, p[j].y);
-    glEnd();
-    EndSolid();
+    const double * p = TransformPoints(pathMatrix, pathPoints, batch.stroke() != nullptr);
+    batch.begin(GL_LINE_LOOP);
+    for(int j = 0, n = pathPoints.size()/2; j < n; ++j)
+        batch.vertex(p[2*j], p[2*j + 1]);
+    batch.end();
     LOG("()");
 }
 
 void GL_GraphicsDriver::end_polygon()
 {
     StartSolid();
-    glBegin(GL_POLYGON);
-    XPOINT * p = vertices();
-    for(int j = 0, n = vertex_no(); j < n; ++j)
-        gl_vertex(p[j].x, p[j].y);
-    glEnd();
-    EndSolid();
+    const double * p = TransformPoints(pathMatrix, pathPoints, aaMode == COVERAGE_AA);
+    int n = pathPoints.size()/2;
+    batch.begin(GL_POLYGON);
+    for(int j = 0; j < n; ++j)
+        batch.vertex(p[2*j], p[2*j + 1]);
+    batch.end();
+    if(aaMode == COVERAGE_AA) {
+        fringePoints.assign(p, p + 2*n);
+        Fringe();
+    }
     LOG("()");
 }
 
 
-// void GL_GraphicsDriver::begin_complex_polygon()
-// {
-//     fltk3::GraphicsDriver::begin_complex_polygon();
-//     LOG("()");
-// }
-
-static void TessCombineCB(GLdouble coords[3], GLvoid * points[4], GLfloat weights[4], GLvoid ** vertData, GLvoid * userData)
+bool GL_GraphicsDriver::HaveStencil()
 {
-    // Tesselator generated a new vertex, needs somewhere to put it
-    double * newPt = new double[3];
-    ((std::vector<double *>*)userData)->push_back(newPt);
-    newPt[0] = coords[0];
-    newPt[1] = coords[1];
-    newPt[2] = coords[2];
-    *vertData = newPt;
+    if(stencilBits < 0) {
+        if(core) {
+            // GL_STENCIL_BITS is gone, ask the framebuffer
+            GLint fbo, type = GL_NONE;
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fbo);
+            GLenum attachment = fbo? GL_STENCIL_ATTACHMENT : GL_STENCIL;
+            glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, attachment,
+                                                  GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+            stencilBits = 0;
+            if(type != GL_NONE)
+                glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, attachment,
+                                                      GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+        }
+        else {
+            glGetIntegerv(GL_STENCIL_BITS, &stencilBits);
+        }
+        if(stencilBits > 0) {
+            int clipBits = stencilBits/2;
+            clipShift = stencilBits - clipBits;
+            fillMask = (1u << clipShift) - 1;
+            clipMask = ((1u << clipBits) - 1) << clipShift;
+    
+            // StencilFill() and pop_clip() leave the buffer zeroed, but it has
+            // to start out that way.
+            batch.flush();
+            GLint clearValue;
+            glGetIntegerv(GL_STENCIL_CLEAR_VALUE, &clearValue);
+            GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+            glDisable(GL_SCISSOR_TEST);
+            glStencilMask(~0u);
+            glClearStencil(0);
+            glClear(GL_STENCIL_BUFFER_BIT);
+            glClearStencil(clearValue);
+            if(scissor)
+                glEnable(GL_SCISSOR_TEST);
+        }
+    }
+    return stencilBits > 0;
 }
 
-static void TessErrorCB(GLenum errorCode)
+// A fan from the first of the n points pts over every edge of the contours
+// in cpolyContours, which counts crossings (or windings) into the stencil
+// buffer. bounds gets x0, y0, x1, y1 of the points.
+void GL_GraphicsDriver::StencilFan(const double * pts, int n, double bounds[4])
 {
-    cerr << "GLU tesselation error: " << gluErrorString(errorCode) << endl;
+    float px = pts[0], py = pts[1];
+    double x0 = px, y0 = py, x1 = px, y1 = py;
+    
+    batch.begin(GL_TRIANGLES);
+    size_t contour = 0;
+    for(int start = 0; start < n;) {
+        int end = (contour < cpolyContours.size())? cpolyContours[contour++] : n;
+        for(int j = start; j < end; ++j) {
+            int k = (j + 1 < end)? j + 1 : start;
+            batch.vertex(px, py);
+            batch.vertex(pts[2*j], pts[2*j + 1]);
+            batch.vertex(pts[2*k], pts[2*k + 1]);
+            x0 = std::min(x0, pts[2*j]);
+            x1 = std::max(x1, pts[2*j]);
+            y0 = std::min(y0, pts[2*j + 1]);
+            y1 = std::max(y1, pts[2*j + 1]);
+        }
+        start = end;
+    }
+    batch.end();
+    bounds[0] = x0;
+    bounds[1] = y0;
+    bounds[2] = x1;
+    bounds[3] = y1;
 }
 
-void GL_GraphicsDriver::end_complex_polygon()
+// Fill the n points pts by stencil-then-cover: StencilFan() counts into the
+// lower stencil bits, within the clip level, then the bounding box is drawn
+// where the count says inside, zeroing the count as it goes.
+void GL_GraphicsDriver::StencilFill(const double * pts, int n)
 {
-    XPOINT * p = vertices();
-    std::vector<double> cpolyPts;
-    std::vector<double *> newPts;
-    
-    // Copy points to temp buffer
-    for(int j = 0, n = vertex_no(); j < n; ++j) {
-        cpolyPts.push_back(to_gl_x(p[j].x));
-        cpolyPts.push_back(to_gl_y(p[j].y));
-        cpolyPts.push_back(0.0);
+    StartSolid();
+    batch.flush();
+    state.enable(GL_StateCache::STENCIL_TEST);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glStencilMask(fillMask);
+    int level = regionStack.top().level;
+    glStencilFunc(level? GL_EQUAL : GL_ALWAYS, level << clipShift, clipMask);
+    if(cpolyMode == STENCIL_NONZERO) {
+        // Wrapping so that windings beyond the range of the count still
+        // cancel. The write mask keeps it out of the clip levels.
+        glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_KEEP, GL_INCR_WRAP);
+        glStencilOpSeparate(GL_BACK, GL_KEEP, GL_KEEP, GL_DECR_WRAP);
+    }
+    else {
+        glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
     }
     
-    // Tesselate polygon
-    StartSolid();
-    GLUtriangulatorObj * cpoly = gluNewTess();
-    gluTessCallback(cpoly, GLU_TESS_BEGIN, (GLvoid (*)())glBegin);
-    gluTessCallback(cpoly, GLU_TESS_VERTEX, (GLvoid (*)())glVertex3dv);
-    gluTessCallback(cpoly, GLU_TESS_COMBINE_DATA, (GLvoid (*)())TessCombineCB);
-    gluTessCallback(cpoly, GLU_TESS_END, (GLvoid (*)())glEnd);
-    gluTessCallback(cpoly, GLU_TESS_ERROR, (GLvoid (*)())TessErrorCB);
-    
-    gluTessBeginPolygon(cpoly, (GLvoid*)&newPts);
-    gluTessBeginContour(cpoly);
-    
-    std::vector<int>::iterator cont = cpolyContours.begin();
-    for(int j = 0, n = vertex_no(); j < n; ++j)
-    {
-        if(cont != cpolyContours.end() && *cont == j) {
-            gluTessEndContour(cpoly);
-            gluTessBeginContour(cpoly);
-            ++cont;
+    double bounds[4];
+    StencilFan(pts, n, bounds);
+    batch.flush();
+    
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glStencilFunc(GL_NOTEQUAL, 0, fillMask);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+    batch.begin(GL_QUADS);
+    batch.vertex(bounds[0] - 1, bounds[1] - 1);
+    batch.vertex(bounds[2] + 1, bounds[1] - 1);
+    batch.vertex(bounds[2] + 1, bounds[3] + 1);
+    batch.vertex(bounds[0] - 1, bounds[3] + 1);
+    batch.end();
+    batch.flush();
+    clipLevel = -1;
+    ClipStencil();
+}
+
+// Whether x, y is inside the contours of the n points pts, by the nonzero or
+// the even-odd rule
+static bool Inside(const double * pts, int n, const std::vector<int> & contours, double x, double y, bool nonzero)
+{
+    int winding = 0;
+    size_t contour = 0;
+    for(int start = 0; start < n;) {
+        int end = (contour < contours.size())? contours[contour++] : n;
+        for(int j = start, k = end - 1; j < end; k = j++) {
+            double x0 = pts[2*k], y0 = pts[2*k + 1], x1 = pts[2*j], y1 = pts[2*j + 1];
+            if((y0 <= y) != (y1 <= y) && x0 + (y - y0)*(x1 - x0)/(y1 - y0) > x)
+                winding += (y1 > y0)? 1 : -1;
         }
-        gluTessVertex(cpoly, &(cpolyPts[j*3]), &(cpolyPts[j*3]));
+        start = end;
+    }
+    return nonzero? winding != 0 : (winding & 1) != 0;
+}
+
+void GL_GraphicsDriver::end_complex_polygon()
+{
+    int n = pathPoints.size()/2;
+    if(n < 3) {
+        cpolyContours.clear();
+        return;
     }
     
-    gluTessEndContour(cpoly);
-    gluTessEndPolygon(cpoly);
-    gluDeleteTess(cpoly);
+    // In the path's own coordinates a shape only moved, rotated or scaled by
+    // the matrix is the same shape, so its triangulation stays cached.
+    const double * pts = TransformPoints(pathMatrix, pathPoints, aaMode == COVERAGE_AA);
     
-    std::vector<double *>::iterator np = newPts.begin();
-    while(np != newPts.end()) {
-        delete[] *np;
-        ++np;
+    if(cpolyMode != TESSELLATE && HaveStencil()) {
+        StencilFill(pts, n);
+    }
+    else {
+        // Triangles come back relative to the first point, often from the cache
+        const std::vector<float> & tris = tessellator->triangulate(pts, n, cpolyContours);
+        float x0 = pts[0], y0 = pts[1];
+        StartSolid();
+        batch.begin(GL_TRIANGLES);
+        for(size_t j = 0; j + 1 < tris.size(); j += 2)
+            batch.vertex(tris[j] + x0, tris[j + 1] + y0);
+        batch.end();
+    }
+    
+    if(aaMode == COVERAGE_AA) {
+        // Each contour has its own fringe, on the side of it that isn't
+        // filled, so holes are fringed into the hole whichever way they wind.
+        // A contour that crosses itself or others can have the fill on
+        // either side, so points just left of a few of its edges vote by
+        // edge length.
+        const int kSampleEdges = 8;
+        bool nonzero = cpolyMode == STENCIL_NONZERO && HaveStencil();
+        size_t contour = 0;
+        for(int start = 0; start < n;) {
+            int end = (contour < cpolyContours.size())? cpolyContours[contour++] : n;
+            int m = end - start, step = max(m/kSampleEdges, 1);
+            double vote = 0;
+            for(int j = 0; j < m; j += step) {
+                const double * p0 = pts + 2*(start + j), * p1 = pts + 2*(start + (j + 1)%m);
+                double dx = p1[0] - p0[0], dy = p1[1] - p0[1];
+                double l = sqrt(dx*dx + dy*dy);
+                if(l == 0)
+                    continue;
+                for(int t = 1; t < 4; ++t) {
+                    double x = p0[0] + dx*t/4 + dy/l*1e-3, y = p0[1] + dy*t/4 - dx/l*1e-3;
+                    vote += Inside(pts, n, cpolyContours, x, y, nonzero)? -l : l;
+                }
+            }
+            if(vote != 0) {
+                fringePoints.assign(pts + 2*start, pts + 2*end);
+                batch.fringe(&fringePoints[0], m, (vote > 0)? 1 : -1);
+            }
+            start = end;
+        }
     }
     
     cpolyContours.clear();
-    EndSolid();
     LOG("()");
 }
 
@@ -581,10 +1098,11 @@ void GL_GraphicsDriver::gap()
     // GraphicsDriver::gap() does something rather obscure, perhaps
     // closing the previous contour.
     // Instead, here we just make a note of the index.
-    if(!cpolyContours.empty() && vertex_no() == cpolyContours.back())
+    int n = pathPoints.size()/2;
+    if(!cpolyContours.empty() && n == cpolyContours.back())
         return;// No points since last call, ignore
     
-    cpolyContours.push_back(vertex_no());
+    cpolyContours.push_back(n);
     LOG("()");
 }
 
@@ -593,28 +1111,206 @@ void GL_GraphicsDriver::gap()
 // Clipping
 // ****************************************************************************
 
-void GL_GraphicsDriver::push_clip(int x, int y, int w, int h)
+// The current region within the n rectangles rects, in window coordinates,
+// pushed as the new current region
+void GL_GraphicsDriver::PushRegion(const fltk3::Rectangle * rects, int n)
 {
-    glEnable(GL_SCISSOR_TEST);
-    regionStack.push(regionStack.top());
-    regionStack.top().intersect(fltk3::Rectangle(x, y, w, h));
+    const ClipRegion & top = regionStack.top();
+    ClipRegion region;
+    region.level = top.level;
+    region.marked = false;
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+    for(const fltk3::Rectangle & a: top.rects) {
+        for(int j = 0; j < n; ++j) {
+            const fltk3::Rectangle & b = rects[j];
+            int l = std::max(a.x(), b.x()), t = std::max(a.y(), b.y());
+            int r = std::min(a.r(), b.r()), bottom = std::min(a.b(), b.b());
+            if(l >= r || t >= bottom)
+                continue;
+            region.rects.push_back(fltk3::Rectangle(l, t, r - l, bottom - t));
+            x0 = std::min(x0, l);
+            y0 = std::min(y0, t);
+            x1 = std::max(x1, r);
+            y1 = std::max(y1, bottom);
+        }
+    }
+    if(!region.rects.empty())
+        region.bounds.set(x0, y0, x1 - x0, y1 - y0);
+    regionStack.push(region);
     restore_clip();
+}
+
+// Draw in the window coordinates of clip regions, whole numbers on pixel edges
+void GL_GraphicsDriver::ClipTransform()
+{
+    const double edges[6] = {1, 0, 0, 1, -origin_x() - 0.5, -origin_y() - 0.5};
+    Transform(edges);
+}
+
+// Set up to mark the region just pushed in the stencil buffer, one level up
+// from the region around it. Shapes drawn then set the lower bits, by op,
+// where they cover the region around it; EndClipMark() raises the level
+// wherever those bits are set. False if there is no stencil level to spare,
+// in which case the region is clipped to its bounds alone.
+bool GL_GraphicsDriver::BeginClipMark(GLenum op)
+{
+    const ClipRegion & top = regionStack.top();
+    // Pixels inside the region around it are those at its level only while
+    // no other region is marked, which isn't so inside push_no_clip().
+    if(!HaveStencil() || top.level != stencilTop || (GLuint)(stencilTop + 1) << clipShift > clipMask) {
+        static bool warned = false;
+        if(!warned)
+            cerr << "GL_GraphicsDriver: no stencil level for clip region, clipping to its bounds" << endl;
+        warned = true;
+        return false;
+    }
+    
+    StartSolid();
+    batch.flush();
+    state.enable(GL_StateCache::STENCIL_TEST);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glStencilMask(fillMask);
+    glStencilFunc(GL_EQUAL, (top.level << clipShift) | 1, clipMask);
+    glStencilOp(GL_KEEP, GL_KEEP, op);
+    clipLevel = -1;
+    return true;
+}
+
+void GL_GraphicsDriver::EndClipMark()
+{
+    ClipRegion & top = regionStack.top();
+    top.level = ++stencilTop;
+    top.marked = true;
+    
+    // Replacing the lower bits as well zeroes them again
+    glStencilMask(clipMask | fillMask);
+    glStencilFunc(GL_NOTEQUAL, top.level << clipShift, fillMask);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    ClipTransform();
+    batch.begin(GL_QUADS);
+    RectVertices(top.bounds.x(), top.bounds.y(), top.bounds.w(), top.bounds.h());
+    batch.end();
+    batch.flush();
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    ClipStencil();
+}
+
+// Test the stencil buffer for the current region's level, if it has one
+void GL_GraphicsDriver::ClipStencil()
+{
+    int level = regionStack.top().level;
+    if(level == clipLevel)
+        return;
+    
+    batch.flush();
+    state.enable(GL_StateCache::STENCIL_TEST, level > 0);
+    if(level > 0) {
+        glStencilFunc(GL_EQUAL, level << clipShift, clipMask);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    }
+    clipLevel = level;
+}
+
+void GL_GraphicsDriver::push_clip(int x, int y, int w, int h)
+{
+    fltk3::Rectangle rect(x + origin_x(), y + origin_y(), w, h);
+    PushRegion(&rect, 1);
+    LOG("()");
+}
+
+void GL_GraphicsDriver::push_clip(const fltk3::Rectangle * rects, int n)
+{
+    std::vector<fltk3::Rectangle> window(rects, rects + n);
+    for(fltk3::Rectangle & r: window)
+        r.set(r.x() + origin_x(), r.y() + origin_y(), r.w(), r.h());
+    PushRegion(window.data(), n);
+    
+    // Rectangles within the bounds of one need no marking
+    const ClipRegion & top = regionStack.top();
+    if(top.rects.size() > 1 && BeginClipMark(GL_REPLACE)) {
+        ClipTransform();
+        batch.begin(GL_QUADS);
+        for(const fltk3::Rectangle & r: top.rects)
+            RectVertices(r.x(), r.y(), r.w(), r.h());
+        batch.end();
+        batch.flush();
+        EndClipMark();
+    }
+    LOG("()");
+}
+
+void GL_GraphicsDriver::push_clip_path()
+{
+    int n = pathPoints.size()/2;
+    if(n < 3) {
+        PushRegion(nullptr, 0);
+        cpolyContours.clear();
+        return;
+    }
+    
+    // Pixels the path may cover, whose centers are whole coordinates
+    double x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+    const double * m = pathMatrix;
+    for(int j = 0; j < n; ++j) {
+        double x = pathPoints[2*j], y = pathPoints[2*j + 1];
+        double wx = m[0]*x + m[2]*y + m[4], wy = m[1]*x + m[3]*y + m[5];
+        x0 = std::min(x0, wx);
+        y0 = std::min(y0, wy);
+        x1 = std::max(x1, wx);
+        y1 = std::max(y1, wy);
+    }
+    int l = floor(x0 + 0.5) + origin_x(), t = floor(y0 + 0.5) + origin_y();
+    int r = ceil(x1 + 0.5) + origin_x(), b = ceil(y1 + 0.5) + origin_y();
+    fltk3::Rectangle bounds(l, t, r - l, b - t);
+    PushRegion(&bounds, 1);
+    
+    if(!regionStack.top().rects.empty() && BeginClipMark(GL_INVERT)) {
+        double fanBounds[4];
+        Transform(pathMatrix);
+        StencilFan(pathPoints.data(), n, fanBounds);
+        batch.flush();
+        EndClipMark();
+    }
+    cpolyContours.clear();
     LOG("()");
 }
 
 void GL_GraphicsDriver::push_no_clip()
 {
-    glDisable(GL_SCISSOR_TEST);
-    regionStack.push(fltk3::Rectangle(0, 0, viewW, viewH));
+    ClipRegion region;
+    region.bounds.set(0, 0, viewW, viewH);
+    region.rects.push_back(region.bounds);
+    region.level = 0;
+    region.marked = false;
+    regionStack.push(region);
+    restore_clip();
     LOG("()");
 }
 
 void GL_GraphicsDriver::pop_clip()
 {
+    const ClipRegion & top = regionStack.top();
+    if(top.marked) {
+        // Lower the level where it was raised. Levels above were lowered by
+        // pop_clip() before, so it is wherever the stencil is over the level
+        // below.
+        StartSolid();
+        batch.flush();
+        state.enable(GL_StateCache::STENCIL_TEST);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glStencilMask(clipMask);
+        glStencilFunc(GL_LESS, (top.level - 1) << clipShift, clipMask);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+        ClipTransform();
+        batch.begin(GL_QUADS);
+        RectVertices(top.bounds.x(), top.bounds.y(), top.bounds.w(), top.bounds.h());
+        batch.end();
+        batch.flush();
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        --stencilTop;
+        clipLevel = -1;
+    }
     regionStack.pop();
-    fltk3::Rectangle & r = regionStack.top();
-    if(r.x() == 0 && r.y() == 0 && r.w() == viewW && r.h() == viewH)
-        glDisable(GL_SCISSOR_TEST);
     restore_clip();
     LOG("()");
 }
@@ -622,12 +1318,30 @@ void GL_GraphicsDriver::pop_clip()
 int GL_GraphicsDriver::clip_box(int x, int y, int w, int h, int & X, int & Y, int & W, int & H)
 {
     LOG("()");
-    fltk3::Rectangle rect(x, y, w, h);
-    rect.intersect(regionStack.top());
-    X = rect.x();
-    Y = rect.y();
-    W = rect.w();
-    H = rect.h();
+    // Bounds of the parts of the rectangle in each of the region's
+    int ox = origin_x(), oy = origin_y();
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+    for(const fltk3::Rectangle & r: regionStack.top().rects) {
+        int l = std::max(x + ox, r.x()), t = std::max(y + oy, r.y());
+        int right = std::min(x + ox + w, r.r()), b = std::min(y + oy + h, r.b());
+        if(l >= right || t >= b)
+            continue;
+        x0 = std::min(x0, l);
+        y0 = std::min(y0, t);
+        x1 = std::max(x1, right);
+        y1 = std::max(y1, b);
+    }
+    if(x0 < x1) {
+        X = x0 - ox;
+        Y = y0 - oy;
+        W = x1 - x0;
+        H = y1 - y0;
+    }
+    else {
+        X = x;
+        Y = y;
+        W = H = 0;
+    }
     return x != X || y != Y || w != W || h != H;
 }
 
@@ -636,12 +1350,29 @@ int GL_GraphicsDriver::not_clipped(int x, int y, int w, int h)
     // Return 1 if part of the rect is not clipped.
     // (Return 0 if rect is entirely outside of the clipping region)
     LOG("()");
-    return regionStack.top().intersects(fltk3::Rectangle(x, y, w, h));
+    fltk3::Rectangle rect(x + origin_x(), y + origin_y(), w, h);
+    const ClipRegion & top = regionStack.top();
+    if(!top.bounds.intersects(rect))
+        return 0;
+    for(const fltk3::Rectangle & r: top.rects) {
+        if(r.intersects(rect))
+            return 1;
+    }
+    return 0;
 }
 
 
 void GL_GraphicsDriver::restore_clip() {
-    glScissor(regionStack.top().x(), regionStack.top().y(), regionStack.top().w(), regionStack.top().h());
+    // The state cache drops the enable/scissor calls when the clip is unchanged.
+    // GL counts scissor rows up from the bottom.
+    const ClipRegion & top = regionStack.top();
+    const fltk3::Rectangle & r = top.bounds;
+    bool noClip = (top.level == 0 && top.rects.size() == 1 &&
+                   r.x() <= 0 && r.y() <= 0 && r.r() >= viewW && r.b() >= viewH);
+    state.enable(GL_StateCache::SCISSOR_TEST, !noClip);
+    if(!noClip)
+        state.scissor(r.x(), viewH - r.b(), r.w(), r.h());
+    ClipStencil();
     LOG("()");
 }
 
@@ -650,23 +1381,120 @@ void GL_GraphicsDriver::restore_clip() {
 // Images
 // ****************************************************************************
 
-void GL_GraphicsDriver::draw_image(const uchar * buf, int X, int Y, int W, int H, int D, int L)
+// Draw a texture over the pixels x..x+w-1, y..y+h-1. If tinted it's
+// multiplied by the current color, otherwise drawn as is.
+void GL_GraphicsDriver::TexturedRect(GLuint tex, double x, double y, double w, double h,
+                                     float u0, float v0, float u1, float v1, bool tinted)
 {
-    if(L == 0)
-        L = W*D;
+    state.bind_texture(tex);
+    uint8_t saved[4];
+    const uint8_t * c = batch.color();
+    for(int j = 0; j < 4; ++j)
+        saved[j] = c[j];
+    if(!tinted)
+        batch.color(255, 255, 255);
+    
+    // Pixel edges are half a pixel before their centers, as in rectf()
+    double x0 = x - 0.5, x1 = x0 + w;
+    double y0 = y - 0.5, y1 = y0 + h;
+    OriginTransform();
+    batch.begin(GL_QUADS);
+    batch.vertex(x0, y0, u0, v0);
+    batch.vertex(x0, y1, u0, v1);
+    batch.vertex(x1, y1, u1, v1);
+    batch.vertex(x1, y0, u1, v0);
+    batch.end();
     
+    batch.color(saved[0], saved[1], saved[2], saved[3]);
+}
+
+// Draw the W*H area at cx, cy of an iw*ih image from the texture cache. D and L
+// are draw_image() strides and may be negative. Returns false if the image
+// can't be cached.
+bool GL_GraphicsDriver::DrawCachedImage(const void * id, uint32_t generation, const uchar * buf, int iw, int ih,
+                                        int D, int L, int X, int Y, int W, int H, int cx, int cy)
+{
+    // Textures are stored with the lowest address first, so negative strides
+    // become flipped texture coordinates.
+    const uchar * base = buf;
+    bool flipU = D < 0, flipV = L < 0;
+    if(flipU)
+        base += (iw - 1)*D;
+    if(flipV)
+        base += (ih - 1)*L;
+    
+    // lookup() may delete textures, so none may be bound or have pending vertices
+    state.bind_texture(atlas->texture());
+    bool current;
+    GL_TextureCache::Texture * t = textures->lookup(id, base, generation, iw, ih, abs(D), abs(L), current);
+    if(!t)
+        return false;
+    if(!current) {
+        state.bind_texture(t->tex);
+        textures->upload(t, base);
+    }
+    
+    float u0 = (float)cx/iw, u1 = (float)(cx + W)/iw;
+    float v0 = (float)cy/ih, v1 = (float)(cy + H)/ih;
+    if(flipU) {
+        u0 = 1 - u0;
+        u1 = 1 - u1;
+    }
+    if(flipV) {
+        v0 = 1 - v0;
+        v1 = 1 - v1;
+    }
+    TexturedRect(t->tex, X, Y, W, H, u0, v0, u1, v1);
+    return true;
+}
+
+// Draw pixels straight to the framebuffer. buf may be an offset into a bound
+// pixel buffer, if D and L are positive and L is whole pixels.
+void GL_GraphicsDriver::DrawPixels(const uchar * buf, int X, int Y, int W, int H, int D, int L)
+{
+    // GL's row length is in pixels, so rows padded by other than whole
+    // pixels are packed first
+    std::vector<uchar> packed;
+    if(D != 0 && L%D != 0) {
+        int d = abs(D);
+        packed.resize((size_t)W*H*d);
+        for(int y = 0; y < H; ++y)
+        for(int x = 0; x < W; ++x)
+            memcpy(&packed[d*((size_t)y*W + x)], buf + (ptrdiff_t)y*L + (ptrdiff_t)x*D, d);
+        buf = &packed[0];
+        D = d;
+        L = W*d;
+    }
+    
+    if(core) {
+        DrawPixelsTextured(buf, X, Y, W, H, D, L);
+        return;
+    }
+    
+    // Fragments from glDrawPixels() are textured too, so make sure that's
+    // with the atlas' solid texel.
+    ImmediateMode();
     glPixelZoom((D < 0)? -1 : 1, (L < 0)? 1 : -1);
     
+    // Pixels are read from the lowest address, so with negative strides that
+    // is the right or bottom edge of the image.
     if(D < 0) {
+        buf += (W - 1)*D;
         D = -D;
         X += W;
     }
     if(L < 0) {
+        buf += (H - 1)*L;
         L = -L;
-        Y -= H;
+        Y += H;
     }
     
-    glRasterPos2i(origin_x() + X, viewH - (origin_y() + Y));
+    // A raster position off the window is invalid and nothing would be
+    // drawn, so it's set on the window and moved from there by glBitmap(),
+    // which doesn't clip it.
+    glRasterPos2i(0, 0);
+    glBitmap(0, 0, 0, 0, origin_x() + X, viewH - (origin_y() + Y), nullptr);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     glPixelStorei(GL_UNPACK_ROW_LENGTH, L/D);
     switch(D)
     {
@@ -677,6 +1505,54 @@ void GL_GraphicsDriver::draw_image(const uchar * buf, int X, int Y, int W, int H
         default:
             cerr << __func__ << "Image depth not supported by GL_GraphicsDriver" << endl;
     }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+// DrawPixels() for core profiles, which have no glDrawPixels(): upload to the
+// pipeline's pixel texture and draw that.
+void GL_GraphicsDriver::DrawPixelsTextured(const uchar * buf, int X, int Y, int W, int H, int D, int L)
+{
+    static const GLenum kFormats[4] = {GL_LUMINANCE, GL_LUMINANCE_ALPHA, GL_RGB, GL_RGBA};
+    if(abs(D) < 1 || abs(D) > 4) {
+        cerr << __func__ << "Image depth not supported by GL_GraphicsDriver" << endl;
+        return;
+    }
+    
+    // As in DrawCachedImage(), negative strides become flipped coordinates
+    bool flipU = D < 0, flipV = L < 0;
+    if(flipU)
+        buf += (W - 1)*D;
+    if(flipV)
+        buf += (H - 1)*L;
+    
+    // The texture is redefined for each image, so draw what's queued from it
+    GLuint tex = pipeline->pixel_texture();
+    state.bind_texture(tex);
+    batch.flush();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, abs(L)/abs(D));
+    GL_TexImage(kFormats[abs(D) - 1], W, H, buf);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    
+    TexturedRect(tex, X, Y, W, H, flipU? 1 : 0, flipV? 1 : 0, flipU? 0 : 1, flipV? 0 : 1);
+}
+
+void GL_GraphicsDriver::draw_image(const uchar * buf, int X, int Y, int W, int H, int D, int L)
+{
+    if(L == 0)
+        L = W*abs(D);
+    
+    // Only buffers registered with the texture cache are known not to change
+    // behind our back.
+    uint32_t generation;
+    if(textures->tracked(buf, generation) &&
+       DrawCachedImage(buf, generation, buf, W, H, D, L, X, Y, W, H, 0, 0))
+    {
+        LOG("(const uchar * buf)");
+        return;
+    }
+    
+    DrawPixels(buf, X, Y, W, H, D, L);
     LOG("(const uchar * buf)");
 }
 void GL_GraphicsDriver::draw_image_mono(const uchar * buf, int X, int Y, int W, int H, int D, int L) {
@@ -684,14 +1560,42 @@ void GL_GraphicsDriver::draw_image_mono(const uchar * buf, int X, int Y, int W,
     LOG("(const uchar * buf)");
 }
 
+static std::unordered_set<fltk3::DrawImageCb> & ThreadSafeCallbacks() {
+    static std::unordered_set<fltk3::DrawImageCb> callbacks;
+    return callbacks;
+}
+
+void GL_GraphicsDriver::thread_safe_image_callback(fltk3::DrawImageCb cb, bool safe) {
+    if(safe)
+        ThreadSafeCallbacks().insert(cb);
+    else
+        ThreadSafeCallbacks().erase(cb);
+}
+
 void GL_GraphicsDriver::draw_image(fltk3::DrawImageCb cb, void * data, int X, int Y, int W, int H, int D) {
-    // Reconstruct image
-    uint8_t * buf = new uint8_t[D*W*H];
-    for(int y = 0; y < H; ++y)
-        cb(data, 0, y, W, buf + D*W*y);
+    if(W <= 0 || H <= 0)
+        return;
+    
+    // Reconstruct image in staging memory, directly in a pixel buffer if we
+    // have them.
+    size_t row = (size_t)W*D;
+    GL_StagingBuffer & staging = GL_StagingBuffer::shared();
+    uint8_t * buf = staging.map(row*H);
+    auto rows = [&](int y0, int y1) {
+        for(int y = y0; y < y1; ++y)
+            cb(data, 0, y, W, buf + row*y);
+    };
     
-    draw_image(buf, X, Y, W, H, D, 0);
-    delete[] buf;
+    // Small images aren't worth waking the workers for
+    const int kMinParallelPixels = 128*128;
+    WorkerPool & pool = WorkerPool::shared();
+    if(W*H >= kMinParallelPixels && pool.size() > 1 && ThreadSafeCallbacks().count(cb))
+        pool.parallel_for(H, std::max(H/(4*pool.size()), 1), rows);
+    else
+        rows(0, H);
+    
+    DrawPixels((const uchar *)staging.unmap(), X, Y, W, H, D, row);
+    staging.release();
     LOG("(fltk3::DrawImageCb cb)");
 }
 void GL_GraphicsDriver::draw_image_mono(fltk3::DrawImageCb cb, void * data, int X, int Y, int W, int H, int D) {
@@ -700,6 +1604,78 @@ void GL_GraphicsDriver::draw_image_mono(fltk3::DrawImageCb cb, void * data, int
 }
 
 
+// Restrict the area drawn to the image, as FLTK's own drivers do
+static bool ClipImage(fltk3::Image * img, int & X, int & Y, int & W, int & H, int & cx, int & cy) {
+    if(cx < 0) {
+        W += cx;
+        X -= cx;
+        cx = 0;
+    }
+    if(cy < 0) {
+        H += cy;
+        Y -= cy;
+        cy = 0;
+    }
+    W = std::min(W, img->w() - cx);
+    H = std::min(H, img->h() - cy);
+    return W > 0 && H > 0;
+}
+
+static bool DecodePixmap(fltk3::Image * img, uint8_t * rgba) {
+    return imageconv::xpm_to_rgba(img->data(), img->w(), img->h(), rgba);
+}
+static bool DecodeBitmap(fltk3::Image * img, uint8_t * rgba) {
+    imageconv::bits_to_rgba(((fltk3::Bitmap *)img)->array, img->w(), img->h(), rgba);
+    return true;
+}
+
+// Draw the W*H area at cx, cy of a Pixmap or Bitmap from the icon atlas, or
+// the texture cache if it's too big for the atlas. decode() converts the
+// image to RGBA, and is only called when it isn't already resident. data
+// identifies the image contents.
+bool GL_GraphicsDriver::DrawIcon(fltk3::Image * img, const void * data, bool (*decode)(fltk3::Image *, uint8_t *),
+                                 int X, int Y, int W, int H, int cx, int cy, bool tinted)
+{
+    int iw = img->w(), ih = img->h();
+    if(GL_IconAtlas::fits(iw, ih)) {
+        state.bind_texture(icons->texture());
+        const GL_IconAtlas::Icon * icon = icons->find(img, data, iw, ih);
+        if(!icon) {
+            imagePixels.resize(4*iw*ih);
+            if(!decode(img, &imagePixels[0]))
+                return false;
+            icon = icons->add(img, data, iw, ih, &imagePixels[0]);
+            if(!icon) {
+                batch.flush();
+                icons->clear();
+                icon = icons->add(img, data, iw, ih, &imagePixels[0]);
+            }
+        }
+        float du = (icon->u1 - icon->u0)/iw, dv = (icon->v1 - icon->v0)/ih;
+        TexturedRect(icons->texture(), X, Y, W, H, icon->u0 + cx*du, icon->v0 + cy*dv,
+                     icon->u0 + (cx + W)*du, icon->v0 + (cy + H)*dv, tinted);
+        return true;
+    }
+    
+    // lookup() may delete textures, so none may be bound or have pending vertices
+    state.bind_texture(atlas->texture());
+    bool current;
+    GL_TextureCache::Texture * t = textures->lookup(img, data, 0, iw, ih, 4, 4*iw, current);
+    if(!t)
+        return false;
+    if(!current) {
+        imagePixels.resize(4*iw*ih);
+        if(!decode(img, &imagePixels[0])) {
+            textures->invalidate(img);
+            return false;
+        }
+        state.bind_texture(t->tex);
+        textures->upload(t, &imagePixels[0]);
+    }
+    TexturedRect(t->tex, X, Y, W, H, (float)cx/iw, (float)cy/ih, (float)(cx + W)/iw, (float)(cy + H)/ih, tinted);
+    return true;
+}
+
 void draw_empty(fltk3::Image * img, int X, int Y) {
     if(img->w() > 0 && img->h() > 0) {
         fltk3::color(fltk3::FOREGROUND_COLOR);
@@ -714,26 +1690,62 @@ void GL_GraphicsDriver::draw(fltk3::RGBImage * rgb, int X, int Y, int W, int H,
         draw_empty(rgb, X, Y);
         return;
     }
-    if(W > rgb->w() - cx)
-        W = rgb->w() - cx;
-    if(H > rgb->h() - cy)
-        H = rgb->h() - cy;
+    if(!ClipImage(rgb, X, Y, W, H, cx, cy))
+        return;
     
-    // FIXME: Not at all sure if this is the right behavior...
-    const uint8_t * data = (const uint8_t *)rgb->data() + rgb->d()*(cy*rgb->ld() + cx);
-    draw_image(data, X, Y, W, H, rgb->d(), rgb->ld());
+    // ld() is bytes per line
+    int ld = rgb->ld()? rgb->ld() : rgb->w()*rgb->d();
+    const uint8_t * pixels = (const uint8_t *)rgb->data()[0];
+    if(!DrawCachedImage(rgb, 0, pixels, rgb->w(), rgb->h(), rgb->d(), ld, X, Y, W, H, cx, cy))
+        draw_image(pixels + cy*ld + cx*rgb->d(), X, Y, W, H, rgb->d(), ld);
     LOG("(fltk3::RGBImage)");
 }
-void GL_GraphicsDriver::draw(fltk3::Pixmap * pxm, int XP, int YP, int WP, int HP, int cx, int cy) {
-    LOG_UNIMPLEMENTED("(fltk3::Pixmap)");
+void GL_GraphicsDriver::draw(GL_ImageStream * stream, int X, int Y, int W, int H, int cx, int cy) {
+    W = std::min(W, stream->w() - cx);
+    H = std::min(H, stream->h() - cy);
+    if(W <= 0 || H <= 0)
+        return;
+    float iw = stream->w(), ih = stream->h();
+    TexturedRect(stream->texture(), X, Y, W, H, cx/iw, cy/ih, (cx + W)/iw, (cy + H)/ih);
+    LOG("(GL_ImageStream)");
+}
+void GL_GraphicsDriver::draw(fltk3::Pixmap * pxm, int X, int Y, int W, int H, int cx, int cy) {
+    if(!pxm->data() || pxm->w() <= 0 || pxm->h() <= 0) {
+        draw_empty(pxm, X, Y);
+        return;
+    }
+    if(!ClipImage(pxm, X, Y, W, H, cx, cy))
+        return;
+    if(!DrawIcon(pxm, pxm->data(), DecodePixmap, X, Y, W, H, cx, cy, false))
+        draw_empty(pxm, X, Y);
+    LOG("(fltk3::Pixmap)");
 }
-void GL_GraphicsDriver::draw(fltk3::Bitmap * bm, int XP, int YP, int WP, int HP, int cx, int cy) {
-    LOG_UNIMPLEMENTED("(fltk3::Bitmap)");
+void GL_GraphicsDriver::draw(fltk3::Bitmap * bm, int X, int Y, int W, int H, int cx, int cy) {
+    if(!bm->array) {
+        draw_empty(bm, X, Y);
+        return;
+    }
+    if(!ClipImage(bm, X, Y, W, H, cx, cy))
+        return;
+    // Set bits are drawn in the current color
+    DrawIcon(bm, bm->array, DecodeBitmap, X, Y, W, H, cx, cy, true);
+    LOG("(fltk3::Bitmap)");
 }
 
 void GL_GraphicsDriver::copy_offscreen(int x, int y, int w, int h, fltk3::Offscreen pixmap, int srcx, int srcy)
 {
-    LOG_UNIMPLEMENTED("()");
+    GL_Offscreen * off = GL_Offscreen::find(pixmap);
+    if(!off) {
+        LOG_UNIMPLEMENTED("(not a GL_Offscreen)");
+        return;
+    }
+    
+    // A copy, not a blend. The texture has row 0 at the bottom.
+    float tw = off->w(), th = off->h();
+    state.disable(GL_StateCache::BLEND);
+    TexturedRect(off->texture(), x, y, w, h, srcx/tw, 1 - srcy/th, (srcx + w)/tw, 1 - (srcy + h)/th);
+    state.enable(GL_StateCache::BLEND);
+    LOG("()");
 }
 
 
@@ -741,64 +1753,151 @@ void GL_GraphicsDriver::copy_offscreen(int x, int y, int w, int h, fltk3::Offscr
 // Text
 // ****************************************************************************
 
+void GL_GraphicsDriver::TextMode()
+{
+    ImmediateMode();
+    if(!glFontValid) {
+        // gl_font() goes through the current driver to look up the font, so
+        // this is the one place the replaced driver still has to be swapped in.
+        uninstall();
+        gl_font(GraphicsDriver::font(), size());
+        install();
+        glFontValid = true;
+    }
+}
+
+bool GL_GraphicsDriver::DrawGlyphs(const char * str, int n, double x, double y, int angle, bool rtl)
+{
+    if(!metrics)
+        return false;
+    fltk3::Font face = GraphicsDriver::font();
+    int fsize = size();
+    
+    // Multisampling makes no difference to pixel aligned quads, so whatever
+    // is current is left alone. FLTK's matrix doesn't apply to text.
+    state.bind_texture(atlas->texture());
+    OriginTransform();
+    
+    auto lookup = [&](uint32_t cp) -> const GL_GlyphAtlas::Glyph * {
+        const GL_GlyphAtlas::Glyph * g = atlas->glyph(face, fsize, cp);
+        if(!g) {
+            // Atlas full. Draw what's queued from it and start over.
+            batch.flush();
+            atlas->clear();
+            g = atlas->glyph(face, fsize, cp);
+        }
+        return g;
+    };
+    
+    codepoints.clear();
+    for(const char * p = str, * end = str + n; p < end;)
+        codepoints.push_back(utf8::decode(p, end));
+    if(rtl) {
+        // Glyphs are laid out in reverse, ending at x, and kerned in the
+        // order they're drawn in
+        std::reverse(codepoints.begin(), codepoints.end());
+        double width = 0.0;
+        uint32_t prev = 0;
+        for(uint32_t cp: codepoints) {
+            if(prev)
+                width += metrics->kerning(prev, cp);
+            width += metrics->advance(cp);
+            prev = cp;
+        }
+        x -= width;
+    }
+    
+    // FLTK angles are counterclockwise, y is down
+    double c = 1.0, s = 0.0;
+    if(angle != 0) {
+        c = cos(angle*M_PI/180.0);
+        s = sin(angle*M_PI/180.0);
+    }
+    
+    // Advances come from the metrics tables rather than the glyphs so drawn
+    // text matches width().
+    double pen = 0.0;
+    uint32_t prev = 0;
+    for(uint32_t cp: codepoints) {
+        if(prev)
+            pen += metrics->kerning(prev, cp);
+        prev = cp;
+        const GL_GlyphAtlas::Glyph * g = lookup(cp);
+        if(g && g->w > 0) {
+            // Glyph corners relative to the start of the baseline. The -0.5
+            // puts unrotated quads on pixel edges, as in rectf().
+            double x0 = pen + g->left - 0.5, y0 = -g->top - 0.5;
+            double x1 = x0 + g->w, y1 = y0 + g->h;
+            if(angle == 0) {
+                double px = floor(x + pen + 0.5) - pen;
+                batch.begin(GL_QUADS);
+                batch.vertex(px + x0, y + y0, g->u0, g->v0);
+                batch.vertex(px + x1, y + y0, g->u1, g->v0);
+                batch.vertex(px + x1, y + y1, g->u1, g->v1);
+                batch.vertex(px + x0, y + y1, g->u0, g->v1);
+                batch.end();
+            }
+            else {
+                batch.begin(GL_QUADS);
+                batch.vertex(x + x0*c + y0*s, y - x0*s + y0*c, g->u0, g->v0);
+                batch.vertex(x + x1*c + y0*s, y - x1*s + y0*c, g->u1, g->v0);
+                batch.vertex(x + x1*c + y1*s, y - x1*s + y1*c, g->u1, g->v1);
+                batch.vertex(x + x0*c + y1*s, y - x0*s + y1*c, g->u0, g->v1);
+                batch.end();
+            }
+        }
+        pen += metrics->advance(cp);
+    }
+    return true;
+}
+
 void GL_GraphicsDriver::draw(const char * str, int n, int x, int y) {
-    uninstall();
-    x += origin_x();
-    y += origin_y();
-    gl_draw(str, n, (int)to_gl_x(x), (int)to_gl_y(y));
-    install();
+    // gl_draw() needs the fixed-function pipeline, so in core profiles only
+    // fonts with a FreeType face are drawn.
+    if(!DrawGlyphs(str, n, x, y, 0, false) && !core) {
+        TextMode();
+        gl_draw(str, n, (int)to_gl_x(x + origin_x()), (int)to_gl_y(y + origin_y()));
+    }
     LOG("()");
 }
 void GL_GraphicsDriver::draw(int angle, const char * str, int n, int x, int y) {
-    uninstall();
-    // FIXME
-    x += origin_x();
-    y += origin_y();
-    gl_draw(str, n, (int)to_gl_x(x), (int)to_gl_y(y));
-    install();
-    LOG_UNIMPLEMENTED("(angle)");
+    if(!DrawGlyphs(str, n, x, y, angle, false) && !core) {
+        TextMode();
+        // gl_draw() can't rotate
+        gl_draw(str, n, (int)to_gl_x(x + origin_x()), (int)to_gl_y(y + origin_y()));
+        LOG_UNIMPLEMENTED("(angle)");
+    }
+    LOG("(angle)");
 }
 void GL_GraphicsDriver::rtl_draw(const char * str, int n, int x, int y) {
-    uninstall();
-    // FIXME
-    x += origin_x();
-    y += origin_y();
-    gl_draw(str, n, (int)to_gl_x(x), (int)to_gl_y(y));
-    install();
-    LOG_UNIMPLEMENTED("()");
+    if(!DrawGlyphs(str, n, x, y, 0, true) && !core) {
+        TextMode();
+        // gl_draw() can't reverse
+        gl_draw(str, n, (int)to_gl_x(x + origin_x()), (int)to_gl_y(y + origin_y()));
+        LOG_UNIMPLEMENTED("()");
+    }
+    LOG("()");
 }
 
 
-// FIXME: make this non-ugly. Doing this properly probably will require changes in FLTK...
 double GL_GraphicsDriver::width(const char * str, int n) {
-    uninstall();
-    int w = gl_width(str, n);
-    install();
     LOG("()");
-    return w;
+    return metrics? metrics->width(str, n) : replacedDriver->width(str, n);
 }
 void GL_GraphicsDriver::text_extents(const char * str, int n, int & dx, int & dy, int & w, int & h) {
-    uninstall();
     dx = 0;
-    dy = gl_descent();
-    w = gl_width(str, n);
-    h = gl_height();
-    install();
+    dy = descent();
+    w = width(str, n);
+    h = height();
     LOG("()");
 }
 int GL_GraphicsDriver::height() {
-    uninstall();
-    int h = gl_height();
-    install();
     LOG("()");
-    return h;
+    return metrics? metrics->height() : replacedDriver->height();
 }
 int GL_GraphicsDriver::descent() {
-    uninstall();
-    int d = gl_descent();
-    install();
     LOG("()");
-    return d;
+    return metrics? metrics->descent() : replacedDriver->descent();
 }
 
 
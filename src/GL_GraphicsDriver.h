@@ -5,34 +5,159 @@
 #include "fltk3/Device.h"
 #include "fltk3gl/gl.h"
 #include "fltk3gl/glu.h"
+#include "GL_VertexBatch.h"
+#include "GL_StateCache.h"
+#include "GL_GlyphAtlas.h"
+#include "GL_FontMetrics.h"
+#include "GL_TextureCache.h"
+#include "GL_IconAtlas.h"
+#include "GL_Tessellator.h"
+#include "GL_CorePipeline.h"
+#include "GL_SavedState.h"
 #include <vector>
 #include <stack>
 #include <list>
 
+class GL_ImageStream;
+
 class GL_GraphicsDriver: public fltk3::GraphicsDriver {
+  public:
+    // How end_complex_polygon() fills. TESSELLATE triangulates on the CPU
+    // with the odd winding rule. The stencil modes draw a triangle fan of the
+    // outline into the stencil buffer and then cover its bounding box, which
+    // costs nothing per vertex beyond submitting it, so suit paths too large
+    // or self-intersecting to tessellate. They fall back to TESSELLATE on
+    // surfaces without a stencil buffer.
+    enum ComplexPolygonMode {
+        TESSELLATE,
+        STENCIL_EVEN_ODD,
+        STENCIL_NONZERO
+    };
+    
+    // How shapes are antialiased. MULTISAMPLE_AA switches multisampling on
+    // for filled shapes and wide lines, and needs a multisampled visual.
+    // COVERAGE_AA draws lines as quads with soft sides and gives polygons a
+    // fringe fading out past their edges, so works with one sample per pixel
+    // and never breaks a batch.
+    enum Antialiasing {
+        MULTISAMPLE_AA,
+        COVERAGE_AA
+    };
+    
+    // What the driver saves at construction and puts back at destruction.
+    // SAVE_ALL pushes every attribute and client attribute, in case widgets
+    // change GL state themselves. SAVE_TOUCHED keeps just the state the
+    // driver changes, listed in GL_SavedState. SAVE_NONE is for windows whose
+    // widgets are trusted to draw through FLTK only and that don't care what
+    // state is left after drawing. Matrix stacks are pushed unless SAVE_NONE.
+    // Core profiles have no attribute stack, so there SAVE_ALL is SAVE_TOUCHED.
+    enum StateSave {
+        SAVE_ALL,
+        SAVE_TOUCHED,
+        SAVE_NONE
+    };
+    
+  private:
     fltk3::GraphicsDriver * replacedDriver;
     int viewW, viewH;
+    bool core;// core profile context, no fixed-function pipeline
+    GL_CorePipeline * pipeline;// null unless core
+    GLuint vertexArray;
+    StateSave saveMode;
+    GL_SavedState savedState;// unless SAVE_ALL with the attribute stack or SAVE_NONE
     double lineWidth;
+    GL_Stroker::Style strokeStyle;
+    bool glFontValid;
+    
+    // Paths from vertex() are kept in the coordinates given, under the FLTK
+    // matrix of their first point (a, b, c, d, x, y), which goes to GL with
+    // the origin as the transform they are drawn with.
+    std::vector<double> pathPoints;
+    double pathMatrix[6];
     std::vector<int> cpolyContours;
+    std::vector<double> shapePoints;// circle() outline
+    std::vector<double> transformedPoints;// see TransformPoints()
     
-    std::stack<fltk3::Rectangle> regionStack;
+    GL_Tessellator * tessellator;
+    ComplexPolygonMode cpolyMode;
+    int stencilBits;// -1 until needed
+    
+    // The stencil buffer's upper half holds clip levels and its lower half
+    // the counts of StencilFill(), which is zero between fills.
+    int clipShift;
+    GLuint clipMask, fillMask;
+    int stencilTop;// highest clip level marked
+    int clipLevel;// level the stencil test is set up for, -1 if unknown
+    Antialiasing aaMode;
+    std::vector<float> fringePoints;
+    
+    // A clip region in window coordinates: the union of rects, which are
+    // kept so that not_clipped() and clip_box() can answer without GL.
+    // Regions other than one rectangle are marked in the stencil buffer, at
+    // level; rects then only bound polygons.
+    struct ClipRegion {
+        std::vector<fltk3::Rectangle> rects;
+        fltk3::Rectangle bounds;
+        int level;// 0 for none
+        bool marked;// raised the level, which pop_clip() lowers again
+    };
+    std::stack<ClipRegion> regionStack;
+    
+    GL_VertexBatch batch;
+    GL_StateCache state;
+    GL_GlyphAtlas * atlas;
+    GL_FontMetrics * metrics;// null if current font has no FreeType face
+    std::vector<uint32_t> codepoints;
+    GL_TextureCache * textures;
+    GL_IconAtlas * icons;
+    std::vector<uint8_t> imagePixels;// conversion of indexed images to RGBA
     
   protected:
     void RectVertices(double x, double y, double w, double h);
     
     void StartSolid();
-    void EndSolid();
+    void StartStroke();
+    void Fringe();
+    
+    void CurrentMatrix(double m[6]);
+    void Transform(const double m[6]);
+    void OriginTransform();
+    const double * TransformPoints(const double m[6], const std::vector<double> & pts, bool pixels);
+    
+    void TexturedRect(GLuint tex, double x, double y, double w, double h,
+                      float u0, float v0, float u1, float v1, bool tinted = false);
+    bool DrawCachedImage(const void * id, uint32_t generation, const uchar * buf, int iw, int ih, int D, int L,
+                         int X, int Y, int W, int H, int cx, int cy);
+    
+    bool DrawIcon(fltk3::Image * img, const void * data, bool (*decode)(fltk3::Image *, uint8_t *),
+                  int X, int Y, int W, int H, int cx, int cy, bool tinted);
+    void DrawPixels(const uchar * buf, int X, int Y, int W, int H, int D, int L);
+    void DrawPixelsTextured(const uchar * buf, int X, int Y, int W, int H, int D, int L);
     
+    bool HaveStencil();
+    void StencilFan(const double * pts, int n, double bounds[4]);
+    void StencilFill(const double * pts, int n);
+    
+    void PushRegion(const fltk3::Rectangle * rects, int n);
+    void ClipTransform();
+    bool BeginClipMark(GLenum op);
+    void EndClipMark();
+    void ClipStencil();
+    
+    void ImmediateMode();
+    void TextMode();
+    bool DrawGlyphs(const char * str, int n, double x, double y, int angle, bool rtl);
+    
+    // Window coordinates for GL calls outside the batch, such as raster
+    // positions
     double to_gl_x(double x) {return x + 0.5;}
     double to_gl_y(double y) {return viewH - 0.5 - y;}
     
-    void gl_vertex(double x, double y);
-    
     void install();
     void uninstall();
     
   public:
-    GL_GraphicsDriver(fltk3::Rectangle * rect);
+    GL_GraphicsDriver(fltk3::Rectangle * rect, StateSave save = SAVE_ALL);
     virtual ~GL_GraphicsDriver();
     
     virtual void line_style(int style, int width=0, char * dashes=0);
@@ -59,22 +184,31 @@ class GL_GraphicsDriver: public fltk3::GraphicsDriver {
     virtual void polygon(int x0, int y0, int x1, int y1, int x2, int y2, int x3, int y3);
     virtual void arc(int x, int y, int w, int h, double a1, double a2);
     virtual void pie(int x, int y, int w, int h, double a1, double a2);
-    // virtual void begin_points();
-    // virtual void begin_line();
-    // virtual void begin_loop();
-    // virtual void begin_polygon();
-    // virtual void vertex(double x, double y);
-    // virtual void transformed_vertex(double xf, double yf);
-    // virtual void curve(double X0, double Y0, double X1, double Y1, double X2, double Y2, double X3, double Y3);
+    virtual void begin_points();
+    virtual void begin_line();
+    virtual void begin_loop();
+    virtual void begin_polygon();
+    virtual void vertex(double x, double y);
+    virtual void transformed_vertex(double xf, double yf);
+    virtual void curve(double X0, double Y0, double X1, double Y1, double X2, double Y2, double X3, double Y3);
     virtual void circle(double x, double y, double r);
-    // virtual void arc(double x, double y, double r, double start, double end);
+    virtual void arc(double x, double y, double r, double start, double end);
     virtual void end_points();
     virtual void end_line();
     virtual void end_loop();
     virtual void end_polygon();
-    // virtual void begin_complex_polygon();
+    virtual void begin_complex_polygon();
     virtual void gap();
     virtual void end_complex_polygon();
+    void complex_polygon_mode(ComplexPolygonMode mode) {cpolyMode = mode;}
+    ComplexPolygonMode complex_polygon_mode() const {return cpolyMode;}
+    
+    void antialiasing(Antialiasing mode) {aaMode = mode;}
+    Antialiasing antialiasing() const {return aaMode;}
+    
+    // Pack batched vertices to 16 bits where they fit (the default), or draw
+    // them as floats
+    void pack_vertices(bool on) {batch.pack(on);}
     
     virtual void push_clip(int x, int y, int w, int h);
     virtual int clip_box(int x, int y, int w, int h, int & X, int & Y, int & W, int & H);
@@ -82,7 +216,15 @@ class GL_GraphicsDriver: public fltk3::GraphicsDriver {
     virtual void push_no_clip();
     virtual void pop_clip();
     virtual void restore_clip();
-    // clip_region(fltk3::Region) isn't virtual?
+    // clip_region(fltk3::Region) isn't virtual, and regions are per platform,
+    // so regions other than a rectangle are pushed by these instead.
+    
+    // Clip to the union of n rectangles within the current clip, until
+    // pop_clip().
+    void push_clip(const fltk3::Rectangle * rects, int n);
+    // Clip to the path begun with begin_complex_polygon(), by the even-odd
+    // rule, instead of filling it. Its edges are never antialiased.
+    void push_clip_path();
     
     // Images
     virtual void draw_image(const uchar * buf, int X, int Y, int W, int H, int D=3, int L=0);
@@ -93,6 +235,7 @@ class GL_GraphicsDriver: public fltk3::GraphicsDriver {
     virtual void draw(fltk3::RGBImage * rgb, int XP, int YP, int WP, int HP, int cx, int cy);
     virtual void draw(fltk3::Pixmap * pxm, int XP, int YP, int WP, int HP, int cx, int cy);
     virtual void draw(fltk3::Bitmap * bm, int XP, int YP, int WP, int HP, int cx, int cy);
+    void draw(GL_ImageStream * stream, int XP, int YP, int WP, int HP, int cx, int cy);
     
     virtual void font(fltk3::Font face, fltk3::Fontsize size);
     
@@ -103,6 +246,25 @@ class GL_GraphicsDriver: public fltk3::GraphicsDriver {
     
     virtual void copy_offscreen(int x, int y, int w, int h, fltk3::Offscreen pixmap, int srcx, int srcy);
     virtual char can_do_alpha_blending();
+    
+    // Declare that a draw_image() callback may be called from several threads
+    // at once, for different lines. Large images drawn with it are then
+    // generated on the shared WorkerPool.
+    static void thread_safe_image_callback(fltk3::DrawImageCb cb, bool safe = true);
+    
+    // The installed driver, if it is a GL_GraphicsDriver
+    static GL_GraphicsDriver * current();
+    
+    // True if drawing without the fixed-function pipeline, in a core profile
+    // context. Decided by the context current at construction.
+    bool core_profile() const {return core;}
+    
+    StateSave state_save() const {return saveMode;}
+    
+    // Submit any batched primitives now
+    void flush() {batch.flush();}
+    const GL_VertexBatch::Stats & batch_stats() const {return batch.stats();}
+    const GL_StateCache::Stats & state_stats() const {return state.stats();}
 };
 
 #endif // GL_GRAPHICSDRIVER_H
@@ -0,0 +1,191 @@
+
+#include "GL_Headless.h"
+#include "GL_Ext.h"
+#include <fltk3/fltk3.h>
+
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+#if defined(__linux__)
+
+// Mesa's platform for contexts with no window system, where the loader has it
+static EGLDisplay SurfacelessDisplay()
+{
+    const char * extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if(extensions && strstr(extensions, "EGL_MESA_platform_surfaceless")) {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if(getPlatformDisplay)
+            return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+GL_Headless::GL_Headless(int w, int h, int samples, bool core):
+    display(nullptr),
+    surface(nullptr),
+    context(nullptr),
+    width(w),
+    height(h),
+    samples_(samples),
+    core_(core)
+{
+    EGLDisplay dpy = SurfacelessDisplay();
+    if(dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, nullptr, nullptr)) {
+        cerr << "GL_Headless: no EGL display" << endl;
+        return;
+    }
+    display = dpy;
+    if(!eglBindAPI(EGL_OPENGL_API)) {
+        cerr << "GL_Headless: no desktop GL" << endl;
+        return;
+    }
+    
+    // A stencil buffer for clips and complex polygons, as CustomGL_Visual()
+    // asks for. Fewer samples if there are no configs with as many.
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    for(samples_ = max(samples, 1); ; samples_ /= 2) {
+        bool multisample = samples_ > 1;
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+            EGL_DEPTH_SIZE, 24, EGL_STENCIL_SIZE, 8,
+            EGL_SAMPLE_BUFFERS, multisample? 1 : 0,
+            EGL_SAMPLES, multisample? samples_ : 0,
+            EGL_NONE
+        };
+        if(eglChooseConfig(dpy, configAttribs, &config, 1, &numConfigs) && numConfigs > 0)
+            break;
+        if(!multisample) {
+            cerr << "GL_Headless: no RGBA config with a stencil buffer" << endl;
+            return;
+        }
+    }
+    if(samples_ < samples)
+        cerr << "GL_Headless: " << samples_ << " samples, not " << samples << endl;
+    
+    const EGLint surfaceAttribs[] = {EGL_WIDTH, w, EGL_HEIGHT, h, EGL_NONE};
+    EGLSurface surf = eglCreatePbufferSurface(dpy, config, surfaceAttribs);
+    if(surf == EGL_NO_SURFACE) {
+        cerr << "GL_Headless: can't make a " << w << "x" << h << " pbuffer" << endl;
+        return;
+    }
+    surface = surf;
+    
+    const EGLint coreAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext ctx = EGL_NO_CONTEXT;
+    if(core) {
+        ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, coreAttribs);
+        if(ctx == EGL_NO_CONTEXT) {
+            cerr << "GL_Headless: no core profile context, using compatibility" << endl;
+            core_ = false;
+        }
+    }
+    if(ctx == EGL_NO_CONTEXT)
+        ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, nullptr);
+    if(ctx == EGL_NO_CONTEXT) {
+        cerr << "GL_Headless: no context" << endl;
+        return;
+    }
+    context = ctx;
+    make_current();
+    
+    // As GLView::InitGL()
+    glViewport(0, 0, w, h);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_BLEND);
+    glClearColor(0.75, 0.75, 0.75, 1.0);
+}
+
+GL_Headless::~GL_Headless()
+{
+    if(!display)
+        return;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(context)
+        eglDestroyContext(display, context);
+    if(surface)
+        eglDestroySurface(display, surface);
+    eglTerminate(display);
+}
+
+void GL_Headless::make_current()
+{
+    if(context)
+        eglMakeCurrent(display, surface, surface, context);
+}
+
+#else
+
+GL_Headless::GL_Headless(int w, int h, int samples, bool core):
+    display(nullptr),
+    surface(nullptr),
+    context(nullptr),
+    width(w),
+    height(h),
+    samples_(samples),
+    core_(core)
+{
+    cerr << "GL_Headless: only supported with EGL on Linux" << endl;
+}
+
+GL_Headless::~GL_Headless()
+{
+}
+
+void GL_Headless::make_current()
+{
+}
+
+#endif
+
+void GL_Headless::render(fltk3::Widget * widget, GL_GraphicsDriver::StateSave save)
+{
+    if(!ok())
+        return;
+    make_current();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    
+    // As GLView::draw()
+    if(!core_) {
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(0, width, 0, height, -1, 1);
+    }
+    
+    GL_GraphicsDriver glgd(widget, save);
+    if(samples_ <= 1)
+        glgd.antialiasing(GL_GraphicsDriver::COVERAGE_AA);
+    widget->redraw();
+    widget->draw();
+}
+
+void GL_Headless::read(std::vector<uint8_t> & rgba)
+{
+    size_t rowBytes = 4*width;
+    rgba.resize(rowBytes*height);
+    if(!ok())
+        return;
+    make_current();
+    rows.resize(rgba.size());
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &rows[0]);
+    for(int y = 0; y < height; ++y)
+        memcpy(&rgba[rowBytes*y], &rows[rowBytes*(height - 1 - y)], rowBytes);
+}
@@ -0,0 +1,52 @@
+
+#ifndef GL_HEADLESS_H
+#define GL_HEADLESS_H
+
+#include "GL_GraphicsDriver.h"
+#include <vector>
+
+// A GL context with no window and no display server, for benchmarks and
+// image checks on machines without one. It's an EGL pbuffer on Mesa's
+// surfaceless platform, so it has a default framebuffer like a window's and
+// anything drawing to a window draws to it unchanged:
+//
+//     GL_Headless headless(512, 720);
+//     headless.render(window);
+//     headless.read(rgba);
+//
+// The window needn't be shown, as only its draw() is called. EGL is only
+// used on Linux; elsewhere ok() is false.
+class GL_Headless {
+    void * display;// EGLDisplay, EGLSurface and EGLContext
+    void * surface;
+    void * context;
+    int width, height;
+    int samples_;
+    bool core_;
+    std::vector<uint8_t> rows;// as read, bottom up
+    
+  public:
+    // A w*h framebuffer with up to samples per pixel, 0 or 1 for none, and
+    // a core profile (3.3) context if core. Made current.
+    GL_Headless(int w, int h, int samples = 0, bool core = false);
+    ~GL_Headless();
+    
+    // False if there's no context
+    bool ok() const {return context != nullptr;}
+    int w() const {return width;}
+    int h() const {return height;}
+    int samples() const {return samples_;}
+    // False if a core profile was asked for and couldn't be had
+    bool core_profile() const {return core_;}
+    
+    void make_current();
+    
+    // Clear and draw widget and its children through a GL_GraphicsDriver, as
+    // OGL_Window::draw() does
+    void render(fltk3::Widget * widget, GL_GraphicsDriver::StateSave save = GL_GraphicsDriver::SAVE_TOUCHED);
+    
+    // Wait for the frame and read it as w*h RGBA pixels, rows top down
+    void read(std::vector<uint8_t> & rgba);
+};
+
+#endif // GL_HEADLESS_H
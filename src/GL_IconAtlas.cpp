@@ -0,0 +1,77 @@
+
+#include "GL_IconAtlas.h"
+
+#include <vector>
+
+GL_IconAtlas::GL_IconAtlas():
+    tex(0),
+    packer(kAtlasSize, kAtlasSize)
+{
+    // Zero fill, so the padding between icons is transparent
+    std::vector<uint8_t> zeros(kAtlasSize*kAtlasSize*4, 0);
+    // Usually created mid-frame, so keep the binding the driver expects
+    GLint prevTex;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTex);
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, kAtlasSize, kAtlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, &zeros[0]);
+    glBindTexture(GL_TEXTURE_2D, prevTex);
+}
+
+GL_IconAtlas::~GL_IconAtlas()
+{
+    if(tex)
+        glDeleteTextures(1, &tex);
+}
+
+GL_IconAtlas & GL_IconAtlas::shared()
+{
+    // Never destroyed, as with the glyph atlas
+    static GL_IconAtlas * atlas = new GL_IconAtlas;
+    return *atlas;
+}
+
+const GL_IconAtlas::Icon * GL_IconAtlas::find(const void * id, const void * data, int w, int h) const
+{
+    auto found = icons.find(id);
+    if(found == icons.end())
+        return nullptr;
+    const Entry & e = found->second;
+    if(e.data != data || e.icon.w != w || e.icon.h != h)
+        return nullptr;
+    return &e.icon;
+}
+
+const GL_IconAtlas::Icon * GL_IconAtlas::add(const void * id, const void * data, int w, int h, const uint8_t * rgba)
+{
+    // A replaced icon's old space is only reclaimed by clear()
+    int x, y;
+    if(!fits(w, h) || !packer.alloc(w, h, x, y))
+        return nullptr;
+    
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    
+    Entry & e = icons[id];
+    e.data = data;
+    e.icon.w = w;
+    e.icon.h = h;
+    e.icon.u0 = (float)x/kAtlasSize;
+    e.icon.v0 = (float)y/kAtlasSize;
+    e.icon.u1 = (float)(x + w)/kAtlasSize;
+    e.icon.v1 = (float)(y + h)/kAtlasSize;
+    return &e.icon;
+}
+
+void GL_IconAtlas::clear()
+{
+    icons.clear();
+    packer.clear();
+}
@@ -0,0 +1,59 @@
+
+#ifndef GL_ICONATLAS_H
+#define GL_ICONATLAS_H
+
+#include "fltk3gl/gl.h"
+#include "GL_ShelfPacker.h"
+#include <cstdint>
+#include <unordered_map>
+
+// Small images (fltk3::Pixmap and fltk3::Bitmap icons) packed into one RGBA
+// texture, so a toolbar's worth of them is drawn in a single batch. Icons are
+// keyed on the image object and converted to RGBA by the caller only when
+// missing. An icon is replaced if the image's data pointer or size changes.
+//
+// Like the glyph atlas, it's shared by all drivers and calls must be made with
+// the atlas texture bound.
+class GL_IconAtlas {
+  public:
+    struct Icon {
+        float u0, v0, u1, v1;
+        int w, h;
+    };
+    
+  private:
+    enum {kAtlasSize = 1024, kMaxIconSize = 128};
+    
+    struct Entry {
+        Icon icon;
+        const void * data;
+    };
+    
+    GLuint tex;
+    GL_ShelfPacker packer;
+    std::unordered_map<const void *, Entry> icons;
+    
+    GL_IconAtlas();
+    
+  public:
+    ~GL_IconAtlas();
+    
+    static GL_IconAtlas & shared();
+    
+    GLuint texture() const {return tex;}
+    
+    // Whether an image is small enough to go in the atlas
+    static bool fits(int w, int h) {return w <= kMaxIconSize && h <= kMaxIconSize;}
+    
+    // Returns null if id isn't in the atlas, or has changed
+    const Icon * find(const void * id, const void * data, int w, int h) const;
+    
+    // Add or replace an icon from w*h RGBA pixels. Returns null if the atlas
+    // is full; flush anything drawn from the atlas, clear() and retry.
+    const Icon * add(const void * id, const void * data, int w, int h, const uint8_t * rgba);
+    
+    void invalidate(const void * id) {icons.erase(id);}
+    void clear();
+};
+
+#endif // GL_ICONATLAS_H
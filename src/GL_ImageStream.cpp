@@ -0,0 +1,164 @@
+
+#include "GL_ImageStream.h"
+#include "GL_GraphicsDriver.h"
+
+#include <algorithm>
+#include <cstring>
+
+GL_ImageStream::GL_ImageStream(int w, int h, int d, int buffers):
+    w_(w),
+    h_(h),
+    d_(std::min(std::max(d, 1), 4)),
+    numBuffers(0),
+    nextBuffer(0)
+{
+    if(GL_HavePixelBuffers()) {
+        numBuffers = std::min(std::max(buffers, 1), (int)kMaxBuffers);
+        glGenBuffers(numBuffers, pbos);
+    }
+    
+    GLint prevTex;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTex);
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    GL_TexImage(Format(), w_, h_, nullptr);
+    glBindTexture(GL_TEXTURE_2D, prevTex);
+    
+    reset_stats();
+    damage();
+}
+
+GL_ImageStream::~GL_ImageStream()
+{
+    if(GL_GraphicsDriver * driver = GL_GraphicsDriver::current())
+        driver->flush();
+    if(numBuffers)
+        glDeleteBuffers(numBuffers, pbos);
+    glDeleteTextures(1, &tex);
+}
+
+void GL_ImageStream::reset_stats()
+{
+    stats_.frames = 0;
+    stats_.uploadedBytes = 0;
+}
+
+GLenum GL_ImageStream::Format() const
+{
+    switch(d_) {
+        case 1: return GL_LUMINANCE;
+        case 2: return GL_LUMINANCE_ALPHA;
+        case 3: return GL_RGB;
+        default: return GL_RGBA;
+    }
+}
+
+void GL_ImageStream::damage(int x, int y, int w, int h)
+{
+    Rect r;
+    r.x = std::max(x, 0);
+    r.y = std::max(y, 0);
+    r.w = std::min(x + w, w_) - r.x;
+    r.h = std::min(y + h, h_) - r.y;
+    if(r.w <= 0 || r.h <= 0)
+        return;
+    damaged.push_back(r);
+    
+    // Many or overlapping rectangles cost more in calls and copying than
+    // sending their bounding box.
+    size_t area = 0;
+    for(const Rect & d: damaged)
+        area += (size_t)d.w*d.h;
+    if(damaged.size() > kMaxDamageRects || area > (size_t)w_*h_) {
+        int x0 = w_, y0 = h_, x1 = 0, y1 = 0;
+        for(const Rect & d: damaged) {
+            x0 = std::min(x0, d.x);
+            y0 = std::min(y0, d.y);
+            x1 = std::max(x1, d.x + d.w);
+            y1 = std::max(y1, d.y + d.h);
+        }
+        damaged.clear();
+        Rect box = {x0, y0, x1 - x0, y1 - y0};
+        damaged.push_back(box);
+    }
+}
+
+// Copy the damaged rectangles, one after another and tightly packed
+void GL_ImageStream::Pack(uint8_t * dst, const uint8_t * frame, int L) const
+{
+    for(const Rect & r: damaged) {
+        size_t row = (size_t)r.w*d_;
+        const uint8_t * src = frame + (size_t)r.y*L + (size_t)r.x*d_;
+        for(int y = 0; y < r.h; ++y, src += L, dst += row)
+            memcpy(dst, src, row);
+    }
+}
+
+void GL_ImageStream::update(const uint8_t * frame, int L)
+{
+    if(damaged.empty())
+        return;
+    if(L == 0)
+        L = w_*d_;
+    size_t bytes = 0;
+    for(const Rect & r: damaged)
+        bytes += (size_t)r.w*r.h*d_;
+    
+    // Primitives already batched must see the previous contents
+    if(GL_GraphicsDriver * driver = GL_GraphicsDriver::current())
+        driver->flush();
+    
+    // Restore the binding afterwards, the driver's state cache depends on it
+    GLint prevTex;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    
+    uint8_t * mapped = nullptr;
+    if(numBuffers) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[nextBuffer]);
+        nextBuffer = (nextBuffer + 1)%numBuffers;
+        // Orphan the old storage, so we never wait for an upload still
+        // reading from it.
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        mapped = (uint8_t *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        if(mapped) {
+            Pack(mapped, frame, L);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        else {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+    if(!mapped) {
+        scratch.resize(bytes);
+        Pack(&scratch[0], frame, L);
+    }
+    
+    size_t offset = 0;
+    for(const Rect & r: damaged) {
+        // Offsets are into the bound pixel buffer, if any
+        const GLvoid * pixels = mapped? (const GLvoid *)offset : (const GLvoid *)(&scratch[0] + offset);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.w, r.h, GL_TexFormat(Format()), GL_UNSIGNED_BYTE, pixels);
+        offset += (size_t)r.w*r.h*d_;
+    }
+    
+    if(mapped)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, prevTex);
+    
+    damaged.clear();
+    ++stats_.frames;
+    stats_.uploadedBytes += bytes;
+}
+
+void GL_ImageStream::draw(int X, int Y)
+{
+    if(GL_GraphicsDriver * driver = GL_GraphicsDriver::current())
+        driver->draw(this, X, Y, w_, h_, 0, 0);
+}
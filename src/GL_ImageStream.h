@@ -0,0 +1,74 @@
+
+#ifndef GL_IMAGESTREAM_H
+#define GL_IMAGESTREAM_H
+
+#include "GL_Ext.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// A texture for images that change every frame, such as video. Frames are
+// copied into a ring of pixel buffer objects and uploaded from there with
+// glTexSubImage2D(), so the copy into the texture runs on the GPU while the
+// CPU gets on with the next frame, and only the areas marked with damage()
+// are sent at all.
+//
+// Draw with GL_GraphicsDriver::draw(GL_ImageStream *, ...) or draw() here.
+// The constructor, destructor and update() need a current GL context. Without
+// pixel buffer objects, update() uploads straight from client memory.
+class GL_ImageStream {
+  public:
+    struct Rect {
+        int x, y, w, h;
+    };
+    
+    struct Stats {
+        size_t frames;
+        size_t uploadedBytes;
+    };
+    
+  private:
+    enum {kMaxBuffers = 3, kMaxDamageRects = 16};
+    
+    int w_, h_, d_;
+    GLuint tex;
+    GLuint pbos[kMaxBuffers];
+    int numBuffers;
+    int nextBuffer;
+    std::vector<Rect> damaged;
+    std::vector<uint8_t> scratch;// staging without pixel buffers
+    Stats stats_;
+    
+    GLenum Format() const;
+    void Pack(uint8_t * dst, const uint8_t * frame, int L) const;
+    
+  public:
+    // d is bytes per pixel (1 to 4), buffers the number of pixel buffers
+    // cycled through (2 or 3).
+    GL_ImageStream(int w, int h, int d = 3, int buffers = 2);
+    ~GL_ImageStream();
+    
+    int w() const {return w_;}
+    int h() const {return h_;}
+    int d() const {return d_;}
+    GLuint texture() const {return tex;}
+    
+    // Mark an area as changed for the next update(). A new stream is fully
+    // damaged.
+    void damage(int x, int y, int w, int h);
+    void damage() {damage(0, 0, w_, h_);}
+    bool damaged_any() const {return !damaged.empty();}
+    
+    // Upload the damaged areas of a w()*h() frame, L bytes per line (0 for
+    // w()*d()), and clear the damage.
+    void update(const uint8_t * frame, int L = 0);
+    
+    // Draw through the current GL_GraphicsDriver. Does nothing under any other
+    // driver, the pixels aren't kept on the CPU.
+    void draw(int X, int Y);
+    
+    const Stats & stats() const {return stats_;}
+    void reset_stats();
+};
+
+#endif // GL_IMAGESTREAM_H
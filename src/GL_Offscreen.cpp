@@ -0,0 +1,167 @@
+
+#include "GL_Offscreen.h"
+#include "GL_GraphicsDriver.h"
+
+#include <iostream>
+#include <cstdint>
+
+using namespace std;
+
+// Handles are the object pointers. fltk3::Offscreen is an integer on X11 and
+// a pointer elsewhere, hence the C style casts.
+static fltk3::Offscreen ToHandle(GL_Offscreen * off) {return (fltk3::Offscreen)(uintptr_t)off;}
+static GL_Offscreen * FromHandle(fltk3::Offscreen handle) {return (GL_Offscreen *)(uintptr_t)handle;}
+
+std::unordered_set<GL_Offscreen *> & GL_Offscreen::Registry()
+{
+    static std::unordered_set<GL_Offscreen *> offscreens;
+    return offscreens;
+}
+
+std::vector<GL_Offscreen *> & GL_Offscreen::Active()
+{
+    static std::vector<GL_Offscreen *> active;
+    return active;
+}
+
+GL_Offscreen::GL_Offscreen(int w, int h):
+    fbo(0),
+    tex(0),
+    depthStencil(0),
+    w_(w),
+    h_(h),
+    prevFBO(0),
+    driver(nullptr)
+{
+    // Keep the bindings a driver may be relying on
+    GLint prevTex;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTex);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFBO);
+    
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, prevTex);
+    
+    GLint prevRenderbuffer;
+    glGetIntegerv(GL_RENDERBUFFER_BINDING, &prevRenderbuffer);
+    glGenRenderbuffers(1, &depthStencil);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthStencil);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, prevRenderbuffer);
+    
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencil);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
+        // Contents start out undefined, as with window system offscreens,
+        // but transparent black is friendlier. Saved by hand, as core
+        // profiles have no glPushAttrib().
+        GLfloat clearColor[4];
+        GLint clearStencil, stencilMask;
+        GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+        glGetIntegerv(GL_STENCIL_CLEAR_VALUE, &clearStencil);
+        glGetIntegerv(GL_STENCIL_WRITEMASK, &stencilMask);
+        glDisable(GL_SCISSOR_TEST);
+        glClearColor(0, 0, 0, 0);
+        glClearStencil(0);
+        glStencilMask(~0u);
+        glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+        glClearStencil(clearStencil);
+        glStencilMask(stencilMask);
+        if(scissor)
+            glEnable(GL_SCISSOR_TEST);
+    }
+    else {
+        cerr << "GL_Offscreen: incomplete framebuffer for " << w << "x" << h << endl;
+        glDeleteFramebuffers(1, &fbo);
+        fbo = 0;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFBO);
+}
+
+GL_Offscreen::~GL_Offscreen()
+{
+    if(fbo)
+        glDeleteFramebuffers(1, &fbo);
+    if(depthStencil)
+        glDeleteRenderbuffers(1, &depthStencil);
+    if(tex)
+        glDeleteTextures(1, &tex);
+}
+
+fltk3::Offscreen GL_Offscreen::create(int w, int h)
+{
+    if(w <= 0 || h <= 0 || !GL_HaveFramebuffers())
+        return 0;
+    GL_Offscreen * off = new GL_Offscreen(w, h);
+    if(!off->fbo) {
+        delete off;
+        return 0;
+    }
+    Registry().insert(off);
+    return ToHandle(off);
+}
+
+void GL_Offscreen::destroy(fltk3::Offscreen handle)
+{
+    GL_Offscreen * off = find(handle);
+    if(!off)
+        return;
+    // Anything queued that samples it must be drawn first
+    if(GL_GraphicsDriver * current = GL_GraphicsDriver::current())
+        current->flush();
+    Registry().erase(off);
+    delete off;
+}
+
+GL_Offscreen * GL_Offscreen::find(fltk3::Offscreen handle)
+{
+    GL_Offscreen * off = FromHandle(handle);
+    return Registry().count(off)? off : nullptr;
+}
+
+void GL_Offscreen::begin(fltk3::Offscreen handle)
+{
+    GL_Offscreen * off = find(handle);
+    if(!off) {
+        cerr << "GL_Offscreen::begin(): not a GL_Offscreen" << endl;
+        return;
+    }
+    
+    // Primitives queued for the current target go there first
+    if(GL_GraphicsDriver * current = GL_GraphicsDriver::current())
+        current->flush();
+    
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &off->prevFBO);
+    glGetIntegerv(GL_VIEWPORT, off->prevViewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, off->fbo);
+    glViewport(0, 0, off->w_, off->h_);
+    
+    fltk3::Rectangle rect(off->w_, off->h_);
+    GL_GraphicsDriver * outer = GL_GraphicsDriver::current();
+    off->driver = new GL_GraphicsDriver(&rect, outer? outer->state_save() : GL_GraphicsDriver::SAVE_ALL);
+    Active().push_back(off);
+}
+
+void GL_Offscreen::end()
+{
+    if(Active().empty())
+        return;
+    GL_Offscreen * off = Active().back();
+    Active().pop_back();
+    
+    // Restores the outer driver
+    delete off->driver;
+    off->driver = nullptr;
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, off->prevFBO);
+    glViewport(off->prevViewport[0], off->prevViewport[1], off->prevViewport[2], off->prevViewport[3]);
+}
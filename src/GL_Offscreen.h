@@ -0,0 +1,62 @@
+
+#ifndef GL_OFFSCREEN_H
+#define GL_OFFSCREEN_H
+
+#include "GL_Ext.h"
+#include "fltk3/Device.h"
+#include <vector>
+#include <unordered_set>
+
+class GL_GraphicsDriver;
+
+// Offscreen drawing surfaces for GL windows, as framebuffer objects with a
+// color texture. These take the place of fltk3::create_offscreen() and
+// friends, which make window system pixmaps a GL driver can't draw into:
+//
+//     fltk3::Offscreen off = GL_Offscreen::create(w, h);
+//     GL_Offscreen::begin(off);
+//     ...draw with fltk3 calls...
+//     GL_Offscreen::end();
+//     fltk3::copy_offscreen(x, y, w, h, off, 0, 0);
+//     GL_Offscreen::destroy(off);
+//
+// Between begin() and end() drawing goes through a GL_GraphicsDriver bound to
+// the framebuffer, which has a stencil buffer. copy_offscreen() by
+// GL_GraphicsDriver is a textured quad, with no readback. All calls need a
+// current GL context.
+class GL_Offscreen {
+    GLuint fbo;
+    GLuint tex;
+    GLuint depthStencil;// renderbuffer, for stencil fills
+    int w_, h_;
+    
+    // Saved by begin()
+    GLint prevFBO;
+    GLint prevViewport[4];
+    GL_GraphicsDriver * driver;
+    
+    static std::unordered_set<GL_Offscreen *> & Registry();
+    static std::vector<GL_Offscreen *> & Active();
+    
+    GL_Offscreen(int w, int h);
+    ~GL_Offscreen();
+    
+  public:
+    // Returns 0 if framebuffer objects aren't supported or the size isn't
+    static fltk3::Offscreen create(int w, int h);
+    static void destroy(fltk3::Offscreen handle);
+    
+    // Null if handle isn't a GL_Offscreen
+    static GL_Offscreen * find(fltk3::Offscreen handle);
+    
+    // Redirect drawing to an offscreen until end(). May be nested.
+    static void begin(fltk3::Offscreen handle);
+    static void end();
+    
+    int w() const {return w_;}
+    int h() const {return h_;}
+    // Color texture, with row 0 at the bottom as usual for GL
+    GLuint texture() const {return tex;}
+};
+
+#endif // GL_OFFSCREEN_H
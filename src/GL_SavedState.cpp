@@ -0,0 +1,151 @@
+
+#include "GL_SavedState.h"
+
+static const GLenum kClientArrays[3] = {GL_VERTEX_ARRAY, GL_COLOR_ARRAY, GL_TEXTURE_COORD_ARRAY};
+
+void GL_SavedState::save(bool core)
+{
+    this->core = core;
+    
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &arrayBuffer);
+    unpackBuffer = 0;
+    if(GL_HavePixelBuffers())
+        glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpackBuffer);
+    
+    blend = glIsEnabled(GL_BLEND);
+    scissorTest = glIsEnabled(GL_SCISSOR_TEST);
+    stencilTest = glIsEnabled(GL_STENCIL_TEST);
+    depthTest = glIsEnabled(GL_DEPTH_TEST);
+    cullFace = glIsEnabled(GL_CULL_FACE);
+    multisample = glIsEnabled(GL_MULTISAMPLE);
+    
+    glGetIntegerv(GL_BLEND_SRC_RGB, &blendSrcRGB);
+    glGetIntegerv(GL_BLEND_DST_RGB, &blendDstRGB);
+    glGetIntegerv(GL_BLEND_SRC_ALPHA, &blendSrcAlpha);
+    glGetIntegerv(GL_BLEND_DST_ALPHA, &blendDstAlpha);
+    glGetIntegerv(GL_SCISSOR_BOX, scissorBox);
+    glGetBooleanv(GL_COLOR_WRITEMASK, colorMask);
+    
+    glGetIntegerv(GL_STENCIL_FUNC, &stencilFunc);
+    glGetIntegerv(GL_STENCIL_REF, &stencilRef);
+    glGetIntegerv(GL_STENCIL_VALUE_MASK, &stencilValueMask);
+    glGetIntegerv(GL_STENCIL_WRITEMASK, &stencilWriteMask);
+    glGetIntegerv(GL_STENCIL_FAIL, &stencilOps[0][0]);
+    glGetIntegerv(GL_STENCIL_PASS_DEPTH_FAIL, &stencilOps[0][1]);
+    glGetIntegerv(GL_STENCIL_PASS_DEPTH_PASS, &stencilOps[0][2]);
+    glGetIntegerv(GL_STENCIL_BACK_FAIL, &stencilOps[1][0]);
+    glGetIntegerv(GL_STENCIL_BACK_PASS_DEPTH_FAIL, &stencilOps[1][1]);
+    glGetIntegerv(GL_STENCIL_BACK_PASS_DEPTH_PASS, &stencilOps[1][2]);
+    
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+    glGetIntegerv(GL_UNPACK_ROW_LENGTH, &unpackRowLength);
+    
+    if(core) {
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vertexArray);
+        return;
+    }
+    
+    texture2D = glIsEnabled(GL_TEXTURE_2D);
+    lineStipple = glIsEnabled(GL_LINE_STIPPLE);
+    lighting = glIsEnabled(GL_LIGHTING);
+    fog = glIsEnabled(GL_FOG);
+    
+    static const GLenum kBuffers[3] = {GL_VERTEX_ARRAY_BUFFER_BINDING, GL_COLOR_ARRAY_BUFFER_BINDING,
+                                       GL_TEXTURE_COORD_ARRAY_BUFFER_BINDING};
+    static const GLenum kSizes[3] = {GL_VERTEX_ARRAY_SIZE, GL_COLOR_ARRAY_SIZE, GL_TEXTURE_COORD_ARRAY_SIZE};
+    static const GLenum kTypes[3] = {GL_VERTEX_ARRAY_TYPE, GL_COLOR_ARRAY_TYPE, GL_TEXTURE_COORD_ARRAY_TYPE};
+    static const GLenum kStrides[3] = {GL_VERTEX_ARRAY_STRIDE, GL_COLOR_ARRAY_STRIDE, GL_TEXTURE_COORD_ARRAY_STRIDE};
+    static const GLenum kPointers[3] = {GL_VERTEX_ARRAY_POINTER, GL_COLOR_ARRAY_POINTER, GL_TEXTURE_COORD_ARRAY_POINTER};
+    for(int j = 0; j < 3; ++j) {
+        ClientArray & a = clientArrays[j];
+        a.enabled = glIsEnabled(kClientArrays[j]);
+        glGetIntegerv(kBuffers[j], &a.buffer);
+        glGetIntegerv(kSizes[j], &a.size);
+        glGetIntegerv(kTypes[j], &a.type);
+        glGetIntegerv(kStrides[j], &a.stride);
+        glGetPointerv(kPointers[j], &a.pointer);
+    }
+    
+    glGetFloatv(GL_LINE_WIDTH, &lineWidth);
+    glGetTexEnviv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, &texEnvMode);
+    if(GL_HaveMultisampleFilterHint())
+        glGetIntegerv(GL_MULTISAMPLE_FILTER_HINT_NV, &multisampleHint);
+    glGetIntegerv(GL_LIST_BASE, &listBase);
+    glGetFloatv(GL_CURRENT_COLOR, color);
+    glGetFloatv(GL_CURRENT_TEXTURE_COORDS, texCoord);
+    glGetFloatv(GL_ZOOM_X, &pixelZoom[0]);
+    glGetFloatv(GL_ZOOM_Y, &pixelZoom[1]);
+}
+
+static void Enable(GLenum cap, GLboolean on)
+{
+    if(on)
+        glEnable(cap);
+    else
+        glDisable(cap);
+}
+
+void GL_SavedState::restore() const
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if(GL_HavePixelBuffers())
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+    
+    Enable(GL_BLEND, blend);
+    Enable(GL_SCISSOR_TEST, scissorTest);
+    Enable(GL_STENCIL_TEST, stencilTest);
+    Enable(GL_DEPTH_TEST, depthTest);
+    Enable(GL_CULL_FACE, cullFace);
+    Enable(GL_MULTISAMPLE, multisample);
+    
+    glBlendFuncSeparate(blendSrcRGB, blendDstRGB, blendSrcAlpha, blendDstAlpha);
+    glScissor(scissorBox[0], scissorBox[1], scissorBox[2], scissorBox[3]);
+    glColorMask(colorMask[0], colorMask[1], colorMask[2], colorMask[3]);
+    
+    glStencilFunc(stencilFunc, stencilRef, stencilValueMask);
+    glStencilMask(stencilWriteMask);
+    glStencilOpSeparate(GL_FRONT, stencilOps[0][0], stencilOps[0][1], stencilOps[0][2]);
+    glStencilOpSeparate(GL_BACK, stencilOps[1][0], stencilOps[1][1], stencilOps[1][2]);
+    
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, unpackRowLength);
+    
+    if(core) {
+        glUseProgram(program);
+        glBindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
+        return;
+    }
+    
+    Enable(GL_TEXTURE_2D, texture2D);
+    Enable(GL_LINE_STIPPLE, lineStipple);
+    Enable(GL_LIGHTING, lighting);
+    Enable(GL_FOG, fog);
+    
+    // Pointers are into the array buffer bound when they were set
+    const ClientArray & v = clientArrays[0], & c = clientArrays[1], & t = clientArrays[2];
+    glBindBuffer(GL_ARRAY_BUFFER, v.buffer);
+    glVertexPointer(v.size, v.type, v.stride, v.pointer);
+    glBindBuffer(GL_ARRAY_BUFFER, c.buffer);
+    glColorPointer(c.size, c.type, c.stride, c.pointer);
+    glBindBuffer(GL_ARRAY_BUFFER, t.buffer);
+    glTexCoordPointer(t.size, t.type, t.stride, t.pointer);
+    glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
+    for(int j = 0; j < 3; ++j) {
+        if(clientArrays[j].enabled)
+            glEnableClientState(kClientArrays[j]);
+        else
+            glDisableClientState(kClientArrays[j]);
+    }
+    
+    glLineWidth(lineWidth);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, texEnvMode);
+    if(GL_HaveMultisampleFilterHint())
+        glHint(GL_MULTISAMPLE_FILTER_HINT_NV, multisampleHint);
+    glListBase(listBase);
+    glColor4fv(color);
+    glTexCoord4fv(texCoord);
+    glPixelZoom(pixelZoom[0], pixelZoom[1]);
+}
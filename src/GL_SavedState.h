@@ -0,0 +1,45 @@
+
+#ifndef GL_SAVEDSTATE_H
+#define GL_SAVEDSTATE_H
+
+#include "GL_Ext.h"
+
+// The GL state GL_GraphicsDriver and the objects it draws with may change,
+// saved and restored around a driver in place of pushing every attribute.
+// A driver's state changes must all be listed here: anything set but not
+// saved leaks out to whatever draws after it.
+//
+// Queries are made with glGet*(), so this costs no more than the state it
+// covers. Matrices are left to the caller, who pushes the stacks they load.
+// The raster position isn't kept, as anything drawing at it sets it first.
+class GL_SavedState {
+    bool core;
+    
+    GLint program, vertexArray, arrayBuffer, unpackBuffer, texture;
+    GLboolean blend, scissorTest, stencilTest, depthTest, cullFace, multisample;
+    GLint blendSrcRGB, blendDstRGB, blendSrcAlpha, blendDstAlpha;
+    GLint scissorBox[4];
+    GLboolean colorMask[4];
+    GLint stencilFunc, stencilRef, stencilValueMask, stencilWriteMask;
+    GLint stencilOps[2][3];// front and back: fail, depth fail, pass
+    GLint unpackAlignment, unpackRowLength;
+    
+    // Compatibility profiles only
+    GLboolean texture2D, lineStipple, lighting, fog;
+    struct ClientArray {
+        GLboolean enabled;
+        GLint buffer, size, type, stride;
+        GLvoid * pointer;
+    } clientArrays[3];// vertex, color, texture coordinate
+    GLfloat lineWidth;
+    GLint texEnvMode, multisampleHint, listBase;
+    GLfloat color[4], texCoord[4];
+    GLfloat pixelZoom[2];
+    
+  public:
+    // Record the current state, of a core profile context or not
+    void save(bool core);
+    void restore() const;
+};
+
+#endif // GL_SAVEDSTATE_H
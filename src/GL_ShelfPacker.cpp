@@ -0,0 +1,50 @@
+
+#include "GL_ShelfPacker.h"
+
+GL_ShelfPacker::GL_ShelfPacker(int w, int h, int padding):
+    width(w),
+    height(h),
+    padding(padding)
+{
+    clear();
+}
+
+void GL_ShelfPacker::clear()
+{
+    shelves.clear();
+    bottom = 0;
+}
+
+bool GL_ShelfPacker::alloc(int w, int h, int & x, int & y)
+{
+    int pw = w + padding;
+    int ph = h + padding;
+    if(pw > width || ph > height)
+        return false;
+    
+    // Best fit: the lowest shelf that is tall enough and has room
+    Shelf * best = nullptr;
+    for(Shelf & shelf: shelves) {
+        if(shelf.h >= ph && shelf.used + pw <= width && (!best || shelf.h < best->h))
+            best = &shelf;
+    }
+    
+    // Don't put small rectangles on a much taller shelf if a better one can be opened
+    if(!best || (best->h > ph*2 && bottom + ph <= height)) {
+        if(bottom + ph > height) {
+            if(!best)
+                return false;
+        }
+        else {
+            Shelf shelf = {bottom, ph, 0};
+            shelves.push_back(shelf);
+            bottom += ph;
+            best = &shelves.back();
+        }
+    }
+    
+    x = best->used;
+    y = best->y;
+    best->used += pw;
+    return true;
+}
@@ -0,0 +1,38 @@
+
+#ifndef GL_SHELFPACKER_H
+#define GL_SHELFPACKER_H
+
+#include <vector>
+
+// Shelf allocator for packing small rectangles (glyphs, icons) into a texture.
+// Rectangles are placed left to right on horizontal shelves; a new shelf is
+// opened below the last one when nothing fits. A shelf is chosen by best fit on
+// height, so runs of similar sized glyphs share shelves and waste little space.
+// There is no freeing of individual rectangles, only clear().
+class GL_ShelfPacker {
+    struct Shelf {
+        int y, h;
+        int used;// width allocated so far
+    };
+    
+    int width, height;
+    int padding;
+    int bottom;// first row below the last shelf
+    std::vector<Shelf> shelves;
+    
+  public:
+    // padding pixels are left between rectangles to avoid filtering bleed.
+    GL_ShelfPacker(int w, int h, int padding = 1);
+    
+    // Returns false if there is no room for the rectangle.
+    bool alloc(int w, int h, int & x, int & y);
+    void clear();
+    
+    int w() const {return width;}
+    int h() const {return height;}
+    
+    // Fraction of the area below the last shelf that is still free
+    double free_fraction() const {return 1.0 - (double)bottom/height;}
+};
+
+#endif // GL_SHELFPACKER_H
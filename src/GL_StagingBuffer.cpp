@@ -0,0 +1,60 @@
+
+#include "GL_StagingBuffer.h"
+
+GL_StagingBuffer::GL_StagingBuffer():
+    nextBuffer(0),
+    initialized(false),
+    mapped(false)
+{
+}
+
+GL_StagingBuffer & GL_StagingBuffer::shared()
+{
+    // Never destroyed, as with the glyph atlas
+    static GL_StagingBuffer * staging = new GL_StagingBuffer;
+    return *staging;
+}
+
+uint8_t * GL_StagingBuffer::map(size_t bytes)
+{
+    if(!initialized) {
+        // Deferred to here so there's a GL context to ask
+        if(GL_HavePixelBuffers())
+            glGenBuffers(kNumBuffers, pbos);
+        else
+            pbos[0] = 0;
+        initialized = true;
+    }
+    
+    mapped = false;
+    if(pbos[0]) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[nextBuffer]);
+        nextBuffer = (nextBuffer + 1)%kNumBuffers;
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        uint8_t * ptr = (uint8_t *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        if(ptr) {
+            mapped = true;
+            return ptr;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    
+    if(memory.size() < bytes)
+        memory.resize(bytes);
+    return &memory[0];
+}
+
+const GLvoid * GL_StagingBuffer::unmap()
+{
+    if(!mapped)
+        return &memory[0];
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    return nullptr;// offset 0 in the buffer
+}
+
+void GL_StagingBuffer::release()
+{
+    if(mapped)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    mapped = false;
+}
@@ -0,0 +1,41 @@
+
+#ifndef GL_STAGINGBUFFER_H
+#define GL_STAGINGBUFFER_H
+
+#include "GL_Ext.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Memory for pixels on their way to GL, reused from call to call. With pixel
+// buffer objects it's a mapped buffer, so pixels written there need no further
+// copy on the CPU. A ring of buffers is cycled through and each is orphaned on
+// reuse, so a new transfer never waits for the last one to finish. Otherwise
+// it's a plain array that only grows.
+//
+// Usage is map(), write, unmap(), pass the returned pointer to glDrawPixels()
+// or similar, release(). Needs a current GL context throughout.
+class GL_StagingBuffer {
+    enum {kNumBuffers = 2};
+    
+    GLuint pbos[kNumBuffers];
+    int nextBuffer;
+    bool initialized;
+    bool mapped;
+    std::vector<uint8_t> memory;
+    
+    GL_StagingBuffer();
+    
+  public:
+    static GL_StagingBuffer & shared();
+    
+    // Writable memory for at least bytes bytes
+    uint8_t * map(size_t bytes);
+    // Finish writing, and get the pixel pointer for GL. Until release() a
+    // pixel buffer is bound, and pointers passed to pixel unpacking calls are
+    // offsets into it.
+    const GLvoid * unmap();
+    void release();
+};
+
+#endif // GL_STAGINGBUFFER_H
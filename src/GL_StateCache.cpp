@@ -0,0 +1,140 @@
+
+#include "GL_StateCache.h"
+#include "GL_CorePipeline.h"
+
+#include <algorithm>
+#include <cmath>
+
+GL_StateCache::GL_StateCache(GL_VertexBatch * batch):
+    batch(batch),
+    pipeline_(nullptr)
+{
+    invalidate();
+    reset_stats();
+}
+
+void GL_StateCache::invalidate()
+{
+    for(int j = 0; j < kNumCapabilities; ++j)
+        capValid[j] = false;
+    scissorValid = false;
+    lineWidthValid = false;
+    blendFuncValid = false;
+    textureValid = false;
+    transformValid = false;
+}
+
+void GL_StateCache::reset_stats()
+{
+    stats_.issued = 0;
+    stats_.elided = 0;
+}
+
+GLenum GL_StateCache::CapabilityEnum(Capability cap)
+{
+    switch(cap) {
+        case MULTISAMPLE: return GL_MULTISAMPLE;
+        case SCISSOR_TEST: return GL_SCISSOR_TEST;
+        case BLEND: return GL_BLEND;
+        case TEXTURE_2D: return GL_TEXTURE_2D;
+        case STENCIL_TEST: return GL_STENCIL_TEST;
+        default: return 0;
+    }
+}
+
+bool GL_StateCache::Change(bool redundant)
+{
+    if(redundant) {
+        ++stats_.elided;
+        return false;
+    }
+    batch->flush();
+    ++stats_.issued;
+    return true;
+}
+
+void GL_StateCache::enable(Capability cap, bool on)
+{
+    if(!Change(capValid[cap] && capEnabled[cap] == on))
+        return;
+    
+    if(on)
+        glEnable(CapabilityEnum(cap));
+    else
+        glDisable(CapabilityEnum(cap));
+    capValid[cap] = true;
+    capEnabled[cap] = on;
+}
+
+void GL_StateCache::scissor(GLint x, GLint y, GLint w, GLint h)
+{
+    if(!Change(scissorValid && scissorBox[0] == x && scissorBox[1] == y &&
+               scissorBox[2] == w && scissorBox[3] == h))
+        return;
+    
+    glScissor(x, y, w, h);
+    scissorValid = true;
+    scissorBox[0] = x;
+    scissorBox[1] = y;
+    scissorBox[2] = w;
+    scissorBox[3] = h;
+}
+
+void GL_StateCache::line_width(float w)
+{
+    if(!Change(lineWidthValid && lineWidth_ == w))
+        return;
+    
+    glLineWidth(w);
+    lineWidthValid = true;
+    lineWidth_ = w;
+}
+
+void GL_StateCache::blend_func(GLenum src, GLenum dst)
+{
+    if(!Change(blendFuncValid && blendSrc == src && blendDst == dst))
+        return;
+    
+    glBlendFunc(src, dst);
+    blendFuncValid = true;
+    blendSrc = src;
+    blendDst = dst;
+}
+
+void GL_StateCache::bind_texture(GLuint tex)
+{
+    if(!Change(textureValid && texture_ == tex))
+        return;
+    
+    glBindTexture(GL_TEXTURE_2D, tex);
+    textureValid = true;
+    texture_ = tex;
+}
+
+void GL_StateCache::transform(const float m[6])
+{
+    if(!Change(transformValid && std::equal(m, m + 6, transform_)))
+        return;
+    
+    if(pipeline_) {
+        pipeline_->transform(m);
+    }
+    else {
+        const GLfloat matrix[16] = {
+            m[0], m[1], 0, 0,
+            m[2], m[3], 0, 0,
+            0,    0,    1, 0,
+            m[4], m[5], 0, 1
+        };
+        glMatrixMode(GL_MODELVIEW);
+        glLoadMatrixf(matrix);
+    }
+    transformValid = true;
+    std::copy(m, m + 6, transform_);
+    
+    // The largest singular value of the linear part, the most a unit can be
+    // stretched
+    float s = m[0]*m[0] + m[1]*m[1] + m[2]*m[2] + m[3]*m[3];
+    float det = m[0]*m[3] - m[1]*m[2];
+    batch->pixel_scale(sqrtf((s + sqrtf(std::max(s*s - 4*det*det, 0.0f)))/2));
+}
@@ -0,0 +1,93 @@
+
+#ifndef GL_STATECACHE_H
+#define GL_STATECACHE_H
+
+#include "fltk3gl/gl.h"
+#include "GL_VertexBatch.h"
+#include <cstddef>
+
+class GL_CorePipeline;
+
+// Shadow copy of the GL state touched by GL_GraphicsDriver. Setters compare
+// against the shadow and only call into GL when the value actually changes,
+// flushing the vertex batch first so pending primitives are drawn with the
+// state they were submitted under.
+//
+// Entries start out unknown, so the first set of each is always issued. Call
+// invalidate() after code outside the cache (GLU, gl_draw(), nested drivers)
+// may have changed state behind its back.
+class GL_StateCache {
+  public:
+    enum Capability {
+        MULTISAMPLE,
+        SCISSOR_TEST,
+        BLEND,
+        TEXTURE_2D,
+        STENCIL_TEST,
+        kNumCapabilities
+    };
+    
+    struct Stats {
+        size_t issued;// state calls passed on to GL
+        size_t elided;// redundant state calls dropped
+    };
+    
+  private:
+    GL_VertexBatch * batch;
+    
+    bool capValid[kNumCapabilities];
+    bool capEnabled[kNumCapabilities];
+    
+    bool scissorValid;
+    GLint scissorBox[4];
+    
+    bool lineWidthValid;
+    float lineWidth_;
+    
+    bool blendFuncValid;
+    GLenum blendSrc, blendDst;
+    
+    bool textureValid;
+    GLuint texture_;
+    
+    bool transformValid;
+    float transform_[6];
+    
+    GL_CorePipeline * pipeline_;
+    Stats stats_;
+    
+    static GLenum CapabilityEnum(Capability cap);
+    
+    // Returns true if the caller must issue the change
+    bool Change(bool redundant);
+    
+  public:
+    GL_StateCache(GL_VertexBatch * batch);
+    
+    void invalidate();
+    
+    void enable(Capability cap, bool on = true);
+    void disable(Capability cap) {enable(cap, false);}
+    bool enabled(Capability cap) const {return capValid[cap] && capEnabled[cap];}
+    
+    void scissor(GLint x, GLint y, GLint w, GLint h);
+    void line_width(float w);
+    void blend_func(GLenum src, GLenum dst);
+    void bind_texture(GLuint tex);
+    GLuint texture() const {return textureValid? texture_ : 0;}
+    
+    // The 2D affine transform from vertex to window coordinates, as a, b, c,
+    // d, x, y of FLTK's matrix: x' = a*x + c*y + x, y' = b*x + d*y + y. Loaded
+    // as the modelview matrix, or the pipeline's transform uniform, and passed
+    // to the batch as its pixel_scale().
+    void transform(const float m[6]);
+    
+    // Set transforms through pipeline, whose program must be in use. Null for
+    // the fixed-function pipeline.
+    void pipeline(GL_CorePipeline * pipeline) {pipeline_ = pipeline;}
+    
+    const Stats & stats() const {return stats_;}
+    void reset_stats();
+};
+
+#endif // GL_STATECACHE_H
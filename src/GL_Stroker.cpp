@@ -0,0 +1,350 @@
+
+#include "GL_Stroker.h"
+#include "fltk3/Device.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Round joins and caps are flattened to chords within this many pixels
+static const float kFlatness = 0.2;
+
+GL_Stroker::GL_Stroker():
+    style(nullptr),
+    numLevels(0),
+    numRadii(0)
+{
+}
+
+void GL_Stroker::Style::line_style(int style, float w, const char * dashList)
+{
+    width = w;
+    switch(style & 0xF00) {
+        case fltk3::CAP_ROUND: cap = CAP_ROUND; break;
+        case fltk3::CAP_SQUARE: cap = CAP_SQUARE; break;
+        default: cap = CAP_FLAT; break;
+    }
+    switch(style & 0xF000) {
+        case fltk3::JOIN_ROUND: join = JOIN_ROUND; break;
+        case fltk3::JOIN_BEVEL: join = JOIN_BEVEL; break;
+        default: join = JOIN_MITER; break;
+    }
+    
+    // Dash lengths as X11 FLTK has them: in proportion to the width, and
+    // shortened where caps stick out past the ends of dashes.
+    dashes.clear();
+    if(dashList && *dashList) {
+        while(*dashList)
+            dashes.push_back((unsigned char)*dashList++);
+    }
+    else {
+        float dash, dot, gap;
+        if(style & 0x200) {
+            dash = 2*w;
+            dot = 1;
+            gap = 2*w - 1;
+        }
+        else {
+            dash = 3*w;
+            dot = gap = w;
+        }
+        switch(style & 0xFF) {
+            case fltk3::DASH: dashes = {dash, gap}; break;
+            case fltk3::DOT: dashes = {dot, gap}; break;
+            case fltk3::DASHDOT: dashes = {dash, gap, dot, gap}; break;
+            case fltk3::DASHDOTDOT: dashes = {dash, gap, dot, gap, dot, gap}; break;
+        }
+    }
+}
+
+void GL_Stroker::Quad(float ax, float ay, float ac, float bx, float by, float bc,
+                      float cx, float cy, float cc, float dx, float dy, float dc)
+{
+    Emit(ax, ay, ac);
+    Emit(bx, by, bc);
+    Emit(cx, cy, cc);
+    Emit(ax, ay, ac);
+    Emit(cx, cy, cc);
+    Emit(dx, dy, dc);
+}
+
+void GL_Stroker::Profile()
+{
+    float hw = style->width/2;
+    if(style->antialias) {
+        // Solid core, then a one pixel ramp centered on the true edge. Lines
+        // under two pixels wide only reach the coverage of their width.
+        float inner = std::max(hw - 0.5f, 0.0f), outer = hw + 0.5f;
+        float peak = std::min(style->width, 1.0f);
+        if(inner > 0) {
+            numLevels = 4;
+            float o[4] = {-outer, -inner, inner, outer}, c[4] = {0, peak, peak, 0};
+            std::copy(o, o + 4, offsets);
+            std::copy(c, c + 4, coverages);
+            numRadii = 3;
+            float r[3] = {0, inner, outer}, rc[3] = {peak, peak, 0};
+            std::copy(r, r + 3, radii);
+            std::copy(rc, rc + 3, radiusCoverages);
+        }
+        else {
+            numLevels = 3;
+            float o[3] = {-outer, 0, outer}, c[3] = {0, peak, 0};
+            std::copy(o, o + 3, offsets);
+            std::copy(c, c + 3, coverages);
+            numRadii = 2;
+            float r[2] = {0, outer}, rc[2] = {peak, 0};
+            std::copy(r, r + 2, radii);
+            std::copy(rc, rc + 2, radiusCoverages);
+        }
+    }
+    else {
+        numLevels = 2;
+        offsets[0] = -hw;
+        offsets[1] = hw;
+        coverages[0] = coverages[1] = 1;
+        numRadii = 2;
+        radii[0] = 0;
+        radii[1] = hw;
+        radiusCoverages[0] = radiusCoverages[1] = 1;
+    }
+}
+
+// The body of a segment, lengthened by the given amounts at either end
+void GL_Stroker::Segment(const float * a, const float * b, float extendA, float extendB)
+{
+    float tx = b[0] - a[0], ty = b[1] - a[1];
+    float len = sqrtf(tx*tx + ty*ty);
+    if(len > 0) {
+        tx /= len;
+        ty /= len;
+    }
+    else {
+        tx = 1;
+        ty = 0;
+    }
+    float nx = -ty, ny = tx;
+    float ax = a[0] - tx*extendA, ay = a[1] - ty*extendA;
+    float bx = b[0] + tx*extendB, by = b[1] + ty*extendB;
+    for(int k = 0; k + 1 < numLevels; ++k) {
+        float o0 = offsets[k], o1 = offsets[k + 1];
+        float c0 = coverages[k], c1 = coverages[k + 1];
+        Quad(ax + nx*o0, ay + ny*o0, c0, bx + nx*o0, by + ny*o0, c0,
+             bx + nx*o1, by + ny*o1, c1, ax + nx*o1, ay + ny*o1, c1);
+    }
+}
+
+// Wedges about p between successive directions, each direction scaled so
+// that miters reach their points.
+void GL_Stroker::Fan(const float * p, const float * dirs, const float * scales, int n)
+{
+    for(int j = 0; j + 1 < n; ++j) {
+        const float * d0 = dirs + 2*j, * d1 = dirs + 2*j + 2;
+        float s0 = scales[j], s1 = scales[j + 1];
+        for(int k = 0; k + 1 < numRadii; ++k) {
+            float r0 = radii[k], r1 = radii[k + 1];
+            float c0 = radiusCoverages[k], c1 = radiusCoverages[k + 1];
+            if(r0 == 0) {
+                Emit(p[0], p[1], c0);
+                Emit(p[0] + d0[0]*s0*r1, p[1] + d0[1]*s0*r1, c1);
+                Emit(p[0] + d1[0]*s1*r1, p[1] + d1[1]*s1*r1, c1);
+            }
+            else {
+                Quad(p[0] + d0[0]*s0*r0, p[1] + d0[1]*s0*r0, c0, p[0] + d1[0]*s1*r0, p[1] + d1[1]*s1*r0, c0,
+                     p[0] + d1[0]*s1*r1, p[1] + d1[1]*s1*r1, c1, p[0] + d0[0]*s0*r1, p[1] + d0[1]*s0*r1, c1);
+            }
+        }
+    }
+}
+
+// Round wedge from direction a, sweeping counterclockwise by sweep radians
+void GL_Stroker::Arc(const float * p, float ax, float ay, float bx, float by, float sweep)
+{
+    float r = radii[numRadii - 1];
+    float step = (r > kFlatness)? 2*acosf(1 - kFlatness/r) : M_PI;
+    int n = std::max((int)ceilf(fabsf(sweep)/step), 1);
+    float dc = cosf(sweep/n), ds = sinf(sweep/n);
+    
+    fanDirs.resize(2*(n + 1));
+    fanScales.assign(n + 1, 1);
+    float x = ax, y = ay;
+    for(int j = 0; j < n; ++j) {
+        fanDirs[2*j] = x;
+        fanDirs[2*j + 1] = y;
+        float t = x*dc - y*ds;
+        y = x*ds + y*dc;
+        x = t;
+    }
+    fanDirs[2*n] = bx;
+    fanDirs[2*n + 1] = by;
+    Fan(p, &fanDirs[0], &fanScales[0], n + 1);
+}
+
+// Fill the outside of the turn at b between segments a-b and b-c. The
+// inside is covered by the segments overlapping.
+void GL_Stroker::Join(const float * a, const float * b, const float * c)
+{
+    float t0x = b[0] - a[0], t0y = b[1] - a[1], t1x = c[0] - b[0], t1y = c[1] - b[1];
+    float l0 = sqrtf(t0x*t0x + t0y*t0y), l1 = sqrtf(t1x*t1x + t1y*t1y);
+    t0x /= l0; t0y /= l0;
+    t1x /= l1; t1y /= l1;
+    float cross = t0x*t1y - t0y*t1x, dot = t0x*t1x + t0y*t1y;
+    if(fabsf(cross) < 1e-4f && dot > 0)
+        return;// straight on
+    
+    // Outside of a left turn is on the right
+    float side = (cross > 0)? -1 : 1;
+    float d[6] = {-t0y*side, t0x*side, 0, 0, -t1y*side, t1x*side};
+    float scales[3] = {1, 1, 1};
+    
+    if(style->join == JOIN_ROUND) {
+        Arc(b, d[0], d[1], d[4], d[5], atan2f(d[0]*d[5] - d[1]*d[4], d[0]*d[4] + d[1]*d[5]));
+        return;
+    }
+    if(style->join == JOIN_MITER) {
+        float mx = d[0] + d[4], my = d[1] + d[5];
+        float ml = sqrtf(mx*mx + my*my);
+        if(ml > 1e-4f) {
+            mx /= ml;
+            my /= ml;
+            float scale = 1/(mx*d[0] + my*d[1]);
+            if(scale <= style->miterLimit) {
+                d[2] = mx;
+                d[3] = my;
+                scales[1] = scale;
+                Fan(b, d, scales, 3);
+                return;
+            }
+        }
+    }
+    // Bevel
+    d[2] = d[4];
+    d[3] = d[5];
+    Fan(b, d, scales, 2);
+}
+
+// Cap the end p of a line, t pointing away from the line
+void GL_Stroker::Cap(const float * p, float tx, float ty)
+{
+    float nx = -ty, ny = tx;
+    if(style->cap == CAP_ROUND) {
+        Arc(p, nx, ny, -nx, -ny, -M_PI);
+        return;
+    }
+    if(!style->antialias)
+        return;
+    
+    // Flat ends fade out over half a pixel beyond the end, as for polygons
+    float ext = (style->cap == CAP_SQUARE)? style->width/2 : 0;
+    float ex = p[0] + tx*ext, ey = p[1] + ty*ext;
+    float fx = tx*0.5f, fy = ty*0.5f;
+    for(int k = 0; k + 1 < numLevels; ++k) {
+        float o0 = offsets[k], o1 = offsets[k + 1];
+        float c0 = coverages[k]/2, c1 = coverages[k + 1]/2;
+        Quad(ex + nx*o0, ey + ny*o0, c0, ex + nx*o1, ey + ny*o1, c1,
+             ex + nx*o1 + fx, ey + ny*o1 + fy, 0, ex + nx*o0 + fx, ey + ny*o0 + fy, 0);
+    }
+}
+
+void GL_Stroker::Stroke(const float * xy, int n, bool closed)
+{
+    points.clear();
+    for(int j = 0; j < n; ++j) {
+        size_t m = points.size();
+        if(m && points[m - 2] == xy[2*j] && points[m - 1] == xy[2*j + 1])
+            continue;
+        points.push_back(xy[2*j]);
+        points.push_back(xy[2*j + 1]);
+    }
+    int m = points.size()/2;
+    if(closed && m > 2 && points[0] == points[2*m - 2] && points[1] == points[2*m - 1])
+        --m;
+    if(m == 0)
+        return;
+    const float * p = &points[0];
+    
+    if(m == 1) {
+        // A dot, unless the ends are flat
+        if(style->cap == CAP_ROUND)
+            Arc(p, 1, 0, 1, 0, 2*M_PI);
+        else if(style->cap == CAP_SQUARE)
+            Segment(p, p, style->width/2, style->width/2);
+        return;
+    }
+    
+    if(closed) {
+        for(int j = 0; j < m; ++j) {
+            int k = (j + 1)%m, i = (j + m - 1)%m;
+            Segment(p + 2*j, p + 2*k, 0, 0);
+            Join(p + 2*i, p + 2*j, p + 2*k);
+        }
+        return;
+    }
+    
+    float ext = (style->cap == CAP_SQUARE)? style->width/2 : 0;
+    for(int j = 0; j + 1 < m; ++j)
+        Segment(p + 2*j, p + 2*j + 2, (j == 0)? ext : 0, (j + 2 == m)? ext : 0);
+    for(int j = 1; j + 1 < m; ++j)
+        Join(p + 2*j - 2, p + 2*j, p + 2*j + 2);
+    
+    const float * a = p, * b = p + 2;
+    float l = hypotf(a[0] - b[0], a[1] - b[1]);
+    Cap(a, (a[0] - b[0])/l, (a[1] - b[1])/l);
+    a = p + 2*m - 2;
+    b = p + 2*m - 4;
+    l = hypotf(a[0] - b[0], a[1] - b[1]);
+    Cap(a, (a[0] - b[0])/l, (a[1] - b[1])/l);
+}
+
+// Split the path into dashes by length, each stroked with its own caps. The
+// pattern starts afresh with each path.
+void GL_Stroker::Dashed(const float * xy, int n, bool closed)
+{
+    const std::vector<float> & dashes = style->dashes;
+    size_t index = 0;
+    float remaining = dashes[0];
+    bool on = true;
+    
+    dash.assign(xy, xy + 2);
+    int segments = closed? n : n - 1;
+    for(int j = 0; j < segments; ++j) {
+        const float * a = xy + 2*j, * b = xy + 2*((j + 1)%n);
+        float tx = b[0] - a[0], ty = b[1] - a[1];
+        float len = sqrtf(tx*tx + ty*ty);
+        float pos = 0;
+        while(len - pos > remaining) {
+            pos += remaining;
+            float x = a[0] + tx*pos/len, y = a[1] + ty*pos/len;
+            if(on) {
+                dash.push_back(x);
+                dash.push_back(y);
+                Stroke(&dash[0], dash.size()/2, false);
+            }
+            dash.assign({x, y});
+            on = !on;
+            index = (index + 1)%dashes.size();
+            remaining = dashes[index];
+        }
+        remaining -= len - pos;
+        if(on) {
+            dash.push_back(b[0]);
+            dash.push_back(b[1]);
+        }
+    }
+    if(on)
+        Stroke(&dash[0], dash.size()/2, false);
+}
+
+const std::vector<GL_Stroker::Vertex> & GL_Stroker::stroke(const Style & style, const float * xy, int n, bool closed)
+{
+    out.clear();
+    this->style = &style;
+    Profile();
+    
+    float period = 0;
+    for(float d: style.dashes)
+        period += d;
+    if(n > 1 && period > 0)
+        Dashed(xy, n, closed);
+    else if(n > 0)
+        Stroke(xy, n, closed);
+    return out;
+}
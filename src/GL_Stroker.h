@@ -0,0 +1,75 @@
+
+#ifndef GL_STROKER_H
+#define GL_STROKER_H
+
+#include <vector>
+
+// Turns polylines into triangles for wide and dashed lines, which GL lines
+// can't draw properly: glLineWidth() is capped at 1 by many drivers, and
+// ignores joins and caps. Joins are mitered, rounded or beveled on the outside
+// of each turn and caps are flat, round or square, as with X11.
+//
+// With antialias set, edges fade out over a pixel, so lines look right
+// without multisampling.
+//
+// Output is triangles with a coverage for each vertex, to be drawn in the
+// line color with alpha scaled by coverage. GL_VertexBatch does this.
+class GL_Stroker {
+  public:
+    enum Cap {CAP_FLAT, CAP_ROUND, CAP_SQUARE};
+    enum Join {JOIN_MITER, JOIN_ROUND, JOIN_BEVEL};
+    
+    struct Style {
+        float width;
+        Cap cap;
+        Join join;
+        float miterLimit;// longest miter, in line widths
+        std::vector<float> dashes;// alternating on and off lengths, empty for solid
+        bool antialias;
+    
+        Style(): width(1), cap(CAP_FLAT), join(JOIN_MITER), miterLimit(10), antialias(false) {}
+    
+        // Width, cap, join and dashes from fltk3::line_style() arguments
+        void line_style(int style, float width, const char * dashes);
+    };
+    
+    struct Vertex {
+        float x, y;
+        float coverage;
+    };
+    
+  private:
+    const Style * style;
+    std::vector<Vertex> out;
+    std::vector<float> points;// without repeats
+    std::vector<float> dash;// current dash
+    std::vector<float> fanDirs, fanScales;
+    
+    // Cross section: offsets from the center line and their coverage, and
+    // the half from the center outwards for joins and caps.
+    int numLevels;
+    float offsets[4], coverages[4];
+    int numRadii;
+    float radii[3], radiusCoverages[3];
+    
+    void Emit(float x, float y, float c) {Vertex v = {x, y, c}; out.push_back(v);}
+    void Quad(float ax, float ay, float ac, float bx, float by, float bc,
+              float cx, float cy, float cc, float dx, float dy, float dc);
+    void Profile();
+    void Segment(const float * a, const float * b, float extendA, float extendB);
+    void Fan(const float * p, const float * dirs, const float * scales, int n);
+    void Arc(const float * p, float ax, float ay, float bx, float by, float sweep);
+    void Join(const float * a, const float * b, const float * c);
+    void Cap(const float * p, float tx, float ty);
+    void Stroke(const float * xy, int n, bool closed);
+    void Dashed(const float * xy, int n, bool closed);
+    
+  public:
+    GL_Stroker();
+    
+    // Stroke n points xy, closing the path if closed. Returns triangles, three
+    // vertices each, valid until the next call.
+    const std::vector<Vertex> & stroke(const Style & style, const float * xy, int n, bool closed);
+};
+
+#endif // GL_STROKER_H
@@ -0,0 +1,200 @@
+
+#include "GL_Tessellator.h"
+
+#include <iostream>
+#include <cstring>
+
+using namespace std;
+
+GL_Tessellator::GL_Tessellator():
+    out(nullptr),
+    arenaUsed(0),
+    cachedVertices(0)
+{
+    tess = gluNewTess();
+    gluTessCallback(tess, GLU_TESS_BEGIN_DATA, (void (*)())BeginCB);
+    gluTessCallback(tess, GLU_TESS_VERTEX_DATA, (void (*)())VertexCB);
+    gluTessCallback(tess, GLU_TESS_COMBINE_DATA, (void (*)())CombineCB);
+    gluTessCallback(tess, GLU_TESS_ERROR_DATA, (void (*)())ErrorCB);
+    // With an edge flag callback GLU only produces GL_TRIANGLES, never fans
+    // or strips.
+    gluTessCallback(tess, GLU_TESS_EDGE_FLAG_DATA, (void (*)())EdgeFlagCB);
+    gluTessProperty(tess, GLU_TESS_WINDING_RULE, GLU_TESS_WINDING_ODD);
+    // Everything is in the xy plane, don't make GLU work that out
+    gluTessNormal(tess, 0, 0, 1);
+    reset_stats();
+}
+
+GL_Tessellator::~GL_Tessellator()
+{
+    gluDeleteTess(tess);
+}
+
+GL_Tessellator & GL_Tessellator::shared()
+{
+    static GL_Tessellator * tessellator = new GL_Tessellator;
+    return *tessellator;
+}
+
+void GL_Tessellator::reset_stats()
+{
+    stats_.hits = 0;
+    stats_.misses = 0;
+    stats_.combined = 0;
+}
+
+void GL_Tessellator::BeginCB(GLenum, void *)
+{
+    // Always GL_TRIANGLES, see the edge flag callback
+}
+
+void GL_Tessellator::VertexCB(void * vertex, void * self)
+{
+    const double * v = (const double *)vertex;
+    std::vector<float> & out = *((GL_Tessellator *)self)->out;
+    out.push_back(v[0]);
+    out.push_back(v[1]);
+}
+
+void GL_Tessellator::CombineCB(GLdouble coords[3], void * [4], GLfloat [4], void ** out, void * self)
+{
+    // Tessellator generated a new vertex, needs somewhere to put it
+    double * v = ((GL_Tessellator *)self)->NewVertex();
+    v[0] = coords[0];
+    v[1] = coords[1];
+    v[2] = coords[2];
+    *out = v;
+}
+
+void GL_Tessellator::EdgeFlagCB(GLboolean, void *)
+{
+}
+
+void GL_Tessellator::ErrorCB(GLenum error, void *)
+{
+    cerr << "GLU tessellation error: " << gluErrorString(error) << endl;
+}
+
+double * GL_Tessellator::NewVertex()
+{
+    size_t block = arenaUsed/kArenaBlock, index = arenaUsed%kArenaBlock;
+    if(block == arena.size())
+        arena.push_back(std::unique_ptr<double[]>(new double[3*kArenaBlock]));
+    ++arenaUsed;
+    ++stats_.combined;
+    return &arena[block][3*index];
+}
+
+uint64_t GL_Tessellator::Hash(const double * xy, int n, const std::vector<int> & contours)
+{
+    // FNV-1a over the relative points and the contour starts
+    uint64_t h = 14695981039346656037ULL;
+    auto mix = [&h](const void * data, size_t bytes) {
+        const uint8_t * p = (const uint8_t *)data;
+        for(size_t j = 0; j < bytes; ++j)
+            h = (h ^ p[j])*1099511628211ULL;
+    };
+    for(int j = 0; j < n; ++j) {
+        float d[2] = {(float)(xy[2*j] - xy[0]), (float)(xy[2*j + 1] - xy[1])};
+        mix(d, sizeof(d));
+    }
+    if(!contours.empty())
+        mix(&contours[0], contours.size()*sizeof(int));
+    return h;
+}
+
+void GL_Tessellator::Tessellate(const double * xy, int n, const std::vector<int> & contours,
+                                std::vector<float> & triangles)
+{
+    // Relative to the first point, so the result can be reused anywhere
+    coords.resize(3*n);
+    for(int j = 0; j < n; ++j) {
+        coords[3*j] = xy[2*j] - xy[0];
+        coords[3*j + 1] = xy[2*j + 1] - xy[1];
+        coords[3*j + 2] = 0;
+    }
+    
+    triangles.clear();
+    out = &triangles;
+    arenaUsed = 0;
+    
+    gluTessBeginPolygon(tess, this);
+    gluTessBeginContour(tess);
+    auto cont = contours.begin();
+    for(int j = 0; j < n; ++j) {
+        if(cont != contours.end() && *cont == j) {
+            gluTessEndContour(tess);
+            gluTessBeginContour(tess);
+            ++cont;
+        }
+        gluTessVertex(tess, &coords[3*j], &coords[3*j]);
+    }
+    gluTessEndContour(tess);
+    gluTessEndPolygon(tess);
+    out = nullptr;
+}
+
+const std::vector<float> & GL_Tessellator::triangulate(const double * xy, int n, const std::vector<int> & contours)
+{
+    uint64_t hash = Hash(xy, n, contours);
+    auto range = cache.equal_range(hash);
+    for(auto e = range.first; e != range.second; ++e) {
+        Entry & entry = e->second;
+        if(entry.points.size() != 2*(size_t)n || entry.contours != contours)
+            continue;
+        bool same = true;
+        for(int j = 0; j < n && same; ++j)
+            same = entry.points[2*j] == (float)(xy[2*j] - xy[0]) &&
+                   entry.points[2*j + 1] == (float)(xy[2*j + 1] - xy[1]);
+        if(same) {
+            lru.splice(lru.begin(), lru, entry.lru);
+            ++stats_.hits;
+            return entry.triangles;
+        }
+    }
+    
+    ++stats_.misses;
+    if(2*(size_t)n > kMaxCachedVertices) {
+        Tessellate(xy, n, contours, uncached);
+        return uncached;
+    }
+    
+    Entry & entry = cache.insert(std::make_pair(hash, Entry()))->second;
+    entry.points.resize(2*n);
+    for(int j = 0; j < n; ++j) {
+        entry.points[2*j] = xy[2*j] - xy[0];
+        entry.points[2*j + 1] = xy[2*j + 1] - xy[1];
+    }
+    entry.contours = contours;
+    Tessellate(xy, n, contours, entry.triangles);
+    lru.push_front(hash);
+    entry.lru = lru.begin();
+    cachedVertices += entry.points.size() + entry.triangles.size();
+    
+    Evict();
+    return entry.triangles;
+}
+
+void GL_Tessellator::Evict()
+{
+    // The most recent entry always stays, it's about to be drawn
+    while(cachedVertices > kMaxCachedVertices && lru.size() > 1) {
+        uint64_t hash = lru.back();
+        auto range = cache.equal_range(hash);
+        for(auto e = range.first; e != range.second; ++e) {
+            if(e->second.lru == std::prev(lru.end())) {
+                cachedVertices -= e->second.points.size() + e->second.triangles.size();
+                cache.erase(e);
+                break;
+            }
+        }
+        lru.pop_back();
+    }
+}
+
+void GL_Tessellator::clear()
+{
+    cache.clear();
+    lru.clear();
+    cachedVertices = 0;
+}
@@ -0,0 +1,87 @@
+
+#ifndef GL_TESSELLATOR_H
+#define GL_TESSELLATOR_H
+
+#include "fltk3gl/glu.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+// Triangulation of complex polygons with GLU, for end_complex_polygon().
+// One GLU tessellator is kept for the life of the process, intersection
+// vertices come from an arena that is reset rather than freed, and output is
+// forced to plain triangles so it can go straight into the vertex batch.
+//
+// Results are cached by shape: the points relative to the first one, plus
+// the contour starts. Shapes redrawn every frame, or moved, are only
+// tessellated once. Points are compared to float precision, that of the
+// triangles, so that moving a shape by rounding noise doesn't miss. The cache
+// is LRU, limited by total vertices.
+//
+// Uses GLU only, so no GL context is needed.
+class GL_Tessellator {
+  public:
+    struct Stats {
+        size_t hits;
+        size_t misses;
+        size_t combined;// intersection vertices generated
+    };
+    
+  private:
+    enum {kArenaBlock = 1024, kMaxCachedVertices = 1 << 20};
+    
+    struct Entry {
+        std::vector<float> points;// relative to the first point
+        std::vector<int> contours;
+        std::vector<float> triangles;
+        std::list<uint64_t>::iterator lru;
+    };
+    
+    GLUtesselator * tess;
+    
+    // Current tessellation
+    std::vector<double> coords;// x, y, z for GLU
+    std::vector<float> * out;
+    std::vector<std::unique_ptr<double[]> > arena;
+    size_t arenaUsed;
+    
+    std::unordered_multimap<uint64_t, Entry> cache;
+    std::list<uint64_t> lru;// most recently used first
+    size_t cachedVertices;
+    std::vector<float> uncached;
+    Stats stats_;
+    
+    static uint64_t Hash(const double * xy, int n, const std::vector<int> & contours);
+    static void BeginCB(GLenum type, void * self);
+    static void VertexCB(void * vertex, void * self);
+    static void CombineCB(GLdouble coords[3], void * data[4], GLfloat weights[4], void ** out, void * self);
+    static void EdgeFlagCB(GLboolean flag, void * self);
+    static void ErrorCB(GLenum error, void * self);
+    
+    double * NewVertex();
+    void Tessellate(const double * xy, int n, const std::vector<int> & contours, std::vector<float> & triangles);
+    void Evict();
+    
+    GL_Tessellator();
+    
+  public:
+    ~GL_Tessellator();
+    
+    static GL_Tessellator & shared();
+    
+    // Triangulate n points (x, y pairs) under the odd winding rule. New
+    // contours start at the point indices in contours. Returns triangle
+    // vertices as x, y pairs relative to the first point, valid until the
+    // next call.
+    const std::vector<float> & triangulate(const double * xy, int n, const std::vector<int> & contours);
+    
+    void clear();
+    
+    const Stats & stats() const {return stats_;}
+    void reset_stats();
+};
+
+#endif // GL_TESSELLATOR_H
@@ -0,0 +1,169 @@
+
+#include "GL_TextureCache.h"
+#include "GL_Ext.h"
+
+#include <cstring>
+
+GL_TextureCache::GL_TextureCache():
+    budget_(64 << 20),
+    resident(0)
+{
+    reset_stats();
+}
+
+GL_TextureCache & GL_TextureCache::shared()
+{
+    // Never destroyed, as with the glyph atlas
+    static GL_TextureCache * cache = new GL_TextureCache;
+    return *cache;
+}
+
+void GL_TextureCache::reset_stats()
+{
+    stats_.hits = 0;
+    stats_.misses = 0;
+    stats_.evictions = 0;
+    stats_.uploadedBytes = 0;
+}
+
+void GL_TextureCache::Remove(std::unordered_map<const void *, Texture>::iterator t)
+{
+    glDeleteTextures(1, &t->second.tex);
+    resident -= t->second.bytes;
+    lru.erase(t->second.lru);
+    textures.erase(t);
+}
+
+void GL_TextureCache::Evict(const void * keep)
+{
+    while(resident > budget_ && !lru.empty()) {
+        const void * id = lru.back();
+        if(id == keep)
+            break;// keep is most recently used, nothing else left
+        Remove(textures.find(id));
+        ++stats_.evictions;
+    }
+}
+
+GL_TextureCache::Texture * GL_TextureCache::lookup(const void * id, const void * data, uint32_t generation,
+                                                   int w, int h, int d, int ld, bool & current)
+{
+    current = false;
+    // Queried here, as the cache can be made before there's a context
+    GLint maxSize = GL_MaxTextureSize();
+    if(d < 1 || d > 4 || w <= 0 || h <= 0 || w > maxSize || h > maxSize)
+        return nullptr;
+    size_t bytes = Bytes(w, h, d);
+    if(bytes > budget_)
+        return nullptr;
+    
+    auto found = textures.find(id);
+    if(found != textures.end()) {
+        Texture & t = found->second;
+        lru.splice(lru.begin(), lru, t.lru);
+        current = !t.dirty && t.data == data && t.generation == generation &&
+                  t.w == w && t.h == h && t.d == d && t.ld == ld;
+        if(current) {
+            ++stats_.hits;
+            return &t;
+        }
+        // Same texture object, reallocated by upload() if the size changed
+        ++stats_.misses;
+        resident = resident - t.bytes + bytes;
+        t.w = w;
+        t.h = h;
+        t.d = d;
+        t.ld = ld;
+        t.data = data;
+        t.generation = generation;
+        t.dirty = true;
+        t.bytes = bytes;
+        Evict(id);
+        return &t;
+    }
+    
+    ++stats_.misses;
+    Texture & t = textures[id];
+    glGenTextures(1, &t.tex);
+    t.w = w;
+    t.h = h;
+    t.d = d;
+    t.ld = ld;
+    t.data = data;
+    t.generation = generation;
+    t.dirty = true;
+    t.bytes = bytes;
+    lru.push_front(id);
+    t.lru = lru.begin();
+    resident += bytes;
+    Evict(id);
+    return &t;
+}
+
+void GL_TextureCache::upload(Texture * t, const uint8_t * pixels)
+{
+    static const GLenum kFormats[4] = {GL_LUMINANCE, GL_LUMINANCE_ALPHA, GL_RGB, GL_RGBA};
+    
+    // GL row lengths are in whole pixels; repack lines padded to anything else
+    int rowLength = t->ld/t->d;
+    if(t->ld%t->d) {
+        int row = t->w*t->d;
+        scratch.resize((size_t)row*t->h);
+        for(int y = 0; y < t->h; ++y)
+            memcpy(&scratch[(size_t)y*row], pixels + (size_t)y*t->ld, row);
+        pixels = &scratch[0];
+        rowLength = t->w;
+    }
+    
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+    GL_TexImage(kFormats[t->d - 1], t->w, t->h, pixels);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    
+    t->dirty = false;
+    stats_.uploadedBytes += (size_t)t->w*t->h*t->d;
+}
+
+void GL_TextureCache::invalidate(const void * id)
+{
+    auto found = textures.find(id);
+    if(found != textures.end())
+        found->second.dirty = true;
+}
+
+void GL_TextureCache::track(const void * buf, uint32_t generation)
+{
+    trackedBuffers[buf] = generation;
+}
+
+void GL_TextureCache::untrack(const void * buf)
+{
+    // The texture itself is left to age out
+    trackedBuffers.erase(buf);
+    invalidate(buf);
+}
+
+bool GL_TextureCache::tracked(const void * buf, uint32_t & generation) const
+{
+    auto found = trackedBuffers.find(buf);
+    if(found == trackedBuffers.end())
+        return false;
+    generation = found->second;
+    return true;
+}
+
+void GL_TextureCache::budget(size_t bytes)
+{
+    budget_ = bytes;
+    // Shrinks on the next lookup(), when a GL context is known to be current
+}
+
+void GL_TextureCache::clear()
+{
+    while(!textures.empty())
+        Remove(textures.begin());
+}
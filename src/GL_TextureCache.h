@@ -0,0 +1,97 @@
+
+#ifndef GL_TEXTURECACHE_H
+#define GL_TEXTURECACHE_H
+
+#include "fltk3gl/gl.h"
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <vector>
+#include <unordered_map>
+
+// Keeps images resident as textures so that redrawing an unchanged image is a
+// textured quad instead of a glDrawPixels() upload.
+//
+// Textures are keyed on an identity pointer: the fltk3::RGBImage for image
+// objects, or the pixel buffer for draw_image(). The cache can't see pixels
+// change, so raw buffers are only cached once registered with track(), and
+// callers must invalidate() (or track() with a new generation) after writing
+// to a cached image. A texture is also reuploaded when the data pointer,
+// dimensions or depth it was made from change.
+//
+// Resident textures are kept under a byte budget, evicting least recently
+// used first. One cache is shared by all drivers in the process, like the
+// glyph atlas.
+class GL_TextureCache {
+  public:
+    struct Texture {
+        GLuint tex;
+        int w, h, d, ld;
+        const void * data;
+        uint32_t generation;
+        bool dirty;
+        size_t bytes;
+        std::list<const void *>::iterator lru;
+    };
+    
+    struct Stats {
+        size_t hits;
+        size_t misses;// includes reuploads of stale textures
+        size_t evictions;
+        size_t uploadedBytes;
+    };
+    
+  private:
+    std::unordered_map<const void *, Texture> textures;
+    std::list<const void *> lru;// most recently used first
+    std::unordered_map<const void *, uint32_t> trackedBuffers;
+    size_t budget_;
+    size_t resident;
+    std::vector<uint8_t> scratch;
+    Stats stats_;
+    
+    static size_t Bytes(int w, int h, int d) {return (size_t)w*h*((d == 3)? 4 : d);}
+    void Evict(const void * keep);
+    void Remove(std::unordered_map<const void *, Texture>::iterator t);
+    
+    GL_TextureCache();
+    
+  public:
+    static GL_TextureCache & shared();
+    
+    // Find the texture for id, creating it if needed. Sets current if the
+    // texture holds the given pixels; if not the caller must bind t->tex and
+    // call upload(). Returns null if the image can't be cached (too large or
+    // unsupported depth) and should be drawn some other way.
+    //
+    // May delete textures to stay within budget, so the caller must flush
+    // anything drawn from cached textures and must not have one bound.
+    Texture * lookup(const void * id, const void * data, uint32_t generation,
+                     int w, int h, int d, int ld, bool & current);
+    
+    // Upload pixels to a texture returned by lookup(), which must be bound.
+    // d is bytes per pixel (1 to 4), ld bytes per line, both positive.
+    void upload(Texture * t, const uint8_t * pixels);
+    
+    // Mark an image's texture out of date. Needs no GL context.
+    void invalidate(const void * id);
+    
+    // Allow draw_image() to cache a pixel buffer. Registering again with a
+    // different generation marks the texture out of date.
+    void track(const void * buf, uint32_t generation = 0);
+    void untrack(const void * buf);
+    bool tracked(const void * buf, uint32_t & generation) const;
+    
+    // Bytes of texture memory the cache may use, default 64 MB
+    void budget(size_t bytes);
+    size_t budget() const {return budget_;}
+    size_t resident_bytes() const {return resident;}
+    
+    // Delete all textures. Needs a GL context.
+    void clear();
+    
+    const Stats & stats() const {return stats_;}
+    void reset_stats();
+};
+
+#endif // GL_TEXTURECACHE_H
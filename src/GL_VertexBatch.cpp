@@ -0,0 +1,451 @@
+
+#include "GL_VertexBatch.h"
+#include "GL_CorePipeline.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+GL_VertexBatch::GL_VertexBatch():
+    batchMode(GL_TRIANGLES),
+    primMode(GL_TRIANGLES),
+    primStart(0),
+    primCount(0),
+    solidU(0),
+    solidV(0),
+    strokeStyle(nullptr),
+    pipeline_(nullptr),
+    packing(true),
+    pixelScale(1)
+{
+    curColor[0] = curColor[1] = curColor[2] = 0;
+    curColor[3] = 255;
+    verts.reserve(4096);
+    reset_stats();
+}
+
+GL_VertexBatch::~GL_VertexBatch()
+{
+    flush();
+}
+
+void GL_VertexBatch::reset_stats()
+{
+    stats_.drawCalls = 0;
+    stats_.vertices = 0;
+    stats_.primitives = 0;
+    stats_.bytes = 0;
+}
+
+void GL_VertexBatch::color(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    curColor[0] = r;
+    curColor[1] = g;
+    curColor[2] = b;
+    curColor[3] = a;
+}
+
+GLenum GL_VertexBatch::BaseMode(GLenum mode) const
+{
+    switch(mode) {
+        case GL_POINTS:
+            return GL_POINTS;
+        case GL_LINES:
+        case GL_LINE_STRIP:
+        case GL_LINE_LOOP:
+            return strokeStyle? GL_TRIANGLES : GL_LINES;
+        default:
+            return GL_TRIANGLES;
+    }
+}
+
+void GL_VertexBatch::begin(GLenum mode)
+{
+    GLenum base = BaseMode(mode);
+    if(base != batchMode) {
+        flush();
+        batchMode = base;
+    }
+    primMode = mode;
+    primStart = verts.size();
+    primCount = 0;
+    polyline.clear();
+}
+
+void GL_VertexBatch::vertex(float x, float y, float u, float v)
+{
+    Vertex vert;
+    vert.x = x;
+    vert.y = y;
+    vert.u = u;
+    vert.v = v;
+    vert.rgba[0] = curColor[0];
+    vert.rgba[1] = curColor[1];
+    vert.rgba[2] = curColor[2];
+    vert.rgba[3] = curColor[3];
+    
+    switch(primMode) {
+        case GL_LINES:
+            if(strokeStyle) {
+                polyline.push_back(x);
+                polyline.push_back(y);
+                if(primCount%2) {
+                    Stroke(false);
+                    polyline.clear();
+                }
+                break;
+            }
+            // Fall through
+        case GL_POINTS:
+        case GL_TRIANGLES:
+            push(vert);
+            break;
+        case GL_LINE_STRIP:
+        case GL_LINE_LOOP:
+            if(strokeStyle) {
+                polyline.push_back(x);
+                polyline.push_back(y);
+            }
+            else if(primCount == 0) {
+                first = vert;
+            }
+            else {
+                push(prev);
+                push(vert);
+            }
+            break;
+        case GL_TRIANGLE_FAN:
+        case GL_POLYGON:
+            if(primCount == 0) {
+                first = vert;
+            }
+            else if(primCount >= 2) {
+                push(first);
+                push(prev);
+                push(vert);
+            }
+            break;
+        case GL_TRIANGLE_STRIP:
+        case GL_QUAD_STRIP:
+            // A quad strip has the same vertex order as a triangle strip
+            if(primCount >= 2) {
+                push(first);
+                push(prev);
+                push(vert);
+            }
+            first = prev;
+            break;
+        case GL_QUADS:
+            if(primCount%4 == 0) {
+                first = vert;
+            }
+            else if(primCount%4 >= 2) {
+                push(first);
+                push(prev);
+                push(vert);
+            }
+            break;
+    }
+    prev = vert;
+    ++primCount;
+}
+
+void GL_VertexBatch::end()
+{
+    if(strokeStyle && (primMode == GL_LINE_STRIP || primMode == GL_LINE_LOOP)) {
+        Stroke(primMode == GL_LINE_LOOP);
+    }
+    else if(primMode == GL_LINE_LOOP && primCount > 1) {
+        push(prev);
+        push(first);
+    }
+    
+    // As with glBegin()/glEnd(), incomplete primitives are dropped
+    size_t n = verts.size() - primStart;
+    if(batchMode == GL_LINES)
+        verts.resize(primStart + n - n%2);
+    else if(batchMode == GL_TRIANGLES)
+        verts.resize(primStart + n - n%3);
+    
+    ++stats_.primitives;
+    primStart = verts.size();
+    primCount = 0;
+}
+
+// ****************************************************************************
+// Stroking and coverage antialiasing
+// ****************************************************************************
+
+void GL_VertexBatch::push(float x, float y, uint8_t alpha)
+{
+    Vertex v;
+    v.x = x;
+    v.y = y;
+    v.u = solidU;
+    v.v = solidV;
+    v.rgba[0] = curColor[0];
+    v.rgba[1] = curColor[1];
+    v.rgba[2] = curColor[2];
+    v.rgba[3] = alpha;
+    push(v);
+}
+
+void GL_VertexBatch::Stroke(bool closed)
+{
+    if(polyline.empty())
+        return;
+    const std::vector<GL_Stroker::Vertex> & tris = stroker.stroke(*strokeStyle, &polyline[0], polyline.size()/2, closed);
+    for(const GL_Stroker::Vertex & v: tris)
+        push(v.x, v.y, curColor[3]*std::min(v.coverage, 1.0f));
+}
+
+void GL_VertexBatch::fringe(const float * xy, int n, int side)
+{
+    // Drop repeated points, which have no edge direction
+    outline.clear();
+    for(int j = 0; j < n; ++j) {
+        size_t m = outline.size();
+        if(m && outline[m - 2] == xy[2*j] && outline[m - 1] == xy[2*j + 1])
+            continue;
+        outline.push_back(xy[2*j]);
+        outline.push_back(xy[2*j + 1]);
+    }
+    if(outline.size() > 2 && outline[0] == outline[outline.size() - 2] && outline[1] == outline.back())
+        outline.resize(outline.size() - 2);
+    n = outline.size()/2;
+    if(n < 3)
+        return;
+    
+    // Outward is to the right of the edges if they run counterclockwise
+    if(side == 0) {
+        double area = 0;
+        for(int j = 0, k = n - 1; j < n; k = j++)
+            area += (double)outline[2*k]*outline[2*j + 1] - (double)outline[2*j]*outline[2*k + 1];
+        side = (area > 0)? 1 : -1;
+    }
+    
+    // The fringe runs from half coverage on the outline to none half a pixel
+    // out, which keeps pixel aligned edges crisp.
+    const float kWidth = 0.5;
+    uint8_t edgeAlpha = curColor[3]/2;
+    
+    begin(GL_TRIANGLES);
+    for(int j = 0; j < n; ++j) {
+        const float * p0 = &outline[2*((j + n - 1)%n)];
+        const float * p1 = &outline[2*j];
+        const float * p2 = &outline[2*((j + 1)%n)];
+        const float * p3 = &outline[2*((j + 2)%n)];
+    
+        // Offsets at either end of edge p1-p2, along the mitered vertex
+        // normals, limited at sharp corners.
+        float off[2][2];
+        const float * pts[4] = {p0, p1, p2, p3};
+        for(int e = 0; e < 2; ++e) {
+            const float * a = pts[e], * b = pts[e + 1], * c = pts[e + 2];
+            float ax = b[0] - a[0], ay = b[1] - a[1], bx = c[0] - b[0], by = c[1] - b[1];
+            float la = sqrtf(ax*ax + ay*ay), lb = sqrtf(bx*bx + by*by);
+            float nx = side*(ay/la + by/lb), ny = -side*(ax/la + bx/lb);
+            float l2 = std::max(nx*nx + ny*ny, 0.25f);// miter of at most 4 widths
+            off[e][0] = 2*nx/l2*kWidth;
+            off[e][1] = 2*ny/l2*kWidth;
+        }
+        push(p1[0], p1[1], edgeAlpha);
+        push(p2[0], p2[1], edgeAlpha);
+        push(p2[0] + off[1][0], p2[1] + off[1][1], 0);
+        push(p1[0], p1[1], edgeAlpha);
+        push(p2[0] + off[1][0], p2[1] + off[1][1], 0);
+        push(p1[0] + off[0][0], p1[1] + off[0][1], 0);
+    }
+    end();
+}
+
+// ****************************************************************************
+// Packing and drawing
+// ****************************************************************************
+
+// Texture coordinates run 0..1, in steps of 1/kUVOne
+static const float kUVOne = 32767;
+
+// Positions are packed in steps of at most this many pixels
+static const float kMaxStep = 1.0f/16;
+
+// The most fraction bits a packed position has
+static const int kMaxFractionBits = 14;
+
+// Pack verts into the packed array, and lay it out for drawing. False if they
+// don't fit 16 bits, in which case they are drawn as floats.
+bool GL_VertexBatch::PackVertices(Layout & layout)
+{
+    size_t n = verts.size();
+    
+    // Bounds of x, y, u and v
+    float lo[4], hi[4];
+#if defined(__SSE2__)
+    __m128 vmin = _mm_loadu_ps(&verts[0].x), vmax = vmin;
+    for(size_t j = 1; j < n; ++j) {
+        __m128 p = _mm_loadu_ps(&verts[j].x);
+        vmin = _mm_min_ps(vmin, p);
+        vmax = _mm_max_ps(vmax, p);
+    }
+    _mm_storeu_ps(lo, vmin);
+    _mm_storeu_ps(hi, vmax);
+#else
+    std::copy(&verts[0].x, &verts[0].x + 4, lo);
+    std::copy(&verts[0].x, &verts[0].x + 4, hi);
+    for(size_t j = 1; j < n; ++j) {
+        const float * p = &verts[j].x;
+        for(int c = 0; c < 4; ++c) {
+            lo[c] = std::min(lo[c], p[c]);
+            hi[c] = std::max(hi[c], p[c]);
+        }
+    }
+#endif
+
+    bool textured = lo[2] != solidU || hi[2] != solidU || lo[3] != solidV || hi[3] != solidV;
+    if(textured && (lo[2] < 0 || lo[3] < 0 || hi[2] > 1 || hi[3] > 1))
+        return false;
+    
+    // Fixed point about a whole number origin, so that the whole and half
+    // pixel coordinates most drawing uses are exact, with as many fraction
+    // bits as the extent of the batch leaves room for.
+    float ox = roundf((lo[0] + hi[0])/2), oy = roundf((lo[1] + hi[1])/2);
+    float extent = std::max(std::max(hi[0] - ox, ox - lo[0]), std::max(hi[1] - oy, oy - lo[1]));
+    int bits = kMaxFractionBits;
+    while(bits > 0 && extent*(1 << bits) > 32767)
+        --bits;
+    float scale = 1 << bits;
+    if(bits == 0 || pixelScale/scale > kMaxStep)
+        return false;
+    
+    size_t stride = textured? sizeof(PackedVertex) : sizeof(PackedSolidVertex);
+    packed.resize(n*stride);
+    uint8_t * out = &packed[0];
+#if defined(__SSE2__)
+    const __m128 offset = _mm_setr_ps(ox, oy, 0, 0);
+    const __m128 factor = _mm_setr_ps(scale, scale, kUVOne, kUVOne);
+    for(size_t j = 0; j < n; ++j, out += stride) {
+        // x, y, u, v rounded to the nearest 16 bit integers at once
+        __m128 p = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&verts[j].x), offset), factor);
+        __m128i q = _mm_cvtps_epi32(p);
+        q = _mm_packs_epi32(q, q);
+        if(textured) {
+            _mm_storel_epi64((__m128i *)out, q);
+            memcpy(out + offsetof(PackedVertex, rgba), verts[j].rgba, 4);
+        }
+        else {
+            int32_t xy = _mm_cvtsi128_si32(q);
+            memcpy(out, &xy, 4);
+            memcpy(out + offsetof(PackedSolidVertex, rgba), verts[j].rgba, 4);
+        }
+    }
+#else
+    for(size_t j = 0; j < n; ++j, out += stride) {
+        const Vertex & v = verts[j];
+        int16_t q[4] = {
+            (int16_t)lrintf((v.x - ox)*scale), (int16_t)lrintf((v.y - oy)*scale),
+            (int16_t)lrintf(v.u*kUVOne), (int16_t)lrintf(v.v*kUVOne)
+        };
+        if(textured) {
+            memcpy(out, q, 8);
+            memcpy(out + offsetof(PackedVertex, rgba), v.rgba, 4);
+        }
+        else {
+            memcpy(out, q, 4);
+            memcpy(out + offsetof(PackedSolidVertex, rgba), v.rgba, 4);
+        }
+    }
+#endif
+
+    layout.data = &packed[0];
+    layout.type = GL_SHORT;
+    layout.stride = stride;
+    layout.uvOffset = textured? offsetof(PackedVertex, u) : -1;
+    layout.rgbaOffset = textured? offsetof(PackedVertex, rgba) : offsetof(PackedSolidVertex, rgba);
+    layout.origin[0] = ox;
+    layout.origin[1] = oy;
+    layout.unit = 1/scale;
+    layout.uvUnit = textured? 1/kUVOne : 1;// solidUV isn't packed
+    return true;
+}
+
+void GL_VertexBatch::flush()
+{
+    if(verts.empty())
+        return;
+    
+    Layout layout;
+    layout.count = verts.size();
+    layout.solidUV[0] = solidU;
+    layout.solidUV[1] = solidV;
+    if(!packing || !PackVertices(layout)) {
+        layout.data = &verts[0];
+        layout.type = GL_FLOAT;
+        layout.stride = sizeof(Vertex);
+        layout.uvOffset = offsetof(Vertex, u);
+        layout.rgbaOffset = offsetof(Vertex, rgba);
+        layout.origin[0] = layout.origin[1] = 0;
+        layout.unit = 1;
+        layout.uvUnit = 1;
+    }
+    
+    if(pipeline_) {
+        pipeline_->draw(batchMode, layout);
+    }
+    else {
+        const uint8_t * data = (const uint8_t *)layout.data;
+        bool scaled = layout.type != GL_FLOAT;
+        bool textured = layout.uvOffset >= 0;
+        if(scaled) {
+            // The modelview matrix is GL_StateCache's, so put it back after
+            glMatrixMode(GL_MODELVIEW);
+            glPushMatrix();
+            glTranslatef(layout.origin[0], layout.origin[1], 0);
+            glScalef(layout.unit, layout.unit, 1);
+            if(textured) {
+                glMatrixMode(GL_TEXTURE);
+                glPushMatrix();
+                glScalef(layout.uvUnit, layout.uvUnit, 1);
+            }
+        }
+    
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(2, layout.type, layout.stride, data);
+        glColorPointer(4, GL_UNSIGNED_BYTE, layout.stride, data + layout.rgbaOffset);
+        if(textured) {
+            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+            glTexCoordPointer(2, layout.type, layout.stride, data + layout.uvOffset);
+        }
+        else {
+            glTexCoord2f(solidU, solidV);
+        }
+        glDrawArrays(batchMode, 0, layout.count);
+        if(textured)
+            glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+    
+        if(scaled) {
+            if(textured) {
+                glPopMatrix();
+                glMatrixMode(GL_MODELVIEW);
+            }
+            glPopMatrix();
+        }
+    
+        // Current color and texture coordinates are undefined after drawing
+        // with arrays, and immediate mode code (text, pixel transfers) depends
+        // on them.
+        glColor4ubv(curColor);
+        glTexCoord2f(solidU, solidV);
+    }
+    
+    ++stats_.drawCalls;
+    stats_.vertices += verts.size();
+    stats_.bytes += layout.count*layout.stride;
+    verts.clear();
+    primStart = 0;
+}
@@ -0,0 +1,156 @@
+
+#ifndef GL_VERTEXBATCH_H
+#define GL_VERTEXBATCH_H
+
+#include "fltk3gl/gl.h"
+#include "GL_Stroker.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+class GL_CorePipeline;
+
+// Collects primitives into a client-side vertex array so that a run of
+// drawing calls sharing the same GL state is submitted with one glDrawArrays().
+// Vertices are added glBegin()/glEnd() style. Strips, loops, fans, quads and
+// polygons are converted to independent lines or triangles on the way in, so
+// only a change of point/line/triangle class breaks a batch.
+//
+// Every vertex carries texture coordinates. Untextured vertices get the
+// solid_uv() coordinates, which should address an opaque white texel of the
+// bound texture, so untextured shapes and text can share a batch.
+//
+// Lines can be stroked into triangles by a GL_Stroker, for widths, joins,
+// caps and dashes GL lines don't do. For antialiasing without multisampling,
+// stroked lines can fade out at their edges, and polygons be given a fringe
+// fading out beyond their outline. Coverage goes into vertex alpha, so such
+// shapes batch with everything else.
+//
+// Pending vertices are drawn from client arrays, or streamed through a
+// GL_CorePipeline in core profile contexts. They are built as floats, but
+// packed on flushing to 16 bit fixed point positions about an origin and
+// scale chosen per batch, and 16 bit texture coordinates, which batches of
+// untextured vertices leave out. That is 12 or 8 bytes a vertex instead of
+// 20. Batches too large for 16 bits to place vertices within 1/16 pixel are
+// drawn as floats.
+//
+// The batch does not know about GL state. Anything that changes state the
+// pending vertices depend on (clipping, blending, textures, multisampling,
+// line width...) must call flush() first.
+class GL_VertexBatch {
+  public:
+    struct Vertex {
+        float x, y;
+        float u, v;
+        uint8_t rgba[4];
+    };
+    
+    struct PackedVertex {
+        int16_t x, y;
+        int16_t u, v;
+        uint8_t rgba[4];
+    };
+    
+    struct PackedSolidVertex {
+        int16_t x, y;
+        uint8_t rgba[4];
+    };
+    
+    // Vertices as flushed, and how to read them
+    struct Layout {
+        const void * data;
+        size_t count;
+        GLenum type;// of positions and texture coordinates, GL_FLOAT or GL_SHORT
+        GLsizei stride;
+        int uvOffset;// -1 if every vertex has the solid_uv() coordinates
+        int rgbaOffset;
+        float origin[2], unit;// positions are origin + unit*(x, y)
+        float uvUnit;// texture coordinates are uvUnit*(u, v)
+        float solidUV[2];
+    };
+    
+    struct Stats {
+        size_t drawCalls;
+        size_t vertices;
+        size_t primitives;
+        size_t bytes;// of vertex data submitted
+    };
+    
+  private:
+    std::vector<Vertex> verts;
+    GLenum batchMode;// GL_POINTS, GL_LINES or GL_TRIANGLES
+    
+    // Current primitive
+    GLenum primMode;
+    size_t primStart;// index in verts of first vertex of current primitive
+    int primCount;// vertices added to current primitive
+    Vertex first, prev;
+    
+    uint8_t curColor[4];
+    float solidU, solidV;
+    const GL_Stroker::Style * strokeStyle;// null for GL lines
+    GL_Stroker stroker;
+    std::vector<float> polyline;// line being stroked
+    std::vector<float> outline;// scratch for fringe()
+    GL_CorePipeline * pipeline_;// null to draw from client arrays
+    bool packing;
+    float pixelScale;// pixels per unit, at most, under the current transform
+    std::vector<uint8_t> packed;// PackedVertex or PackedSolidVertex
+    Stats stats_;
+    
+    GLenum BaseMode(GLenum mode) const;
+    void push(const Vertex & v) {verts.push_back(v);}
+    void push(float x, float y, uint8_t alpha);
+    void Stroke(bool closed);
+    bool PackVertices(Layout & layout);
+    
+  public:
+    GL_VertexBatch();
+    ~GL_VertexBatch();
+    
+    void color(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255);
+    const uint8_t * color() const {return curColor;}
+    
+    // mode may be any glBegin() mode.
+    void begin(GLenum mode);
+    void vertex(float x, float y) {vertex(x, y, solidU, solidV);}
+    void vertex(float x, float y, float u, float v);
+    void end();
+    
+    // Stroke lines begun after this in style, as triangles. Null for plain GL
+    // lines. The style must outlive its use.
+    void stroke(const GL_Stroker::Style * style) {strokeStyle = style;}
+    const GL_Stroker::Style * stroke() const {return strokeStyle;}
+    
+    // Antialias the closed polygon of n points xy, already drawn in the
+    // current color, with a fringe fading out beyond its outline. The fringe
+    // is left of the edges as they run on screen if side is 1, right of them
+    // if -1, and outside the polygon by its own winding if 0.
+    void fringe(const float * xy, int n, int side = 0);
+    
+    void solid_uv(float u, float v) {solidU = u; solidV = v;}
+    float solid_u() const {return solidU;}
+    float solid_v() const {return solidV;}
+    
+    // Draw through pipeline, whose program and a vertex array of it must be
+    // bound when flushing. Null for the fixed-function pipeline.
+    void pipeline(GL_CorePipeline * pipeline) {pipeline_ = pipeline;}
+    
+    // How many pixels a unit of vertex coordinates may span under the
+    // transform they are drawn with, which sets how finely positions must be
+    // packed. Vertices already added must be flushed first.
+    void pixel_scale(float scale) {pixelScale = scale;}
+    
+    // Pack vertices on flushing (the default), or draw them as floats
+    void pack(bool on) {packing = on;}
+    
+    // Submit pending vertices. Without a pipeline, leaves the current GL color
+    // set to color() and texture coordinates set to solid_uv().
+    void flush();
+    bool empty() const {return verts.empty();}
+    
+    const Stats & stats() const {return stats_;}
+    void reset_stats();
+};
+
+#endif // GL_VERTEXBATCH_H
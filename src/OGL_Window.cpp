@@ -1,10 +1,14 @@
 
 #include "OGL_Window.h"
 #include "pixfmt.h"
-#include "GL_GraphicsDriver.h"
+
+#include <iostream>
 
 OGL_Window::OGL_Window(int wx, int wy, int ww, int wh, const char * label):
-    fltk3::GLWindow(wx, wy, ww, wh, label)
+    fltk3::GLWindow(wx, wy, ww, wh, label),
+    samples_(CustomGL_Samples()),
+    core_(CustomGL_CoreProfile()),
+    stateSave_(GL_GraphicsDriver::SAVE_ALL)
 {
     // We really need multisampling for decent results. Standard mode does not
     // support it.
@@ -13,9 +17,23 @@ OGL_Window::OGL_Window(int wx, int wy, int ww, int wh, const char * label):
     begin();
 }
 
+void OGL_Window::show()
+{
+    // FLTK makes its context on first drawing, so ours has to be in place
+    // by then.
+    bool first = !shown();
+    fltk3::GLWindow::show();
+    if(first && core_ && !CustomGL_CoreContext(this)) {
+        std::cerr << "OGL_Window: no core profile context, using compatibility" << std::endl;
+        core_ = false;
+    }
+}
+
 void OGL_Window::draw()
 {
-    GL_GraphicsDriver glgd(this);
+    GL_GraphicsDriver glgd(this, state_save());
+    if(samples_ <= 1)
+        glgd.antialiasing(GL_GraphicsDriver::COVERAGE_AA);
     redraw();
     fltk3::Window::draw();
 }
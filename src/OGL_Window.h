@@ -4,8 +4,13 @@
 
 #include <fltk3/fltk3.h>
 #include <fltk3gl/GLWindow.h>
+#include "GL_GraphicsDriver.h"
 
 class OGL_Window: public fltk3::GLWindow {
+    int samples_;
+    bool core_;
+    GL_GraphicsDriver::StateSave stateSave_;
+    
   public:
     OGL_Window(int wx, int wy, int ww, int wh, const char * label = nullptr);
     
@@ -16,6 +21,21 @@ class OGL_Window: public fltk3::GLWindow {
         g = 0;
     }
     
+    // Samples per pixel of the visual asked for, see CustomGL_Samples()
+    int samples() const {return samples_;}
+    
+    // Has (or will have, once shown) a core profile context. Set at
+    // construction by CustomGL_CoreProfile(), cleared if show() can't make one.
+    bool core_profile() const {return core_;}
+    
+    // How a driver drawing this window's widgets saves GL state. SAVE_ALL
+    // unless set, as widgets may change any GL state themselves. Windows
+    // whose widgets draw through FLTK only can opt in to SAVE_TOUCHED, or
+    // SAVE_NONE if they don't care what state is left after drawing either.
+    void state_save(GL_GraphicsDriver::StateSave s) {stateSave_ = s;}
+    GL_GraphicsDriver::StateSave state_save() const {return stateSave_;}
+    
+    void show();
     void draw();
     
     void resize(int wx, int wy, int ww, int wh);
@@ -0,0 +1,66 @@
+#include "SW_GlyphCache.h"
+#include "GL_GlyphAtlas.h"
+
+using namespace std;
+
+SW_GlyphCache::SW_GlyphCache():
+    bytes(0)
+{
+}
+
+SW_GlyphCache & SW_GlyphCache::shared()
+{
+    static SW_GlyphCache * cache = new SW_GlyphCache;
+    return *cache;
+}
+
+void SW_GlyphCache::Rasterize(fltk3::Font font, int size, uint32_t c, Glyph & glyph)
+{
+    glyph.w = glyph.h = glyph.left = glyph.top = 0;
+    FT_Face face = GL_GlyphAtlas::shared().face(font, size);
+    if(FT_Load_Char(face, c, FT_LOAD_RENDER))
+        return;// Unrenderable, draw nothing
+    
+    FT_GlyphSlot slot = face->glyph;
+    FT_Bitmap & bmp = slot->bitmap;
+    glyph.w = bmp.width;
+    glyph.h = bmp.rows;
+    glyph.left = slot->bitmap_left;
+    glyph.top = slot->bitmap_top;
+    glyph.alpha.resize(glyph.w*glyph.h);
+    for(int row = 0; row < glyph.h; ++row) {
+        const uint8_t * src = bmp.buffer + row*bmp.pitch;
+        uint8_t * dst = &glyph.alpha[row*glyph.w];
+        if(bmp.pixel_mode == FT_PIXEL_MODE_MONO) {
+            for(int col = 0; col < glyph.w; ++col)
+                dst[col] = (src[col >> 3] & (0x80 >> (col & 7)))? 255 : 0;
+        }
+        else {
+            for(int col = 0; col < glyph.w; ++col)
+                dst[col] = src[col];
+        }
+    }
+    bytes += glyph.alpha.size();
+}
+
+const SW_GlyphCache::Glyph * SW_GlyphCache::glyph(fltk3::Font font, int size, uint32_t c)
+{
+    uint64_t key = Key(font, size, c);
+    auto found = glyphs.find(key);
+    if(found != glyphs.end())
+        return &found->second;
+    
+    if(!GL_GlyphAtlas::shared().has_face(font))
+        return nullptr;
+    Glyph & g = glyphs[key];
+    Rasterize(font, size, c, g);
+    return &g;
+}
+
+void SW_GlyphCache::trim(size_t maxBytes)
+{
+    if(bytes > maxBytes) {
+        glyphs.clear();
+        bytes = 0;
+    }
+}
@@ -0,0 +1,50 @@
+
+#ifndef SW_GLYPHCACHE_H
+#define SW_GLYPHCACHE_H
+
+#include "fltk3/Device.h"
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+// Glyph bitmaps for SW_GraphicsDriver, rasterized by FreeType from the faces
+// of GL_GlyphAtlas, so software and GL text come from the same font files and
+// agree with GL_FontMetrics. Each glyph is kept in memory of its own, so
+// pointers to glyphs stay valid while more are added: a frame's text is
+// rasterized by the tile workers after it has all been drawn.
+//
+// Shared by all software drivers, and only to be used from the thread drawing.
+class SW_GlyphCache {
+  public:
+    struct Glyph {
+        int w, h;// bitmap size in pixels
+        int left, top;// bitmap offset from pen position, y up
+        std::vector<uint8_t> alpha;// w*h coverage, rows top down
+    };
+    
+  private:
+    std::unordered_map<uint64_t, Glyph> glyphs;
+    size_t bytes;
+    
+    static uint64_t Key(fltk3::Font font, int size, uint32_t c) {
+        return ((uint64_t)(font & 0xFFFF) << 48) | ((uint64_t)(size & 0xFFFF) << 32) | c;
+    }
+    
+    void Rasterize(fltk3::Font font, int size, uint32_t c, Glyph & glyph);
+    
+    SW_GlyphCache();
+    
+  public:
+    static SW_GlyphCache & shared();
+    
+    // Look up a glyph, rasterizing it if needed. Returns null if the font has
+    // no FreeType face.
+    const Glyph * glyph(fltk3::Font font, int size, uint32_t c);
+    
+    // Discard all glyphs if they take more than maxBytes. Only between
+    // frames, when nothing drawn refers to them.
+    void trim(size_t maxBytes);
+};
+
+#endif // SW_GLYPHCACHE_H
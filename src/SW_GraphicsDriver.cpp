@@ -0,0 +1,984 @@
+// Notes:
+// Coordinates are those of GL_GraphicsDriver: FLTK's integer coordinates are
+// pixel centers, so a point x, y is at x + 0.5, y + 0.5 in the rasterizer,
+// whose pixels are whole units. Shapes are placed exactly as GL places them,
+// so differences in a DiffWindow are down to rasterization.
+//
+// Everything is antialiased by exact coverage. Lines one pixel wide along
+// rows or columns between pixel centers are whole pixels, as GL lines draw
+// them. Other thin lines and all wide or dashed ones are stroked by
+// GL_Stroker into triangles, filled as one shape.
+//
+// Text comes from the FreeType faces of GL_GlyphAtlas by way of
+// SW_GlyphCache, measured by GL_FontMetrics, so it's laid out as GL lays it
+// out. Fonts without a face aren't drawn.
+//
+// Not done: copy_offscreen(), which only GL_Offscreen supports, and
+// GL_GraphicsDriver::push_clip_path().
+
+#include "SW_GraphicsDriver.h"
+#include "fltk3/draw.h"
+#include "utf8.h"
+#include "imageconv.h"
+
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+// #define LOG(s) cerr << "SW_GraphicsDriver::" << __func__ << s << endl
+#define LOG(s)
+#define LOG_UNIMPLEMENTED(s) cerr << "*SW_GraphicsDriver::" << __func__ << s << endl
+// #define LOG_UNIMPLEMENTED(s)
+
+// Glyph bitmaps kept between frames
+static const size_t kMaxGlyphBytes = 8 << 20;
+
+static const std::vector<int> kNoContours;
+
+SW_GraphicsDriver::SW_GraphicsDriver(fltk3::Rectangle * rect, uint8_t * pixels, int stride):
+    fltk3::GraphicsDriver()
+{
+    viewW = rect->w();
+    viewH = rect->h();
+    raster.target(pixels, viewW, viewH, stride);
+    
+    lineWidth = 1;
+    strokeStyle.antialias = false;// Coverage comes from the rasterizer
+    
+    glyphs = &SW_GlyphCache::shared();
+    glyphs->trim(kMaxGlyphBytes);
+    metrics = nullptr;
+    
+    push_no_clip();
+    
+    install();
+}
+
+SW_GraphicsDriver::~SW_GraphicsDriver()
+{
+    raster.flush();
+    uninstall();
+}
+
+void SW_GraphicsDriver::install() {
+    replacedDriver = fltk3::DisplayDevice::display_device()->driver();
+    fltk3::DisplayDevice::display_device()->driver(this);
+    fltk3::DisplayDevice::display_device()->set_current();
+}
+
+void SW_GraphicsDriver::uninstall() {
+    fltk3::DisplayDevice::display_device()->driver(replacedDriver);
+    fltk3::DisplayDevice::display_device()->set_current();
+}
+
+SW_GraphicsDriver * SW_GraphicsDriver::current() {
+    return dynamic_cast<SW_GraphicsDriver *>(fltk3::SurfaceDevice::surface()->driver());
+}
+
+void SW_GraphicsDriver::color(fltk3::Color c) {
+    GraphicsDriver::color(c);
+    uchar r, g, b;
+    fltk3::get_color(c, r, g, b);
+    raster.color(r, g, b);
+    LOG("(c)");
+}
+void SW_GraphicsDriver::color(uchar r, uchar g, uchar b) {
+    GraphicsDriver::color(fltk3::rgb_color(r, g, b));
+    raster.color(r, g, b);
+    LOG("(r, g, b)");
+}
+
+void SW_GraphicsDriver::font(fltk3::Font face, fltk3::Fontsize size) {
+    GraphicsDriver::font(face, size);
+    metrics = GL_FontMetrics::get(face, size);
+    if(!metrics)
+        replacedDriver->font(face, size);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::line_style(int style, int width, char * dashes)
+{
+    lineWidth = max(1, width);
+    strokeStyle.line_style(style, lineWidth, dashes);
+    LOG("()");
+}
+
+
+// ****************************************************************************
+// Shapes
+// ****************************************************************************
+
+// n points in FLTK coordinates, in the rasterizer's
+const float * SW_GraphicsDriver::WindowPoints(const double * pts, int n)
+{
+    float ox = origin_x() + 0.5f, oy = origin_y() + 0.5f;
+    windowPoints.resize(2*n);
+    for(int j = 0; j < n; ++j) {
+        windowPoints[2*j] = pts[2*j] + ox;
+        windowPoints[2*j + 1] = pts[2*j + 1] + oy;
+    }
+    return windowPoints.data();
+}
+
+// The pixel a point falls in, as a GL point
+void SW_GraphicsDriver::Point(double x, double y)
+{
+    int px = floor(x + origin_x() + 0.5), py = floor(y + origin_y() + 0.5);
+    raster.fill_rect(px, py, px + 1, py + 1);
+}
+
+void SW_GraphicsDriver::Stroke(const double * pts, int n, bool closed)
+{
+    if(n < 2)
+        return;
+    
+    if(lineWidth < 1.5 && strokeStyle.dashes.empty()) {
+        // Level and upright lines between pixel centers are whole pixels,
+        // each segment's but its last, as a GL line draws them.
+        int segments = closed? n : n - 1;
+        bool pixels = true;
+        for(int j = 0; j < segments && pixels; ++j) {
+            int k = (j + 1) % n;
+            pixels = (pts[2*j] == floor(pts[2*j]) && pts[2*j + 1] == floor(pts[2*j + 1]) &&
+                      (pts[2*j] == pts[2*k] || pts[2*j + 1] == pts[2*k + 1]));
+        }
+        if(pixels) {
+            int ox = origin_x(), oy = origin_y();
+            for(int j = 0; j < segments; ++j) {
+                int k = (j + 1) % n;
+                int x0 = pts[2*j] + ox, y0 = pts[2*j + 1] + oy;
+                int x1 = pts[2*k] + ox, y1 = pts[2*k + 1] + oy;
+                if(y0 == y1 && x0 < x1)
+                    raster.fill_rect(x0, y0, x1, y0 + 1);
+                else if(y0 == y1 && x0 > x1)
+                    raster.fill_rect(x1 + 1, y0, x0 + 1, y0 + 1);
+                else if(y0 < y1)
+                    raster.fill_rect(x0, y0, x0 + 1, y1);
+                else if(y0 > y1)
+                    raster.fill_rect(x0, y1 + 1, x0 + 1, y0 + 1);
+            }
+            return;
+        }
+    }
+    
+    const std::vector<GL_Stroker::Vertex> & tris = stroker.stroke(strokeStyle, WindowPoints(pts, n), n, closed);
+    for(size_t j = 0; j + 2 < tris.size(); j += 3)
+        raster.triangle(&tris[j].x, &tris[j + 1].x, &tris[j + 2].x);
+    raster.fill(SW_Rasterizer::NONZERO);
+}
+
+// Fill the n points pts, in contours ending at the indices in contours and n
+void SW_GraphicsDriver::Fill(const double * pts, int n, const std::vector<int> & contours,
+                             SW_Rasterizer::FillRule rule)
+{
+    if(n < 3)
+        return;
+    const float * p = WindowPoints(pts, n);
+    size_t contour = 0;
+    for(int start = 0; start < n;) {
+        int end = (contour < contours.size())? contours[contour++] : n;
+        raster.contour(p + 2*start, end - start);
+        start = end;
+    }
+    raster.fill(rule);
+}
+
+void SW_GraphicsDriver::rect(int x, int y, int w, int h)
+{
+    // Outline as GL_GraphicsDriver::RectVertices() has it
+    w -= 1;
+    h -= 1;
+    if(w < 0) {
+        w = -w;
+        x -= w;
+    }
+    if(h < 0) {
+        h = -h;
+        y -= h;
+    }
+    const double p[] = {(double)x, (double)y, (double)x, (double)y + h,
+                        (double)x + w, (double)y + h, (double)x + w, (double)y};
+    Stroke(p, 4, true);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::rectf(int x, int y, int w, int h)
+{
+    if(w < 0) {
+        w = -w;
+        x -= w;
+    }
+    if(h < 0) {
+        h = -h;
+        y -= h;
+    }
+    x += origin_x();
+    y += origin_y();
+    raster.fill_rect(x, y, x + w, y + h);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::xyline(int x, int y, int x1)
+{
+    x1 += (x1 > x)? 1 : -1;
+    const double p[] = {(double)x, (double)y, (double)x1, (double)y};
+    Stroke(p, 2, false);
+    LOG("(x)");
+}
+
+void SW_GraphicsDriver::xyline(int x, int y, int x1, int y2)
+{
+    y2 += (y2 > y)? 1 : -1;
+    const double p[] = {(double)x, (double)y, (double)x1, (double)y, (double)x1, (double)y2};
+    Stroke(p, 3, false);
+    LOG("(xy)");
+}
+
+void SW_GraphicsDriver::xyline(int x, int y, int x1, int y2, int x3)
+{
+    x3 += (x3 > x1)? 1 : -1;
+    const double p[] = {(double)x, (double)y, (double)x1, (double)y,
+                        (double)x1, (double)y2, (double)x3, (double)y2};
+    Stroke(p, 4, false);
+    LOG("(xyx)");
+}
+
+void SW_GraphicsDriver::yxline(int x, int y, int y1)
+{
+    y1 += (y1 > y)? 1 : -1;
+    const double p[] = {(double)x, (double)y, (double)x, (double)y1};
+    Stroke(p, 2, false);
+    LOG("(y)");
+}
+
+void SW_GraphicsDriver::yxline(int x, int y, int y1, int x2)
+{
+    x2 += (x2 > x)? 1 : -1;
+    const double p[] = {(double)x, (double)y, (double)x, (double)y1, (double)x2, (double)y1};
+    Stroke(p, 3, false);
+    LOG("(yx)");
+}
+
+void SW_GraphicsDriver::yxline(int x, int y, int y1, int x2, int y3)
+{
+    y3 += (y3 > y1)? 1 : -1;
+    const double p[] = {(double)x, (double)y, (double)x, (double)y1,
+                        (double)x2, (double)y1, (double)x2, (double)y3};
+    Stroke(p, 4, false);
+    LOG("(yxy)");
+}
+
+void SW_GraphicsDriver::line(int x, int y, int x1, int y1)
+{
+    // As in GL_GraphicsDriver, thin solid lines go a step further along their
+    // major axis to take in their last pixel
+    double ex = x1, ey = y1;
+    if(lineWidth < 1.5 && strokeStyle.dashes.empty()) {
+        int dx = x1 - x, dy = y1 - y;
+        int major = max(abs(dx), abs(dy));
+        if(major == 0) {
+            ex += 1;
+        }
+        else {
+            ex += (double)dx/major;
+            ey += (double)dy/major;
+        }
+    }
+    const double p[] = {(double)x, (double)y, ex, ey};
+    Stroke(p, 2, false);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::line(int x, int y, int x1, int y1, int x2, int y2)
+{
+    const double p[] = {(double)x, (double)y, (double)x1, (double)y1, (double)x2, (double)y2};
+    Stroke(p, 3, false);
+    LOG("(2)");
+}
+
+void SW_GraphicsDriver::point(int x, int y)
+{
+    Point(x, y);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::loop(int x0, int y0, int x1, int y1, int x2, int y2)
+{
+    const double p[] = {(double)x0, (double)y0, (double)x1, (double)y1, (double)x2, (double)y2};
+    Stroke(p, 3, true);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::loop(int x0, int y0, int x1, int y1, int x2, int y2, int x3, int y3)
+{
+    const double p[] = {(double)x0, (double)y0, (double)x1, (double)y1,
+                        (double)x2, (double)y2, (double)x3, (double)y3};
+    Stroke(p, 4, true);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::polygon(int x0, int y0, int x1, int y1, int x2, int y2)
+{
+    const double p[] = {(double)x0, (double)y0, (double)x1, (double)y1, (double)x2, (double)y2};
+    Fill(p, 3, kNoContours, SW_Rasterizer::NONZERO);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::polygon(int x0, int y0, int x1, int y1, int x2, int y2, int x3, int y3)
+{
+    const double p[] = {(double)x0, (double)y0, (double)x1, (double)y1,
+                        (double)x2, (double)y2, (double)x3, (double)y3};
+    Fill(p, 4, kNoContours, SW_Rasterizer::NONZERO);
+    LOG("()");
+}
+
+// Curves are flattened as GL_GraphicsDriver flattens them, to chords within
+// this many pixels of the true curve.
+static const double kFlatness = 0.2;
+static const int kMaxSegments = 1024;
+
+// Segments needed for an arc of radius r pixels sweeping a radians
+static int ArcSegments(double r, double a)
+{
+    a = fabs(a);
+    if(r <= kFlatness)
+        return 1;
+    double t = 2*acos(1 - kFlatness/r);
+    int n = ceil(a/t);
+    return max(min(n, kMaxSegments), max(1, (int)ceil(a*4/M_PI)));
+}
+
+// Call fn(cos, sin) at n + 1 evenly spaced angles from a0 to a1
+template<typename fn_t>
+static void ArcPoints(double a0, double a1, int n, const fn_t & fn)
+{
+    double c = cos(a0), s = sin(a0);
+    double dc = cos((a1 - a0)/n), ds = sin((a1 - a0)/n);
+    for(int j = 0; j < n; ++j) {
+        fn(c, s);
+        double t = c*dc - s*ds;
+        s = s*dc + c*ds;
+        c = t;
+    }
+    fn(cos(a1), sin(a1));
+}
+
+void SW_GraphicsDriver::circle(double x, double y, double r)
+{
+    // Segments enough for the larger radius once transformed
+    double sx = hypot(transform_dx(1, 0), transform_dy(1, 0));
+    double sy = hypot(transform_dx(0, 1), transform_dy(0, 1));
+    int n = ArcSegments(r*max(sx, sy), 2*M_PI);
+    shapePoints.clear();
+    int j = 0;
+    ArcPoints(0, 2*M_PI, n, [&](double c, double s) {
+        if(j++ < n) {
+            shapePoints.push_back(transform_x(x + c*r, y + s*r));
+            shapePoints.push_back(transform_y(x + c*r, y + s*r));
+        }
+    });
+    Stroke(shapePoints.data(), n, true);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::arc(int x, int y, int w, int h, double a1, double a2)
+{
+    w -= 1; h -= 1;
+    double xr = w/2.0;
+    double yr = h/2.0;
+    double cx = x + xr;
+    double cy = y + yr;
+    double th1 = a1*M_PI/180, th2 = a2*M_PI/180;
+    shapePoints.clear();
+    ArcPoints(th1, th2, ArcSegments(max(xr, yr), th2 - th1), [&](double c, double s) {
+        shapePoints.push_back(cx + c*xr);
+        shapePoints.push_back(cy - s*yr);
+    });
+    Stroke(shapePoints.data(), shapePoints.size()/2, false);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::pie(int x, int y, int w, int h, double a1, double a2)
+{
+    double xr = w/2.0;
+    double yr = h/2.0;
+    // Pixel edges, as GL_GraphicsDriver::pie()
+    double cx = x + xr - 0.5;
+    double cy = y + yr - 0.5;
+    double th1 = a1*M_PI/180, th2 = a2*M_PI/180;
+    shapePoints.clear();
+    // A whole ellipse has no center on its outline
+    if(fabs(a2 - a1) < 360) {
+        shapePoints.push_back(cx);
+        shapePoints.push_back(cy);
+    }
+    ArcPoints(th1, th2, ArcSegments(max(xr, yr), th2 - th1), [&](double c, double s) {
+        shapePoints.push_back(cx + c*xr);
+        shapePoints.push_back(cy - s*yr);
+    });
+    Fill(shapePoints.data(), shapePoints.size()/2, kNoContours, SW_Rasterizer::NONZERO);
+    LOG("()");
+}
+
+
+// ****************************************************************************
+// Paths
+// ****************************************************************************
+
+void SW_GraphicsDriver::begin_points()
+{
+    pathPoints.clear();
+    LOG("()");
+}
+
+void SW_GraphicsDriver::begin_line()
+{
+    pathPoints.clear();
+    LOG("()");
+}
+
+void SW_GraphicsDriver::begin_loop()
+{
+    pathPoints.clear();
+    LOG("()");
+}
+
+void SW_GraphicsDriver::begin_polygon()
+{
+    pathPoints.clear();
+    LOG("()");
+}
+
+void SW_GraphicsDriver::begin_complex_polygon()
+{
+    pathPoints.clear();
+    cpolyContours.clear();
+    LOG("()");
+}
+
+void SW_GraphicsDriver::vertex(double x, double y)
+{
+    transformed_vertex(transform_x(x, y), transform_y(x, y));
+}
+
+void SW_GraphicsDriver::transformed_vertex(double xf, double yf)
+{
+    pathPoints.push_back(xf);
+    pathPoints.push_back(yf);
+}
+
+void SW_GraphicsDriver::curve(double X0, double Y0, double X1, double Y1,
+                              double X2, double Y2, double X3, double Y3)
+{
+    // Flatness is judged by the transformed control points, as in
+    // GL_GraphicsDriver::curve()
+    double x0 = transform_x(X0, Y0), y0 = transform_y(X0, Y0);
+    double x1 = transform_x(X1, Y1), y1 = transform_y(X1, Y1);
+    double x2 = transform_x(X2, Y2), y2 = transform_y(X2, Y2);
+    double x3 = transform_x(X3, Y3), y3 = transform_y(X3, Y3);
+    double L = max(hypot(x0 - 2*x1 + x2, y0 - 2*y1 + y2), hypot(x1 - 2*x2 + x3, y1 - 2*y2 + y3));
+    int n = min(max((int)ceil(sqrt(0.75*L/kFlatness)), 1), kMaxSegments);
+    
+    // Forward differencing in transformed coordinates, which is the same
+    // curve
+    double t = 1.0/n, t2 = t*t, t3 = t2*t;
+    double ax = x3 - 3*x2 + 3*x1 - x0, ay = y3 - 3*y2 + 3*y1 - y0;
+    double bx = 3*(x2 - 2*x1 + x0), by = 3*(y2 - 2*y1 + y0);
+    double cx = 3*(x1 - x0), cy = 3*(y1 - y0);
+    double dx1 = ax*t3 + bx*t2 + cx*t, dy1 = ay*t3 + by*t2 + cy*t;
+    double dx2 = 6*ax*t3 + 2*bx*t2, dy2 = 6*ay*t3 + 2*by*t2;
+    double dx3 = 6*ax*t3, dy3 = 6*ay*t3;
+    double x = x0, y = y0;
+    transformed_vertex(x, y);
+    for(int j = 1; j < n; ++j) {
+        x += dx1; y += dy1;
+        dx1 += dx2; dy1 += dy2;
+        dx2 += dx3; dy2 += dy3;
+        transformed_vertex(x, y);
+    }
+    transformed_vertex(x3, y3);
+}
+
+void SW_GraphicsDriver::arc(double x, double y, double r, double start, double end)
+{
+    double ux = transform_dx(r, 0), uy = transform_dy(r, 0);
+    double vx = transform_dx(0, r), vy = transform_dy(0, r);
+    double scaledR = sqrt(max(ux*ux + uy*uy, vx*vx + vy*vy));
+    double th1 = start*M_PI/180, th2 = end*M_PI/180;
+    ArcPoints(th1, th2, ArcSegments(scaledR, th2 - th1), [&](double c, double s) {
+        vertex(x + c*r, y - s*r);
+    });
+}
+
+void SW_GraphicsDriver::end_points()
+{
+    for(size_t j = 0; j + 1 < pathPoints.size(); j += 2)
+        Point(pathPoints[j], pathPoints[j + 1]);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::end_line()
+{
+    Stroke(pathPoints.data(), pathPoints.size()/2, false);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::end_loop()
+{
+    Stroke(pathPoints.data(), pathPoints.size()/2, true);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::end_polygon()
+{
+    Fill(pathPoints.data(), pathPoints.size()/2, kNoContours, SW_Rasterizer::NONZERO);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::gap()
+{
+    int n = pathPoints.size()/2;
+    if(!cpolyContours.empty() && n == cpolyContours.back())
+        return;// No points since last call, ignore
+    cpolyContours.push_back(n);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::end_complex_polygon()
+{
+    // The odd winding rule, as GL_Tessellator triangulates by
+    Fill(pathPoints.data(), pathPoints.size()/2, cpolyContours, SW_Rasterizer::EVEN_ODD);
+    cpolyContours.clear();
+    LOG("()");
+}
+
+
+// ****************************************************************************
+// Clipping
+// ****************************************************************************
+
+// The current region within the n rectangles rects, in window coordinates,
+// pushed as the new current region. rects may overlap; the region's don't,
+// so that no pixel is drawn twice.
+void SW_GraphicsDriver::PushRegion(const fltk3::Rectangle * rects, int n)
+{
+    // Cut into bands between the rectangles' tops and bottoms, and each band
+    // into the runs of columns some rectangle covers
+    std::vector<int> ys;
+    for(int j = 0; j < n; ++j) {
+        if(rects[j].w() > 0 && rects[j].h() > 0) {
+            ys.push_back(rects[j].y());
+            ys.push_back(rects[j].b());
+        }
+    }
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+    std::vector<fltk3::Rectangle> disjoint;
+    std::vector<std::pair<int, int> > runs;
+    for(size_t band = 0; band + 1 < ys.size(); ++band) {
+        int top = ys[band], bottom = ys[band + 1];
+        runs.clear();
+        for(int j = 0; j < n; ++j) {
+            if(rects[j].w() > 0 && rects[j].y() <= top && rects[j].b() >= bottom)
+                runs.push_back(std::make_pair(rects[j].x(), rects[j].r()));
+        }
+        std::sort(runs.begin(), runs.end());
+        for(size_t j = 0; j < runs.size();) {
+            int left = runs[j].first, right = runs[j].second;
+            for(++j; j < runs.size() && runs[j].first <= right; ++j)
+                right = max(right, runs[j].second);
+            disjoint.push_back(fltk3::Rectangle(left, top, right - left, bottom - top));
+        }
+    }
+    
+    // Within each of the current region's
+    const ClipRegion & top = regionStack.top();
+    ClipRegion region;
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+    for(const fltk3::Rectangle & a: disjoint)
+    for(const fltk3::Rectangle & b: top.rects) {
+        int l = max(a.x(), b.x()), t = max(a.y(), b.y());
+        int r = min(a.r(), b.r()), bottom = min(a.b(), b.b());
+        if(l >= r || t >= bottom)
+            continue;
+        region.rects.push_back(fltk3::Rectangle(l, t, r - l, bottom - t));
+        x0 = min(x0, l);
+        y0 = min(y0, t);
+        x1 = max(x1, r);
+        y1 = max(y1, bottom);
+    }
+    if(region.rects.empty())
+        region.bounds.set(0, 0, 0, 0);
+    else
+        region.bounds.set(x0, y0, x1 - x0, y1 - y0);
+    regionStack.push(region);
+    restore_clip();
+}
+
+void SW_GraphicsDriver::push_clip(int x, int y, int w, int h)
+{
+    fltk3::Rectangle rect(x + origin_x(), y + origin_y(), w, h);
+    PushRegion(&rect, 1);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::push_clip(const fltk3::Rectangle * rects, int n)
+{
+    std::vector<fltk3::Rectangle> window(rects, rects + n);
+    for(fltk3::Rectangle & r: window)
+        r.set(r.x() + origin_x(), r.y() + origin_y(), r.w(), r.h());
+    PushRegion(window.data(), n);
+    LOG("()");
+}
+
+void SW_GraphicsDriver::push_no_clip()
+{
+    ClipRegion region;
+    region.bounds.set(0, 0, viewW, viewH);
+    region.rects.push_back(region.bounds);
+    regionStack.push(region);
+    restore_clip();
+    LOG("()");
+}
+
+void SW_GraphicsDriver::pop_clip()
+{
+    regionStack.pop();
+    // A pop too many leaves no clip
+    if(regionStack.empty())
+        push_no_clip();
+    else
+        restore_clip();
+    LOG("()");
+}
+
+int SW_GraphicsDriver::clip_box(int x, int y, int w, int h, int & X, int & Y, int & W, int & H)
+{
+    LOG("()");
+    // Bounds of the parts of the rectangle in each of the region's
+    int ox = origin_x(), oy = origin_y();
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+    for(const fltk3::Rectangle & r: regionStack.top().rects) {
+        int l = max(x + ox, r.x()), t = max(y + oy, r.y());
+        int right = min(x + ox + w, r.r()), b = min(y + oy + h, r.b());
+        if(l >= right || t >= b)
+            continue;
+        x0 = min(x0, l);
+        y0 = min(y0, t);
+        x1 = max(x1, right);
+        y1 = max(y1, b);
+    }
+    if(x0 < x1) {
+        X = x0 - ox;
+        Y = y0 - oy;
+        W = x1 - x0;
+        H = y1 - y0;
+    }
+    else {
+        X = x;
+        Y = y;
+        W = H = 0;
+    }
+    return x != X || y != Y || w != W || h != H;
+}
+
+int SW_GraphicsDriver::not_clipped(int x, int y, int w, int h)
+{
+    LOG("()");
+    fltk3::Rectangle rect(x + origin_x(), y + origin_y(), w, h);
+    const ClipRegion & top = regionStack.top();
+    if(!top.bounds.intersects(rect))
+        return 0;
+    for(const fltk3::Rectangle & r: top.rects) {
+        if(r.intersects(rect))
+            return 1;
+    }
+    return 0;
+}
+
+void SW_GraphicsDriver::restore_clip() {
+    const ClipRegion & top = regionStack.top();
+    raster.clip(top.rects.data(), top.rects.size());
+    LOG("()");
+}
+
+
+// ****************************************************************************
+// Images
+// ****************************************************************************
+
+// Draw W*H pixels of depth D from buf at X, Y. D and L are draw_image()
+// strides and may be negative.
+void SW_GraphicsDriver::DrawPixels(const uchar * buf, int X, int Y, int W, int H, int D, int L)
+{
+    int depth = abs(D);
+    if(depth < 1 || depth > 4) {
+        cerr << __func__ << "Image depth not supported by SW_GraphicsDriver" << endl;
+        return;
+    }
+    if(W <= 0 || H <= 0)
+        return;
+    
+    int tex;
+    uint8_t * rgba = raster.new_texture(W, H, SW_Rasterizer::RGBA, tex);
+    for(int y = 0; y < H; ++y) {
+        const uchar * src = buf + (ptrdiff_t)y*L;
+        for(int x = 0; x < W; ++x, src += D, rgba += 4) {
+            switch(depth) {
+                case 1: rgba[0] = rgba[1] = rgba[2] = src[0]; rgba[3] = 255; break;
+                case 2: rgba[0] = rgba[1] = rgba[2] = src[0]; rgba[3] = src[1]; break;
+                case 3: rgba[0] = src[0]; rgba[1] = src[1]; rgba[2] = src[2]; rgba[3] = 255; break;
+                case 4: rgba[0] = src[0]; rgba[1] = src[1]; rgba[2] = src[2]; rgba[3] = src[3]; break;
+            }
+        }
+    }
+    
+    X += origin_x();
+    Y += origin_y();
+    const double m[6] = {1, 0, 0, 1, (double)X, (double)Y};
+    raster.texture(tex, m, false, false);
+    raster.fill_rect(X, Y, X + W, Y + H);
+    raster.no_texture();
+}
+
+void SW_GraphicsDriver::draw_image(const uchar * buf, int X, int Y, int W, int H, int D, int L)
+{
+    if(L == 0)
+        L = W*abs(D);
+    DrawPixels(buf, X, Y, W, H, D, L);
+    LOG("(const uchar * buf)");
+}
+void SW_GraphicsDriver::draw_image_mono(const uchar * buf, int X, int Y, int W, int H, int D, int L) {
+    draw_image(buf, X, Y, W, H, D, L);
+    LOG("(const uchar * buf)");
+}
+
+void SW_GraphicsDriver::draw_image(fltk3::DrawImageCb cb, void * data, int X, int Y, int W, int H, int D) {
+    if(W <= 0 || H <= 0)
+        return;
+    std::vector<uchar> line((size_t)W*D*H);
+    for(int y = 0; y < H; ++y)
+        cb(data, 0, y, W, &line[(size_t)W*D*y]);
+    DrawPixels(line.data(), X, Y, W, H, D, W*D);
+    LOG("(fltk3::DrawImageCb cb)");
+}
+void SW_GraphicsDriver::draw_image_mono(fltk3::DrawImageCb cb, void * data, int X, int Y, int W, int H, int D) {
+    draw_image(cb, data, X, Y, W, H, D);
+    LOG("(fltk3::DrawImageCb cb)");
+}
+
+// Restrict the area drawn to the image, as FLTK's own drivers do
+static bool ClipImage(fltk3::Image * img, int & X, int & Y, int & W, int & H, int & cx, int & cy) {
+    if(cx < 0) {
+        W += cx;
+        X -= cx;
+        cx = 0;
+    }
+    if(cy < 0) {
+        H += cy;
+        Y -= cy;
+        cy = 0;
+    }
+    W = min(W, img->w() - cx);
+    H = min(H, img->h() - cy);
+    return W > 0 && H > 0;
+}
+
+static bool DecodePixmap(fltk3::Image * img, uint8_t * rgba) {
+    return imageconv::xpm_to_rgba(img->data(), img->w(), img->h(), rgba);
+}
+static bool DecodeBitmap(fltk3::Image * img, uint8_t * rgba) {
+    imageconv::bits_to_rgba(((fltk3::Bitmap *)img)->array, img->w(), img->h(), rgba);
+    return true;
+}
+
+// In GL_GraphicsDriver.cpp
+void draw_empty(fltk3::Image * img, int X, int Y);
+
+// Draw the W*H area at cx, cy of an image decoded to RGBA by decode(). If
+// tinted it's multiplied by the current color.
+void SW_GraphicsDriver::DrawDecoded(fltk3::Image * img, bool (*decode)(fltk3::Image *, uint8_t *),
+                                    int X, int Y, int W, int H, int cx, int cy, bool tinted)
+{
+    int tex;
+    uint8_t * rgba = raster.new_texture(img->w(), img->h(), SW_Rasterizer::RGBA, tex);
+    if(!decode(img, rgba)) {
+        draw_empty(img, X, Y);
+        return;
+    }
+    X += origin_x();
+    Y += origin_y();
+    const double m[6] = {1, 0, 0, 1, (double)X - cx, (double)Y - cy};
+    raster.texture(tex, m, false, tinted);
+    raster.fill_rect(X, Y, X + W, Y + H);
+    raster.no_texture();
+}
+
+void SW_GraphicsDriver::draw(fltk3::RGBImage * rgb, int X, int Y, int W, int H, int cx, int cy) {
+    if(rgb->d() == 0 || !rgb->data()) {
+        draw_empty(rgb, X, Y);
+        return;
+    }
+    if(!ClipImage(rgb, X, Y, W, H, cx, cy))
+        return;
+    int ld = rgb->ld()? rgb->ld() : rgb->w()*rgb->d();
+    const uint8_t * pixels = (const uint8_t *)rgb->data()[0];
+    draw_image(pixels + cy*ld + cx*rgb->d(), X, Y, W, H, rgb->d(), ld);
+    LOG("(fltk3::RGBImage)");
+}
+void SW_GraphicsDriver::draw(fltk3::Pixmap * pxm, int X, int Y, int W, int H, int cx, int cy) {
+    if(!pxm->data() || pxm->w() <= 0 || pxm->h() <= 0) {
+        draw_empty(pxm, X, Y);
+        return;
+    }
+    if(!ClipImage(pxm, X, Y, W, H, cx, cy))
+        return;
+    DrawDecoded(pxm, DecodePixmap, X, Y, W, H, cx, cy, false);
+    LOG("(fltk3::Pixmap)");
+}
+void SW_GraphicsDriver::draw(fltk3::Bitmap * bm, int X, int Y, int W, int H, int cx, int cy) {
+    if(!bm->array) {
+        draw_empty(bm, X, Y);
+        return;
+    }
+    if(!ClipImage(bm, X, Y, W, H, cx, cy))
+        return;
+    // Set bits are drawn in the current color
+    DrawDecoded(bm, DecodeBitmap, X, Y, W, H, cx, cy, true);
+    LOG("(fltk3::Bitmap)");
+}
+
+void SW_GraphicsDriver::copy_offscreen(int, int, int, int, fltk3::Offscreen, int, int)
+{
+    LOG_UNIMPLEMENTED("()");
+}
+
+
+// ****************************************************************************
+// Text
+// ****************************************************************************
+
+// Glyphs placed as GL_GraphicsDriver::DrawGlyphs() places them: on whole
+// pixels unless rotated, when they're sampled smoothly.
+bool SW_GraphicsDriver::DrawGlyphs(const char * str, int n, double x, double y, int angle, bool rtl)
+{
+    if(!metrics)
+        return false;
+    fltk3::Font face = GraphicsDriver::font();
+    int fsize = size();
+    
+    codepoints.clear();
+    for(const char * p = str, * end = str + n; p < end;)
+        codepoints.push_back(utf8::decode(p, end));
+    if(rtl) {
+        // Glyphs are laid out in reverse, ending at x, and kerned in the
+        // order they're drawn in
+        std::reverse(codepoints.begin(), codepoints.end());
+        double width = 0.0;
+        uint32_t prev = 0;
+        for(uint32_t cp: codepoints) {
+            if(prev)
+                width += metrics->kerning(prev, cp);
+            width += metrics->advance(cp);
+            prev = cp;
+        }
+        x -= width;
+    }
+    
+    double c = 1.0, s = 0.0;
+    if(angle != 0) {
+        c = cos(angle*M_PI/180.0);
+        s = sin(angle*M_PI/180.0);
+    }
+    
+    // Pixel centers are at halves in the rasterizer
+    x += origin_x();
+    y += origin_y();
+    double pen = 0.0;
+    uint32_t prev = 0;
+    for(uint32_t cp: codepoints) {
+        if(prev)
+            pen += metrics->kerning(prev, cp);
+        prev = cp;
+        
+        const SW_GlyphCache::Glyph * g = glyphs->glyph(face, fsize, cp);
+        if(g && g->w > 0) {
+            int tex = raster.add_texture_ref(g->alpha.data(), g->w, g->h, g->w, SW_Rasterizer::ALPHA);
+            // Glyph corners relative to the start of the baseline, on pixel
+            // edges as in GL_GraphicsDriver
+            double x0 = pen + g->left - 0.5, y0 = -g->top - 0.5;
+            if(angle == 0) {
+                int gx = floor(x + pen + 0.5) + g->left, gy = y - g->top;
+                const double m[6] = {1, 0, 0, 1, (double)gx, (double)gy};
+                raster.texture(tex, m, false, true);
+                raster.fill_rect(gx, gy, gx + g->w, gy + g->h);
+            }
+            else {
+                // Texels across the glyph run along the baseline
+                double px = x + 0.5 + x0*c + y0*s, py = y + 0.5 - x0*s + y0*c;
+                const double m[6] = {c, -s, s, c, px, py};
+                raster.texture(tex, m, true, true);
+                const float quad[8] = {
+                    (float)px, (float)py,
+                    (float)(px + g->w*c), (float)(py - g->w*s),
+                    (float)(px + g->w*c + g->h*s), (float)(py - g->w*s + g->h*c),
+                    (float)(px + g->h*s), (float)(py + g->h*c)
+                };
+                raster.contour(quad, 4);
+                raster.fill(SW_Rasterizer::NONZERO);
+            }
+            raster.no_texture();
+        }
+        pen += metrics->advance(cp);
+    }
+    return true;
+}
+
+void SW_GraphicsDriver::draw(const char * str, int n, int x, int y) {
+    if(!DrawGlyphs(str, n, x, y, 0, false))
+        LOG_UNIMPLEMENTED("(no FreeType face)");
+    LOG("()");
+}
+void SW_GraphicsDriver::draw(int angle, const char * str, int n, int x, int y) {
+    if(!DrawGlyphs(str, n, x, y, angle, false))
+        LOG_UNIMPLEMENTED("(no FreeType face)");
+    LOG("(angle)");
+}
+void SW_GraphicsDriver::rtl_draw(const char * str, int n, int x, int y) {
+    if(!DrawGlyphs(str, n, x, y, 0, true))
+        LOG_UNIMPLEMENTED("(no FreeType face)");
+    LOG("()");
+}
+
+double SW_GraphicsDriver::width(const char * str, int n) {
+    LOG("()");
+    return metrics? metrics->width(str, n) : replacedDriver->width(str, n);
+}
+void SW_GraphicsDriver::text_extents(const char * str, int n, int & dx, int & dy, int & w, int & h) {
+    dx = 0;
+    dy = descent();
+    w = width(str, n);
+    h = height();
+    LOG("()");
+}
+int SW_GraphicsDriver::height() {
+    LOG("()");
+    return metrics? metrics->height() : replacedDriver->height();
+}
+int SW_GraphicsDriver::descent() {
+    LOG("()");
+    return metrics? metrics->descent() : replacedDriver->descent();
+}
+
+
+// ****************************************************************************
+// Misc
+// ****************************************************************************
+
+char SW_GraphicsDriver::can_do_alpha_blending() {
+    LOG("()");
+    return 1;
+}
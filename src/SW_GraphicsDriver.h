@@ -0,0 +1,156 @@
+
+#ifndef SW_GRAPHICSDRIVER_H
+#define SW_GRAPHICSDRIVER_H
+
+#include "fltk3/Device.h"
+#include "SW_Rasterizer.h"
+#include "SW_GlyphCache.h"
+#include "GL_FontMetrics.h"
+#include "GL_Stroker.h"
+#include <vector>
+#include <stack>
+
+// A driver drawing on the CPU into RGBA pixels in memory, rows top down, for
+// comparing with GL_GraphicsDriver and for drawing without GL. It draws what
+// GL_GraphicsDriver does in the same coordinates, from the same fonts and
+// with the same strokes, antialiased as in its COVERAGE_AA mode.
+//
+// Drawing only records shapes. They are rasterized in tiles on the shared
+// WorkerPool by flush() and the destructor, so the pixels are only complete
+// after those. Like GL_GraphicsDriver it's installed for its lifetime:
+//
+//     {
+//         SW_GraphicsDriver swgd(&rect, pixels);
+//         window->draw();
+//     }
+//     fltk3::draw_image(pixels, 0, 0, rect.w(), rect.h(), 4);
+class SW_GraphicsDriver: public fltk3::GraphicsDriver {
+  private:
+    fltk3::GraphicsDriver * replacedDriver;
+    int viewW, viewH;
+    double lineWidth;
+    GL_Stroker::Style strokeStyle;
+    GL_Stroker stroker;
+    
+    // Paths from vertex() are kept transformed by FLTK's matrix, as FLTK's
+    // own drivers do, but not rounded.
+    std::vector<double> pathPoints;
+    std::vector<int> cpolyContours;
+    std::vector<double> shapePoints;// circle() and arc() outlines
+    std::vector<float> windowPoints;// see WindowPoints()
+    
+    // A clip region in window coordinates, as rects that don't overlap
+    struct ClipRegion {
+        std::vector<fltk3::Rectangle> rects;
+        fltk3::Rectangle bounds;
+    };
+    std::stack<ClipRegion> regionStack;
+    
+    SW_Rasterizer raster;
+    SW_GlyphCache * glyphs;
+    GL_FontMetrics * metrics;// null if current font has no FreeType face
+    std::vector<uint32_t> codepoints;
+    
+  protected:
+    const float * WindowPoints(const double * pts, int n);
+    void Point(double x, double y);
+    void Stroke(const double * pts, int n, bool closed);
+    void Fill(const double * pts, int n, const std::vector<int> & contours, SW_Rasterizer::FillRule rule);
+    void PushRegion(const fltk3::Rectangle * rects, int n);
+    void DrawPixels(const uchar * buf, int X, int Y, int W, int H, int D, int L);
+    void DrawDecoded(fltk3::Image * img, bool (*decode)(fltk3::Image *, uint8_t *),
+                     int X, int Y, int W, int H, int cx, int cy, bool tinted);
+    bool DrawGlyphs(const char * str, int n, double x, double y, int angle, bool rtl);
+    
+    void install();
+    void uninstall();
+    
+  public:
+    // Draw into rect->w()*rect->h() RGBA pixels, stride bytes a row, over
+    // what they hold
+    SW_GraphicsDriver(fltk3::Rectangle * rect, uint8_t * pixels, int stride = 0);
+    virtual ~SW_GraphicsDriver();
+    
+    virtual void line_style(int style, int width=0, char * dashes=0);
+    virtual void color(fltk3::Color c);
+    virtual void color(uchar r, uchar g, uchar b);
+    
+    virtual void rect(int x, int y, int w, int h);
+    virtual void rectf(int x, int y, int w, int h);
+    virtual void xyline(int x, int y, int x1);
+    virtual void xyline(int x, int y, int x1, int y2);
+    virtual void xyline(int x, int y, int x1, int y2, int x3);
+    virtual void yxline(int x, int y, int y1);
+    virtual void yxline(int x, int y, int y1, int x2);
+    virtual void yxline(int x, int y, int y1, int x2, int y3);
+    virtual void line(int x, int y, int x1, int y1);
+    virtual void line(int x, int y, int x1, int y1, int x2, int y2);
+    virtual void draw(const char * str, int n, int x, int y);
+    virtual void draw(int angle, const char * str, int n, int x, int y);
+    virtual void rtl_draw(const char * str, int n, int x, int y);
+    virtual void point(int x, int y);
+    virtual void loop(int x0, int y0, int x1, int y1, int x2, int y2);
+    virtual void loop(int x0, int y0, int x1, int y1, int x2, int y2, int x3, int y3);
+    virtual void polygon(int x0, int y0, int x1, int y1, int x2, int y2);
+    virtual void polygon(int x0, int y0, int x1, int y1, int x2, int y2, int x3, int y3);
+    virtual void arc(int x, int y, int w, int h, double a1, double a2);
+    virtual void pie(int x, int y, int w, int h, double a1, double a2);
+    virtual void begin_points();
+    virtual void begin_line();
+    virtual void begin_loop();
+    virtual void begin_polygon();
+    virtual void vertex(double x, double y);
+    virtual void transformed_vertex(double xf, double yf);
+    virtual void curve(double X0, double Y0, double X1, double Y1, double X2, double Y2, double X3, double Y3);
+    virtual void circle(double x, double y, double r);
+    virtual void arc(double x, double y, double r, double start, double end);
+    virtual void end_points();
+    virtual void end_line();
+    virtual void end_loop();
+    virtual void end_polygon();
+    virtual void begin_complex_polygon();
+    virtual void gap();
+    virtual void end_complex_polygon();
+    
+    virtual void push_clip(int x, int y, int w, int h);
+    virtual int clip_box(int x, int y, int w, int h, int & X, int & Y, int & W, int & H);
+    virtual int not_clipped(int x, int y, int w, int h);
+    virtual void push_no_clip();
+    virtual void pop_clip();
+    virtual void restore_clip();
+    // Clip to the union of n rectangles within the current clip, until
+    // pop_clip(), as GL_GraphicsDriver::push_clip(rects, n)
+    void push_clip(const fltk3::Rectangle * rects, int n);
+    
+    // Images
+    virtual void draw_image(const uchar * buf, int X, int Y, int W, int H, int D=3, int L=0);
+    virtual void draw_image_mono(const uchar * buf, int X, int Y, int W, int H, int D=1, int L=0);
+    virtual void draw_image(fltk3::DrawImageCb cb, void * data, int X, int Y, int W, int H, int D=3);
+    virtual void draw_image_mono(fltk3::DrawImageCb cb, void * data, int X, int Y, int W, int H, int D=1);
+    
+    virtual void draw(fltk3::RGBImage * rgb, int XP, int YP, int WP, int HP, int cx, int cy);
+    virtual void draw(fltk3::Pixmap * pxm, int XP, int YP, int WP, int HP, int cx, int cy);
+    virtual void draw(fltk3::Bitmap * bm, int XP, int YP, int WP, int HP, int cx, int cy);
+    
+    virtual void font(fltk3::Font face, fltk3::Fontsize size);
+    
+    virtual double width(const char * str, int n);
+    virtual void text_extents(const char * str, int n, int & dx, int & dy, int & w, int & h);
+    virtual int height();
+    virtual int descent();
+    
+    virtual void copy_offscreen(int x, int y, int w, int h, fltk3::Offscreen pixmap, int srcx, int srcy);
+    virtual char can_do_alpha_blending();
+    
+    // The installed driver, if it is an SW_GraphicsDriver
+    static SW_GraphicsDriver * current();
+    
+    // Rasterize with workers other than WorkerPool::shared()
+    void workers(WorkerPool * pool) {raster.workers(pool);}
+    
+    // Rasterize everything drawn so far into the pixels now
+    void flush() {raster.flush();}
+    const SW_Rasterizer::Stats & stats() const {return raster.stats();}
+};
+
+#endif // SW_GRAPHICSDRIVER_H
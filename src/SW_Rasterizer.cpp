@@ -0,0 +1,560 @@
+#include "SW_Rasterizer.h"
+#include "WorkerPool.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Floats per row of a tile's coverage accumulation: a tile's width, the two
+// cells right of it that edges on its right side write, rounded up to whole
+// SSE vectors.
+static const int kAccStride = SW_Rasterizer::kTileSize + 4;
+
+static inline uint32_t Mul255(uint32_t a, uint32_t b)
+{
+    uint32_t t = a*b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+SW_Rasterizer::SW_Rasterizer():
+    pixels(nullptr),
+    width(0),
+    height(0),
+    stride(0),
+    tilesX(0),
+    tilesY(0),
+    pathBegin(0),
+    pool(nullptr)
+{
+    color(0, 0, 0);
+    paint.texture = -1;
+    paint.smooth = paint.tinted = false;
+    pathBounds[0] = pathBounds[1] = INFINITY;
+    pathBounds[2] = pathBounds[3] = -INFINITY;
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+void SW_Rasterizer::target(uint8_t * pix, int w, int h, int rowBytes)
+{
+    pixels = pix;
+    width = w;
+    height = h;
+    stride = rowBytes? rowBytes : 4*w;
+    tilesX = (w + kTileSize - 1)/kTileSize;
+    tilesY = (h + kTileSize - 1)/kTileSize;
+    
+    // Bins keep their memory from frame to frame
+    tiles.resize(tilesX*tilesY);
+    for(std::vector<Entry> & bin: tiles)
+        bin.clear();
+    commands.clear();
+    edges.clear();
+    textures.clear();
+    arena.clear();
+    pathBegin = 0;
+    clipRects.assign(1, fltk3::Rectangle(0, 0, w, h));
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+void SW_Rasterizer::clip(const fltk3::Rectangle * rects, int n)
+{
+    clipRects.clear();
+    for(int j = 0; j < n; ++j) {
+        int x0 = max(rects[j].x(), 0), y0 = max(rects[j].y(), 0);
+        int x1 = min(rects[j].r(), width), y1 = min(rects[j].b(), height);
+        if(x0 < x1 && y0 < y1)
+            clipRects.push_back(fltk3::Rectangle(x0, y0, x1 - x0, y1 - y0));
+    }
+}
+
+void SW_Rasterizer::color(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    paint.color[0] = r;
+    paint.color[1] = g;
+    paint.color[2] = b;
+    paint.color[3] = a;
+}
+
+void SW_Rasterizer::texture(int tex, const double m[6], bool smooth, bool tinted)
+{
+    // Kept the other way round, pixels to texels, for sampling
+    double det = m[0]*m[3] - m[1]*m[2];
+    if(det == 0)
+        det = 1;// Degenerate, covers nothing anyway
+    paint.m[0] = m[3]/det;
+    paint.m[1] = -m[1]/det;
+    paint.m[2] = -m[2]/det;
+    paint.m[3] = m[0]/det;
+    paint.m[4] = (m[2]*m[5] - m[3]*m[4])/det;
+    paint.m[5] = (m[1]*m[4] - m[0]*m[5])/det;
+    paint.texture = tex;
+    paint.smooth = smooth;
+    paint.tinted = tinted;
+}
+
+int SW_Rasterizer::add_texture(const uint8_t * src, int w, int h, int rowBytes, Format format)
+{
+    int tex;
+    uint8_t * dst = new_texture(w, h, format, tex);
+    size_t row = (format == RGBA)? 4*w : w;
+    for(int y = 0; y < h; ++y)
+        memcpy(dst + y*row, src + y*rowBytes, row);
+    return tex;
+}
+
+uint8_t * SW_Rasterizer::new_texture(int w, int h, Format format, int & tex)
+{
+    Texture t;
+    t.ref = nullptr;
+    t.offset = arena.size();
+    t.w = w;
+    t.h = h;
+    t.stride = (format == RGBA)? 4*w : w;
+    t.format = format;
+    arena.resize(arena.size() + (size_t)t.stride*h);
+    tex = textures.size();
+    textures.push_back(t);
+    return &arena[t.offset];
+}
+
+int SW_Rasterizer::add_texture_ref(const uint8_t * src, int w, int h, int rowBytes, Format format)
+{
+    Texture t;
+    t.ref = src;
+    t.offset = 0;
+    t.w = w;
+    t.h = h;
+    t.stride = rowBytes;
+    t.format = format;
+    textures.push_back(t);
+    return textures.size() - 1;
+}
+
+
+// ****************************************************************************
+// Recording
+// ****************************************************************************
+
+void SW_Rasterizer::contour(const float * xy, int n)
+{
+    for(int j = 0; j < n; ++j) {
+        int k = (j + 1 < n)? j + 1 : 0;
+        // Level edges cover no area
+        if(xy[2*j + 1] == xy[2*k + 1])
+            continue;
+        Edge e = {xy[2*j], xy[2*j + 1], xy[2*k], xy[2*k + 1]};
+        edges.push_back(e);
+        pathBounds[0] = min(pathBounds[0], min(e.x0, e.x1));
+        pathBounds[1] = min(pathBounds[1], min(e.y0, e.y1));
+        pathBounds[2] = max(pathBounds[2], max(e.x0, e.x1));
+        pathBounds[3] = max(pathBounds[3], max(e.y0, e.y1));
+    }
+}
+
+void SW_Rasterizer::triangle(const float * a, const float * b, const float * c)
+{
+    float area = (b[0] - a[0])*(c[1] - a[1]) - (b[1] - a[1])*(c[0] - a[0]);
+    if(area == 0)
+        return;
+    // All one way round, so overlaps add up rather than cancel
+    const float xy[6] = {a[0], a[1], b[0], b[1], c[0], c[1]};
+    const float yx[6] = {a[0], a[1], c[0], c[1], b[0], b[1]};
+    contour((area > 0)? xy : yx, 3);
+}
+
+void SW_Rasterizer::fill(FillRule rule)
+{
+    if(edges.size() > pathBegin) {
+        Command cmd;
+        cmd.x0 = floor(pathBounds[0]);
+        cmd.y0 = floor(pathBounds[1]);
+        cmd.x1 = ceil(pathBounds[2]);
+        cmd.y1 = ceil(pathBounds[3]);
+        cmd.edgeBegin = pathBegin;
+        cmd.edgeEnd = edges.size();
+        cmd.rule = rule;
+        cmd.paint = paint;
+        Record(cmd);
+        stats_.edges += cmd.edgeEnd - cmd.edgeBegin;
+    }
+    pathBegin = edges.size();
+    pathBounds[0] = pathBounds[1] = INFINITY;
+    pathBounds[2] = pathBounds[3] = -INFINITY;
+}
+
+void SW_Rasterizer::fill_rect(int x0, int y0, int x1, int y1)
+{
+    Command cmd;
+    cmd.x0 = x0;
+    cmd.y0 = y0;
+    cmd.x1 = x1;
+    cmd.y1 = y1;
+    cmd.edgeBegin = cmd.edgeEnd = 0;
+    cmd.rule = NONZERO;
+    cmd.paint = paint;
+    Record(cmd);
+}
+
+// Bin cmd into the tiles it touches within each clip rectangle
+void SW_Rasterizer::Record(Command & cmd)
+{
+    cmd.x0 = max(cmd.x0, 0);
+    cmd.y0 = max(cmd.y0, 0);
+    cmd.x1 = min(cmd.x1, width);
+    cmd.y1 = min(cmd.y1, height);
+    if(cmd.x0 >= cmd.x1 || cmd.y0 >= cmd.y1)
+        return;
+    
+    Entry e;
+    e.command = commands.size();
+    bool drawn = false;
+    for(const fltk3::Rectangle & r: clipRects) {
+        int x0 = max(cmd.x0, r.x()), y0 = max(cmd.y0, r.y());
+        int x1 = min(cmd.x1, r.r()), y1 = min(cmd.y1, r.b());
+        if(x0 >= x1 || y0 >= y1)
+            continue;
+        for(int ty = y0/kTileSize; ty <= (y1 - 1)/kTileSize; ++ty)
+        for(int tx = x0/kTileSize; tx <= (x1 - 1)/kTileSize; ++tx) {
+            e.x0 = max(x0, tx*kTileSize);
+            e.y0 = max(y0, ty*kTileSize);
+            e.x1 = min(x1, (tx + 1)*kTileSize);
+            e.y1 = min(y1, (ty + 1)*kTileSize);
+            tiles[ty*tilesX + tx].push_back(e);
+            ++stats_.entries;
+        }
+        drawn = true;
+    }
+    if(drawn) {
+        commands.push_back(cmd);
+        ++stats_.commands;
+    }
+}
+
+
+// ****************************************************************************
+// Rasterizing
+// ****************************************************************************
+
+// Add the area a line covers to the right of it, in a w*h block of cells
+// acc, signed by direction. x must be within 0..w.
+static void Line(float * acc, int w, int h, float x0, float y0, float x1, float y1)
+{
+    if(y0 == y1)
+        return;
+    float dir = 1;
+    if(y0 > y1) {
+        dir = -1;
+        swap(x0, x1);
+        swap(y0, y1);
+    }
+    float dxdy = (x1 - x0)/(y1 - y0);
+    float x = x0;
+    if(y0 < 0) {
+        x -= y0*dxdy;
+        y0 = 0;
+    }
+    y1 = min(y1, (float)h);
+    
+    for(int y = y0, yEnd = ceil(y1); y < yEnd; ++y) {
+        float * row = acc + y*kAccStride;
+        float dy = min(y + 1.0f, y1) - max((float)y, y0);
+        // Clamped, as rounding may step slightly outside
+        float xNext = min(max(x + dxdy*dy, 0.0f), (float)w);
+        float d = dy*dir;
+        float xa = min(x, xNext), xb = max(x, xNext);
+        float xaFloor = floor(xa), xbCeil = ceil(xb);
+        int xai = xaFloor, xbi = xbCeil;
+        if(xbi <= xai + 1) {
+            // Within one cell: the part left of the line's middle is covered
+            float xMid = 0.5f*(x + xNext) - xaFloor;
+            row[xai] += d - d*xMid;
+            row[xai + 1] += d*xMid;
+        }
+        else {
+            // Across cells: a triangle in the first, trapezoids in between
+            // and the rest in the last
+            float s = 1/(xb - xa);
+            float xaFrac = xa - xaFloor;
+            float a0 = 0.5f*s*(1 - xaFrac)*(1 - xaFrac);
+            float xbFrac = xb - xbCeil + 1;
+            float am = 0.5f*s*xbFrac*xbFrac;
+            row[xai] += d*a0;
+            if(xbi == xai + 2) {
+                row[xai + 1] += d*(1 - a0 - am);
+            }
+            else {
+                float a1 = s*(1.5f - xaFrac);
+                row[xai + 1] += d*(a1 - a0);
+                for(int xi = xai + 2; xi < xbi - 1; ++xi)
+                    row[xi] += d*s;
+                float a2 = a1 + (xbi - xai - 3)*s;
+                row[xbi - 1] += d*(1 - a2 - am);
+            }
+            row[xbi] += d*am;
+        }
+        x = xNext;
+    }
+}
+
+// Accumulate the edges of path cmd within the part of a tile e
+void SW_Rasterizer::Accumulate(const Command & cmd, const Entry & e, float * acc) const
+{
+    float ox = e.x0, oy = e.y0;
+    int w = e.x1 - e.x0, h = e.y1 - e.y0;
+    for(uint32_t j = cmd.edgeBegin; j < cmd.edgeEnd; ++j) {
+        const Edge & edge = edges[j];
+        float x0 = edge.x0 - ox, y0 = edge.y0 - oy;
+        float x1 = edge.x1 - ox, y1 = edge.y1 - oy;
+        if(max(y0, y1) <= 0 || min(y0, y1) >= h || min(x0, x1) >= w)
+            continue;
+        
+        // Split where the edge crosses the sides. Parts left of the block
+        // cover all of its row, and become vertical lines down its left
+        // side; parts right of it, down the right side, cover none of it.
+        float ts[4] = {0, 1, 1, 1};
+        int n = 1;
+        if((x0 < 0) != (x1 < 0))
+            ts[n++] = -x0/(x1 - x0);
+        if((x0 < w) != (x1 < w))
+            ts[n++] = (w - x0)/(x1 - x0);
+        if(n == 3 && ts[1] > ts[2])
+            swap(ts[1], ts[2]);
+        ts[n] = 1;
+        float px = x0, py = y0;
+        for(int k = 1; k <= n; ++k) {
+            float qx = (k == n)? x1 : x0 + ts[k]*(x1 - x0);
+            float qy = (k == n)? y1 : y0 + ts[k]*(y1 - y0);
+            Line(acc, w, h, min(max(px, 0.0f), (float)w), py, min(max(qx, 0.0f), (float)w), qy);
+            px = qx;
+            py = qy;
+        }
+    }
+}
+
+// Sum n accumulated cells into coverage by rule
+static void Coverage(const float * acc, int n, SW_Rasterizer::FillRule rule, uint8_t * coverage)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    if(rule == SW_Rasterizer::NONZERO) {
+        // Prefix sums four cells at a time, carrying the last along
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        const __m128 one = _mm_set1_ps(1), scale = _mm_set1_ps(255);
+        __m128 carry = _mm_setzero_ps();
+        for(; i < n; i += 4) {
+            __m128 x = _mm_loadu_ps(acc + i);
+            x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+            x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+            x = _mm_add_ps(x, carry);
+            __m128i c = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_and_ps(x, absMask), one), scale));
+            c = _mm_packs_epi32(c, c);
+            c = _mm_packus_epi16(c, c);
+            int32_t c4 = _mm_cvtsi128_si32(c);
+            memcpy(coverage + i, &c4, 4);
+            carry = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+        return;
+    }
+#endif
+    float sum = 0;
+    for(; i < n; ++i) {
+        sum += acc[i];
+        float c = fabs(sum);
+        if(rule == SW_Rasterizer::EVEN_ODD) {
+            c = fmod(c, 2.0f);
+            if(c > 1)
+                c = 2 - c;
+        }
+        coverage[i] = min(c, 1.0f)*255 + 0.5f;
+    }
+}
+
+// dst = src*alpha + dst*(1 - alpha) for n pixels, src stepping if srcStep
+static void Blend(uint32_t * dst, const uint32_t * src, int srcStep, const uint8_t * alpha, int n)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255), half = _mm_set1_epi16(128);
+    // Exact division by 255 of products, 16 bits a channel
+    auto mix = [&](__m128i s, __m128i d, __m128i a) {
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(full, a)));
+        t = _mm_add_epi16(t, half);
+        return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    };
+    for(; i + 4 <= n; i += 4) {
+        int32_t a4;
+        memcpy(&a4, alpha + i, 4);
+        if(a4 == 0)
+            continue;
+        __m128i s = srcStep? _mm_loadu_si128((const __m128i *)(src + i)) : _mm_set1_epi32(src[0]);
+        if(a4 == -1) {
+            _mm_storeu_si128((__m128i *)(dst + i), s);
+            continue;
+        }
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(a4), zero);
+        a = _mm_unpacklo_epi16(a, a);
+        __m128i lo = mix(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(a, a));
+        __m128i hi = mix(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(a, a));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for(; i < n; ++i) {
+        uint32_t a = alpha[i];
+        if(a == 0)
+            continue;
+        uint32_t s = src[i*srcStep];
+        if(a == 255) {
+            dst[i] = s;
+            continue;
+        }
+        const uint8_t * sc = (const uint8_t *)&s;
+        uint8_t * dc = (uint8_t *)(dst + i);
+        for(int c = 0; c < 4; ++c)
+            dc[c] = Mul255(sc[c], a) + Mul255(dc[c], 255 - a);
+    }
+}
+
+// Texels of paint p for n pixels from x, y, RGBA with alpha
+void SW_Rasterizer::Sample(const Paint & p, int x, int y, int n, uint32_t * colors) const
+{
+    const Texture & t = textures[p.texture];
+    const uint8_t * texels = Texels(t);
+    bool alphaOnly = (t.format == ALPHA);
+    auto texel = [&](int u, int v, uint32_t c[4]) {
+        if(u < 0 || v < 0 || u >= t.w || v >= t.h) {
+            c[0] = c[1] = c[2] = c[3] = 0;
+        }
+        else if(alphaOnly) {
+            c[0] = c[1] = c[2] = 255;
+            c[3] = texels[v*t.stride + u];
+        }
+        else {
+            const uint8_t * q = texels + v*t.stride + 4*u;
+            c[0] = q[0];
+            c[1] = q[1];
+            c[2] = q[2];
+            c[3] = q[3];
+        }
+    };
+    
+    // Pixel centers
+    float cx = x + 0.5f, cy = y + 0.5f;
+    float u = p.m[0]*cx + p.m[2]*cy + p.m[4];
+    float v = p.m[1]*cx + p.m[3]*cy + p.m[5];
+    bool tint = p.tinted || alphaOnly;
+    for(int i = 0; i < n; ++i, u += p.m[0], v += p.m[1]) {
+        uint32_t c[4];
+        if(p.smooth) {
+            float su = u - 0.5f, sv = v - 0.5f;
+            float u0 = floor(su), v0 = floor(sv);
+            float fu = su - u0, fv = sv - v0;
+            uint32_t c00[4], c10[4], c01[4], c11[4];
+            texel(u0, v0, c00);
+            texel(u0 + 1, v0, c10);
+            texel(u0, v0 + 1, c01);
+            texel(u0 + 1, v0 + 1, c11);
+            for(int k = 0; k < 4; ++k) {
+                float top = c00[k] + fu*((float)c10[k] - c00[k]);
+                float bottom = c01[k] + fu*((float)c11[k] - c01[k]);
+                c[k] = top + fv*(bottom - top) + 0.5f;
+            }
+        }
+        else {
+            texel(floor(u), floor(v), c);
+        }
+        uint8_t * out = (uint8_t *)(colors + i);
+        for(int k = 0; k < 4; ++k)
+            out[k] = tint? Mul255(c[k], p.color[k]) : c[k];
+    }
+}
+
+// Draw n pixels of row y from x, covered as coverage
+void SW_Rasterizer::Span(const Command & cmd, int x, int y, int n, const uint8_t * coverage, uint32_t * colors) const
+{
+    uint32_t * dst = (uint32_t *)(pixels + (size_t)y*stride) + x;
+    const Paint & p = cmd.paint;
+    uint8_t alpha[kTileSize + 4];
+    if(p.texture < 0) {
+        // Source alpha goes into the blend; the pixel's own is blended
+        // towards opaque.
+        const uint8_t rgba[4] = {p.color[0], p.color[1], p.color[2], 255};
+        uint32_t src;
+        memcpy(&src, rgba, 4);
+        if(p.color[3] != 255) {
+            for(int i = 0; i < n; ++i)
+                alpha[i] = Mul255(coverage[i], p.color[3]);
+            coverage = alpha;
+        }
+        Blend(dst, &src, 0, coverage, n);
+        return;
+    }
+    
+    Sample(p, x, y, n, colors);
+    for(int i = 0; i < n; ++i) {
+        uint8_t * c = (uint8_t *)(colors + i);
+        alpha[i] = Mul255(c[3], coverage[i]);
+        c[3] = 255;
+    }
+    Blend(dst, colors, 1, alpha, n);
+}
+
+void SW_Rasterizer::DrawTile(int tile, float * acc, uint8_t * coverage, uint32_t * colors) const
+{
+    uint8_t full[kTileSize];
+    memset(full, 255, kTileSize);
+    for(const Entry & e: tiles[tile]) {
+        const Command & cmd = commands[e.command];
+        int w = e.x1 - e.x0;
+        if(cmd.edgeBegin == cmd.edgeEnd) {
+            for(int y = e.y0; y < e.y1; ++y)
+                Span(cmd, e.x0, y, w, full, colors);
+            continue;
+        }
+        
+        int h = e.y1 - e.y0;
+        int cells = (w + 2 + 3) & ~3;
+        for(int y = 0; y < h; ++y)
+            memset(acc + y*kAccStride, 0, cells*sizeof(float));
+        Accumulate(cmd, e, acc);
+        for(int y = 0; y < h; ++y) {
+            Coverage(acc + y*kAccStride, w, cmd.rule, coverage);
+            // Skip the rows of a tile a shape misses
+            int first = 0, last = w;
+            while(first < last && coverage[first] == 0)
+                ++first;
+            while(last > first && coverage[last - 1] == 0)
+                --last;
+            if(first < last)
+                Span(cmd, e.x0 + first, e.y0 + y, last - first, coverage + first, colors);
+        }
+    }
+}
+
+void SW_Rasterizer::flush()
+{
+    if(!commands.empty()) {
+        WorkerPool & workers = pool? *pool : WorkerPool::shared();
+        workers.parallel_for(tiles.size(), 1, [this](int begin, int end) {
+            float acc[kTileSize*kAccStride];
+            uint8_t coverage[kTileSize + 4];
+            uint32_t colors[kTileSize];
+            for(int tile = begin; tile < end; ++tile)
+                DrawTile(tile, acc, coverage, colors);
+        });
+    }
+    
+    for(std::vector<Entry> & bin: tiles)
+        bin.clear();
+    commands.clear();
+    edges.clear();
+    textures.clear();
+    arena.clear();
+    pathBegin = 0;
+}
@@ -0,0 +1,157 @@
+
+#ifndef SW_RASTERIZER_H
+#define SW_RASTERIZER_H
+
+#include "fltk3/Device.h"
+
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+// Antialiased 2D rasterizer for SW_GraphicsDriver, drawing into RGBA pixels
+// in memory on all cores.
+//
+// Shapes are recorded as they are drawn: a path of edges in pixel
+// coordinates (pixel x, y covers x..x+1, y..y+1) filled by a winding rule,
+// or a rectangle of whole pixels, in a paint of a color or a texture. Each is
+// binned into the 64x64 tiles its bounds touch within each rectangle of the
+// clip. flush() then rasterizes the tiles in parallel, each drawing its
+// shapes in the order they were drawn, so no two threads ever write the same
+// pixel and no locking is needed.
+//
+// Coverage is exact area, accumulated per tile as signed areas under each
+// edge and summed along rows, so edges are antialiased and any number of
+// overlapping contours costs one pass. Spans are blended four pixels at a
+// time with SSE2.
+//
+// Textures are copied at recording unless given as refs, which must stay
+// valid until flush().
+class SW_Rasterizer {
+  public:
+    enum FillRule {
+        NONZERO,
+        EVEN_ODD
+    };
+    
+    enum Format {
+        RGBA,
+        ALPHA// tints the paint color
+    };
+    
+    enum {kTileSize = 64};
+    
+    struct Stats {
+        size_t commands;// paths and rectangles drawn
+        size_t entries;// commands binned, once per tile and clip rectangle
+        size_t edges;
+    };
+    
+  private:
+    struct Edge {
+        float x0, y0, x1, y1;
+    };
+    
+    struct Texture {
+        const uint8_t * ref;// null if copied to the arena, at offset
+        size_t offset;
+        int w, h, stride;
+        Format format;
+    };
+    
+    struct Paint {
+        uint8_t color[4];
+        int texture;// -1 for the color alone
+        float m[6];// pixel coordinates to texels, as u = m[0]*x + m[2]*y + m[4]
+        bool smooth;// bilinear, otherwise nearest texel
+        bool tinted;// texel color times paint color
+    };
+    
+    struct Command {
+        int x0, y0, x1, y1;// pixel bounds
+        uint32_t edgeBegin, edgeEnd;// both 0 for a rectangle of whole pixels
+        FillRule rule;
+        Paint paint;
+    };
+    
+    struct Entry {
+        uint32_t command;
+        int16_t x0, y0, x1, y1;// part of the tile to draw, in pixels
+    };
+    
+    uint8_t * pixels;
+    int width, height, stride;
+    int tilesX, tilesY;
+    std::vector<std::vector<Entry> > tiles;
+    std::vector<Command> commands;
+    std::vector<Edge> edges;
+    std::vector<Texture> textures;
+    std::vector<uint8_t> arena;
+    std::vector<fltk3::Rectangle> clipRects;
+    Paint paint;
+    size_t pathBegin;
+    float pathBounds[4];
+    WorkerPool * pool;
+    Stats stats_;
+    
+    const uint8_t * Texels(const Texture & t) const {
+        return t.ref? t.ref : &arena[t.offset];
+    }
+    
+    void Record(Command & cmd);
+    void DrawTile(int tile, float * acc, uint8_t * coverage, uint32_t * colors) const;
+    void Accumulate(const Command & cmd, const Entry & e, float * acc) const;
+    void Span(const Command & cmd, int x, int y, int n, const uint8_t * coverage, uint32_t * colors) const;
+    void Sample(const Paint & p, int x, int y, int n, uint32_t * colors) const;
+    
+  public:
+    SW_Rasterizer();
+    
+    // Draw into w*h RGBA pixels, stride bytes a row, from the top down,
+    // discarding anything recorded and not flushed
+    void target(uint8_t * pixels, int w, int h, int stride = 0);
+    int w() const {return width;}
+    int h() const {return height;}
+    
+    // Workers to rasterize tiles with, WorkerPool::shared() by default
+    void workers(WorkerPool * workers) {pool = workers;}
+    
+    // Draw only within the union of n rectangles, which must not overlap
+    void clip(const fltk3::Rectangle * rects, int n);
+    
+    // Paint following shapes a color, with alpha
+    void color(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255);
+    
+    // Paint following shapes with texture tex, texel u, v being at pixel
+    // coordinates m[0]*u + m[2]*v + m[4], m[1]*u + m[3]*v + m[5]. ALPHA
+    // textures, and RGBA ones if tinted, are multiplied by the color.
+    void texture(int tex, const double m[6], bool smooth, bool tinted);
+    // Back to the color alone
+    void no_texture() {paint.texture = -1;}
+    
+    // A w*h texture copied from pixels, stride bytes a row. Valid until
+    // flush().
+    int add_texture(const uint8_t * pixels, int w, int h, int stride, Format format);
+    // A texture to fill in: w*h, 4 bytes per pixel if RGBA, rows packed.
+    // Valid until another texture is added; its index until flush().
+    uint8_t * new_texture(int w, int h, Format format, int & tex);
+    // A texture left where it is until flush()
+    int add_texture_ref(const uint8_t * pixels, int w, int h, int stride, Format format);
+    
+    // Paths: closed contours of n points xy, filled once all are added
+    void contour(const float * xy, int n);
+    // A triangle of any orientation, all of which are filled as one with
+    // NONZERO, so strokes made of triangles have no seams
+    void triangle(const float * a, const float * b, const float * c);
+    void fill(FillRule rule);
+    
+    // Pixels x0..x1-1, y0..y1-1
+    void fill_rect(int x0, int y0, int x1, int y1);
+    
+    // Rasterize everything recorded into the target
+    void flush();
+    
+    const Stats & stats() const {return stats_;}
+};
+
+#endif // SW_RASTERIZER_H
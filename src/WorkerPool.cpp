@@ -0,0 +1,94 @@
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(int numThreads):
+    job(nullptr),
+    jobSize(0),
+    chunkSize(1),
+    nextChunk(0),
+    busy(0),
+    generation(0),
+    quit(false)
+{
+    for(int j = 0; j < numThreads; ++j)
+        threads.push_back(std::thread(&WorkerPool::WorkerThread, this));
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for(std::thread & t: threads)
+        t.join();
+}
+
+WorkerPool & WorkerPool::shared()
+{
+    // Never destroyed, workers may outlive static destructors otherwise
+    static WorkerPool * pool = new WorkerPool(std::max((int)std::thread::hardware_concurrency() - 1, 0));
+    return *pool;
+}
+
+void WorkerPool::RunChunks()
+{
+    int numChunks = (jobSize + chunkSize - 1)/chunkSize;
+    for(int c = nextChunk++; c < numChunks; c = nextChunk++) {
+        int begin = c*chunkSize;
+        (*job)(begin, std::min(begin + chunkSize, jobSize));
+    }
+}
+
+void WorkerPool::WorkerThread()
+{
+    unsigned seen = 0;
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]{return quit || generation != seen;});
+            if(quit)
+                return;
+            seen = generation;
+        }
+        RunChunks();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(--busy == 0)
+                done.notify_one();
+        }
+    }
+}
+
+void WorkerPool::parallel_for(int n, int chunk, const std::function<void(int, int)> & fn)
+{
+    if(n <= 0)
+        return;
+    chunk = std::max(chunk, 1);
+    if(threads.empty() || n <= chunk) {
+        fn(0, n);
+        return;
+    }
+    
+    std::lock_guard<std::mutex> jobLock(jobMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        jobSize = n;
+        chunkSize = chunk;
+        nextChunk = 0;
+        busy = threads.size();
+        ++generation;
+    }
+    wake.notify_all();
+    
+    RunChunks();
+    
+    // Workers must all be out of RunChunks() before fn goes out of scope
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&]{return busy == 0;});
+    job = nullptr;
+}
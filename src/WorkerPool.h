@@ -0,0 +1,49 @@
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <functional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// A fixed set of threads for splitting loops over rows or tiles. The calling
+// thread works too, and parallel_for() returns once every chunk is done, so
+// callers need no synchronization of their own beyond fn being thread-safe.
+//
+// One loop runs at a time; parallel_for() from several threads at once is
+// serialized.
+class WorkerPool {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    std::mutex jobMutex;// held for the duration of a parallel_for()
+    
+    // Current job
+    const std::function<void(int, int)> * job;
+    int jobSize, chunkSize;
+    std::atomic<int> nextChunk;
+    int busy;// workers still in the current job
+    unsigned generation;
+    bool quit;
+    
+    void WorkerThread();
+    void RunChunks();
+    
+  public:
+    // threads extra threads, besides the caller's
+    explicit WorkerPool(int threads);
+    ~WorkerPool();
+    
+    // Pool with a thread for each hardware thread, less the caller's
+    static WorkerPool & shared();
+    
+    int size() const {return threads.size() + 1;}
+    
+    // Call fn(begin, end) over [0, n) in chunks of at most chunk items
+    void parallel_for(int n, int chunk, const std::function<void(int, int)> & fn);
+};
+
+#endif // WORKERPOOL_H
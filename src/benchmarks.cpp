@@ -0,0 +1,752 @@
+
+#include "benchmarks.h"
+#include "GL_GraphicsDriver.h"
+#include "SW_GraphicsDriver.h"
+#include "GL_Ext.h"
+#include "GL_FrameCapture.h"
+#include "GL_ImageStream.h"
+#include "GL_Tessellator.h"
+#include "WorkerPool.h"
+#include "imagediff.h"
+#include "fltk3/draw.h"
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cmath>
+
+#include <boost/format.hpp>
+
+using namespace std;
+using boost::format;
+
+typedef std::chrono::steady_clock Clock;
+
+static double Seconds(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+// Time frames drawn by draw(frame) with a fresh driver each, as a window
+// would. Throughput is measured with frames submitted back to back, latency by
+// waiting for each frame to finish before starting the next.
+template<typename fn_t>
+static void TimeFrames(const char * name, int w, int h, size_t bytesPerFrame, const fn_t & draw,
+                       GL_GraphicsDriver::StateSave save = GL_GraphicsDriver::SAVE_ALL)
+{
+    const int kFrames = 120;
+    fltk3::Rectangle rect(w, h);
+    
+    auto t0 = Clock::now();
+    for(int f = 0; f < kFrames; ++f) {
+        GL_GraphicsDriver glgd(&rect, save);
+        draw(f);
+    }
+    glFinish();
+    double total = Seconds(t0);
+    
+    double latency = 0;
+    for(int f = 0; f < kFrames; ++f) {
+        auto t1 = Clock::now();
+        {
+            GL_GraphicsDriver glgd(&rect, save);
+            draw(f);
+        }
+        glFinish();
+        latency += Seconds(t1);
+    }
+    
+    // No rate for benchmarks that don't move pixels
+    string rate = bytesPerFrame? (format("%9.1f MB/s") % (bytesPerFrame*kFrames/total/1e6)).str() : string(14, ' ');
+    cout << format("%-24s %s %8.3f ms/frame %8.3f ms latency\n")
+        % name % rate % (1000*total/kFrames) % (1000*latency/kFrames);
+}
+
+
+// ****************************************************************************
+// Image streaming
+// ****************************************************************************
+
+static void BenchImageStream(int w, int h)
+{
+    // A few distinct frames, so nothing can get away with not uploading
+    const int kNumFrames = 4;
+    const int d = 3;
+    vector<vector<uint8_t> > frames(kNumFrames, vector<uint8_t>(w*h*d));
+    for(int f = 0; f < kNumFrames; ++f)
+    for(int y = 0; y < h; ++y)
+    for(int x = 0; x < w; ++x) {
+        uint8_t * pix = &frames[f][d*(y*w + x)];
+        pix[0] = x + 16*f;
+        pix[1] = y;
+        pix[2] = (x ^ y) + 64*f;
+    }
+    size_t frameBytes = w*h*d;
+    
+    cout << format("Streaming %dx%d RGB frames\n") % w % h;
+    
+    TimeFrames("draw_image", w, h, frameBytes, [&](int f) {
+        fltk3::draw_image(&frames[f%kNumFrames][0], 0, 0, w, h, d);
+    });
+    
+    for(int buffers = 1; buffers <= 3; ++buffers) {
+        GL_ImageStream stream(w, h, d, buffers);
+        string name = (format("stream, %d buffer%s") % buffers % ((buffers == 1)? "" : "s")).str();
+        TimeFrames(name.c_str(), w, h, frameBytes, [&](int f) {
+            stream.damage();
+            stream.update(&frames[f%kNumFrames][0]);
+            stream.draw(0, 0);
+        });
+    }
+    
+    // A quarter of the frame changing, as with a moving object on a static
+    // background.
+    GL_ImageStream stream(w, h, d, 2);
+    TimeFrames("stream, 1/4 damaged", w, h, frameBytes/4, [&](int f) {
+        stream.damage(w/4, h/4, w/2, h/2);
+        stream.update(&frames[f%kNumFrames][0]);
+        stream.draw(0, 0);
+    });
+}
+
+
+// ****************************************************************************
+// Generated images
+// ****************************************************************************
+
+// A plot-like image that takes some computing, thread-safe as it only
+// writes its own line.
+static void HeatmapLine(void * data, int x, int y, int w, uchar * buf)
+{
+    double t = *(double *)data;
+    for(int j = 0; j < w; ++j, buf += 3) {
+        double v = sin((x + j)*0.05 + t)*cos(y*0.07 - t) + sin(hypot(x + j - 200, y - 150)*0.1);
+        v = (v + 2)/4;
+        buf[0] = 255*v;
+        buf[1] = 255*(1 - fabs(2*v - 1));
+        buf[2] = 255*(1 - v);
+    }
+}
+
+static void BenchImageCallback(int w, int h)
+{
+    cout << format("Generating %dx%d RGB images line by line\n") % w % h;
+    double t = 0;
+    size_t frameBytes = w*h*3;
+    
+    GL_GraphicsDriver::thread_safe_image_callback(HeatmapLine, false);
+    TimeFrames("serial", w, h, frameBytes, [&](int f) {
+        t = f*0.1;
+        fltk3::draw_image(HeatmapLine, &t, 0, 0, w, h, 3);
+    });
+    
+    GL_GraphicsDriver::thread_safe_image_callback(HeatmapLine);
+    string name = (format("%d threads") % WorkerPool::shared().size()).str();
+    TimeFrames(name.c_str(), w, h, frameBytes, [&](int f) {
+        t = f*0.1;
+        fltk3::draw_image(HeatmapLine, &t, 0, 0, w, h, 3);
+    });
+    GL_GraphicsDriver::thread_safe_image_callback(HeatmapLine, false);
+}
+
+
+// ****************************************************************************
+// Complex polygons
+// ****************************************************************************
+
+// A star with a hole, the sort of shape only end_complex_polygon() can draw
+static void ComplexStar(double cx, double cy, double r, int points, double angle)
+{
+    fltk3::begin_complex_polygon();
+    for(int j = 0; j < 2*points; ++j) {
+        double a = angle + j*M_PI/points, rj = (j & 1)? r*0.45 : r;
+        fltk3::vertex(cx + rj*cos(a), cy + rj*sin(a));
+    }
+    fltk3::gap();
+    for(int j = 0; j < 16; ++j) {
+        double a = -j*M_PI/8;
+        fltk3::vertex(cx + r*0.25*cos(a), cy + r*0.25*sin(a));
+    }
+    fltk3::end_complex_polygon();
+}
+
+static void BenchComplexPolygon(int w, int h)
+{
+    const int kShapes = 100;
+    const int kPoints = 24;
+    GL_Tessellator & tess = GL_Tessellator::shared();
+    cout << format("Drawing %d complex polygons of %d vertices\n") % kShapes % (2*kPoints + 16);
+    
+    auto run = [&](const char * name, double dx, double spin, bool byMatrix) {
+        tess.clear();
+        tess.reset_stats();
+        TimeFrames(name, w, h, 0, [&](int f) {
+            fltk3::color(40, 80, 200);
+            for(int s = 0; s < kShapes; ++s) {
+                double x = fmod(s*37 + f*dx, w), y = (s*53)%h, a = s + f*spin;
+                if(byMatrix) {
+                    fltk3::push_matrix();
+                    fltk3::translate(x, y);
+                    fltk3::rotate(-a*180/M_PI);
+                    ComplexStar(0, 0, 30, kPoints, 0);
+                    fltk3::pop_matrix();
+                }
+                else {
+                    ComplexStar(x, y, 30, kPoints, a);
+                }
+            }
+        });
+        const GL_Tessellator::Stats & stats = tess.stats();
+        cout << format("%24s %zu hits, %zu misses\n") % "" % stats.hits % stats.misses;
+    };
+    
+    run("unchanged", 0, 0, false);
+    run("moving", 3, 0, false);
+    run("rotating", 0, 0.01, false);// new shapes every frame, tessellation cost
+    run("rotating by matrix", 0, 0.01, true);// the same shapes, transformed by GL
+}
+
+
+// An outline like a coastline on a map, changing every frame so that no
+// triangulation comes from the cache.
+static void Outline(int w, int h, int n, int f)
+{
+    double cx = w/2.0, cy = h/2.0, r = 0.45*std::min(w, h);
+    fltk3::begin_complex_polygon();
+    for(int j = 0; j < n; ++j) {
+        double a = 2*M_PI*j/n;
+        double rj = r*(0.75 + 0.15*sin(7*a + f*0.05) + 0.1*sin(97*a - f*0.1));
+        fltk3::vertex(cx + rj*cos(a), cy + rj*sin(a));
+    }
+    fltk3::end_complex_polygon();
+}
+
+static void BenchComplexFill(int w, int h)
+{
+    static const struct {
+        GL_GraphicsDriver::ComplexPolygonMode mode;
+        const char * name;
+    } kModes[] = {
+        {GL_GraphicsDriver::TESSELLATE, "tessellate"},
+        {GL_GraphicsDriver::STENCIL_EVEN_ODD, "stencil even-odd"},
+        {GL_GraphicsDriver::STENCIL_NONZERO, "stencil nonzero"},
+    };
+    
+    for(int n: {100, 1000, 10000, 50000}) {
+        cout << format("Filling a %d vertex outline\n") % n;
+        for(auto & m: kModes) {
+            TimeFrames(m.name, w, h, 0, [&](int f) {
+                GL_GraphicsDriver::current()->complex_polygon_mode(m.mode);
+                fltk3::color(40, 120, 60);
+                Outline(w, h, n, f);
+            });
+        }
+    }
+}
+
+
+// ****************************************************************************
+// Antialiasing
+// ****************************************************************************
+
+// A framebuffer object to draw into, multisampled or not
+struct RenderTarget {
+    GLuint fbo, color, depthStencil;
+    int w, h, samples;
+    
+    RenderTarget(int w, int h, int samples): w(w), h(h), samples(samples) {
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, w, h);
+        glGenRenderbuffers(1, &depthStencil);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthStencil);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, w, h);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencil);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    ~RenderTarget() {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteRenderbuffers(1, &depthStencil);
+    }
+    
+    // Resolve multisamples into dst, as a window would on swapping buffers
+    void resolve(const RenderTarget & dst) const {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dst.fbo);
+        glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    }
+    
+    void read(vector<uint8_t> & rgba) const {
+        rgba.resize(4*w*h);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, &rgba[0]);
+    }
+};
+
+// Shapes whose edges show off antialiasing, moving a little each frame
+static void AAScene(int w, int h, int f)
+{
+    fltk3::color(255, 255, 255);
+    fltk3::rectf(0, 0, w, h);
+    double t = f*0.01;
+    
+    fltk3::color(0, 0, 0);
+    for(int j = 0; j < 24; ++j) {
+        double a = j*M_PI/24 + t;
+        int cx = 100, cy = 100;
+        fltk3::line_style(fltk3::SOLID, 1 + j%4);
+        fltk3::line(cx + 20*cos(a), cy + 20*sin(a), cx + 90*cos(a), cy + 90*sin(a));
+    }
+    fltk3::line_style(fltk3::SOLID, 0);
+    
+    fltk3::color(200, 40, 40);
+    for(int j = 0; j < 6; ++j)
+        fltk3::pie(220 + 45*j, 20, 40, 40, 30*j, 300 + 30*j);
+    fltk3::color(40, 40, 200);
+    for(int j = 0; j < 6; ++j) {
+        double a = t + j;
+        int x = 240 + 45*j, y = 110;
+        fltk3::polygon(x + 18*cos(a), y + 18*sin(a), x + 18*cos(a + 2.1), y + 18*sin(a + 2.1),
+                       x + 18*cos(a + 4.2), y + 18*sin(a + 4.2));
+    }
+    fltk3::color(0, 120, 0);
+    fltk3::line_style(fltk3::SOLID, 3);
+    for(int j = 0; j < 6; ++j)
+        fltk3::arc(220 + 45*j, 150, 40, 40, 0, 360);
+    fltk3::line_style(fltk3::SOLID, 0);
+    for(int j = 0; j < 4; ++j)
+        ComplexStar(60 + 110*j, 280, 50, 7, t + j);
+}
+
+// Differences between two images, ignoring alpha
+static void ImageDifference(const char * name, const imagediff::Image & a, const imagediff::Image & b)
+{
+    imagediff::Options options;
+    options.threshold = 32;
+    imagediff::Result r = imagediff::compare(a, b, options);
+    cout << format("%-24s mean %.3f, max %d, %.2f%% of pixels off by over 32, PSNR %.1f dB, SSIM %.4f\n")
+        % name % r.mean_error() % r.max_error() % (100.0*r.differing/((double)a.w*a.h)) % r.psnr % r.ssim;
+}
+
+static void BenchAntialiasing(int w, int h)
+{
+    if(!GL_HaveFramebuffers()) {
+        cout << "Needs framebuffer objects" << endl;
+        return;
+    }
+    GLint maxSamples = 0;
+    glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+    int samples = min(8, (int)maxSamples);
+    
+    RenderTarget msaa(w, h, samples), single(w, h, 0);
+    auto draw = [&](RenderTarget & target, GL_GraphicsDriver::Antialiasing mode, int f) {
+        GL_GraphicsDriver::current()->antialiasing(mode);
+        AAScene(w, h, f);
+        if(target.samples) {
+            GL_GraphicsDriver::current()->flush();
+            target.resolve(single);
+        }
+    };
+    
+    cout << format("Antialiasing, %dx multisampling vs. coverage\n") % samples;
+    glBindFramebuffer(GL_FRAMEBUFFER, msaa.fbo);
+    string name = (format("%dx multisample") % samples).str();
+    TimeFrames(name.c_str(), w, h, 0, [&](int f) {draw(msaa, GL_GraphicsDriver::MULTISAMPLE_AA, f);});
+    glBindFramebuffer(GL_FRAMEBUFFER, single.fbo);
+    TimeFrames("1x coverage", w, h, 0, [&](int f) {draw(single, GL_GraphicsDriver::COVERAGE_AA, f);});
+    TimeFrames("1x aliased", w, h, 0, [&](int f) {draw(single, GL_GraphicsDriver::MULTISAMPLE_AA, f);});
+    
+    // Same frame each way, compared with multisampling
+    vector<uint8_t> reference, coverage, aliased;
+    fltk3::Rectangle rect(w, h);
+    glBindFramebuffer(GL_FRAMEBUFFER, msaa.fbo);
+    {
+        GL_GraphicsDriver glgd(&rect);
+        draw(msaa, GL_GraphicsDriver::MULTISAMPLE_AA, 0);
+    }
+    single.read(reference);
+    glBindFramebuffer(GL_FRAMEBUFFER, single.fbo);
+    {
+        GL_GraphicsDriver glgd(&rect);
+        draw(single, GL_GraphicsDriver::COVERAGE_AA, 0);
+    }
+    single.read(coverage);
+    {
+        GL_GraphicsDriver glgd(&rect);
+        draw(single, GL_GraphicsDriver::MULTISAMPLE_AA, 0);
+    }
+    single.read(aliased);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    
+    cout << format("Difference from %dx multisampling\n") % samples;
+    imagediff::Image ref = imagediff::bottom_up(&reference[0], w, h, 4);
+    ImageDifference("1x coverage", imagediff::bottom_up(&coverage[0], w, h, 4), ref);
+    ImageDifference("1x aliased", imagediff::bottom_up(&aliased[0], w, h, 4), ref);
+}
+
+
+// ****************************************************************************
+// State saving
+// ****************************************************************************
+
+// A few widgets' worth of boxes, frames and labels, the sort of small redraw
+// where saving GL state is a fair part of the frame.
+static void WidgetScene(int w, int h, int f)
+{
+    fltk3::color(192, 192, 192);
+    fltk3::rectf(0, 0, w, h);
+    fltk3::font(0, 14);
+    for(int j = 0; j < 12; ++j) {
+        int x = 10 + 100*(j%4), y = 10 + 40*(j/4);
+        fltk3::color((j == f%12)? 160 : 212, 208, 200);
+        fltk3::rectf(x, y, 90, 30);
+        fltk3::color(255, 255, 255);
+        fltk3::xyline(x, y, x + 89);
+        fltk3::yxline(x, y, y + 29);
+        fltk3::color(64, 64, 64);
+        fltk3::xyline(x, y + 29, x + 89);
+        fltk3::yxline(x + 89, y, y + 29);
+        fltk3::color(0, 0, 0);
+        fltk3::draw("Button", x + 20, y + 20);
+    }
+}
+
+static void BenchStateSave(int w, int h)
+{
+    static const struct {
+        GL_GraphicsDriver::StateSave save;
+        const char * name;
+    } kModes[] = {
+        {GL_GraphicsDriver::SAVE_ALL, "save all"},
+        {GL_GraphicsDriver::SAVE_TOUCHED, "save touched"},
+        {GL_GraphicsDriver::SAVE_NONE, "save none"},
+    };
+    
+    cout << format("Saving GL state around a driver%s\n") % (GL_CoreProfile()? ", core profile" : "");
+    for(auto & m: kModes)
+        TimeFrames(m.name, w, h, 0, [&](int f) {WidgetScene(w, h, f);}, m.save);
+}
+
+
+// ****************************************************************************
+// Clip regions
+// ****************************************************************************
+
+// A window full of buttons, skipping those not_clipped() rejects, as widgets
+// do. Returns the number drawn.
+static int ButtonGrid(int w, int h, int f)
+{
+    int drawn = 0;
+    fltk3::font(0, 12);
+    for(int y = 0; y + 24 <= h; y += 28) {
+        for(int x = 0; x + 60 <= w; x += 64) {
+            if(!fltk3::not_clipped(x, y, 60, 24))
+                continue;
+            fltk3::color(((x + y)/4 + f)%64 + 160, 208, 200);
+            fltk3::rectf(x, y, 60, 24);
+            fltk3::color(64, 64, 64);
+            fltk3::rect(x, y, 60, 24);
+            fltk3::color(0, 0, 0);
+            fltk3::draw("Button", x + 10, y + 16);
+            ++drawn;
+        }
+    }
+    return drawn;
+}
+
+// A panel with corners of radius r, as a path
+static void RoundedRect(double x, double y, double w, double h, double r)
+{
+    fltk3::begin_complex_polygon();
+    fltk3::arc(x + w - r, y + r, r, 0, 90);
+    fltk3::arc(x + r, y + r, r, 90, 180);
+    fltk3::arc(x + r, y + h - r, r, 180, 270);
+    fltk3::arc(x + w - r, y + h - r, r, 270, 360);
+}
+
+static void BenchClipRegions(int w, int h)
+{
+    // Another window over the middle leaves a frame of this one to redraw
+    int bx = w/4, by = h/4, bw = w/2, bh = h/2;
+    fltk3::Rectangle exposed[4] = {
+        fltk3::Rectangle(0, 0, w, by),
+        fltk3::Rectangle(0, by + bh, w, h - by - bh),
+        fltk3::Rectangle(0, by, bx, bh),
+        fltk3::Rectangle(bx + bw, by, w - bx - bw, bh)
+    };
+    
+    // The frame's bounding box is the whole window
+    static const char * kModes[] = {"bounding box", "uncovered rectangles", "rounded panel"};
+    cout << "Redrawing a window of buttons through a clip region\n";
+    for(int mode = 0; mode < 3; ++mode) {
+        int drawn = 0;
+        TimeFrames(kModes[mode], w, h, 0, [&](int f) {
+            GL_GraphicsDriver * driver = GL_GraphicsDriver::current();
+            if(mode == 0) {
+                fltk3::push_clip(0, 0, w, h);
+            }
+            else if(mode == 1) {
+                driver->push_clip(exposed, 4);
+            }
+            else {
+                RoundedRect(bx, by, bw, bh, 24);
+                driver->push_clip_path();
+            }
+            drawn = ButtonGrid(w, h, f);
+            fltk3::pop_clip();
+        });
+        cout << format("%24s %d buttons drawn\n") % "" % drawn;
+    }
+}
+
+
+// ****************************************************************************
+// Vertex packing
+// ****************************************************************************
+
+static void BenchVertexPacking(int w, int h)
+{
+    static const struct {
+        const char * name;
+        void (*draw)(int w, int h, int f);
+    } kScenes[] = {
+        {"widgets", WidgetScene},
+        {"shapes", AAScene},
+    };
+    
+    cout << "Vertex data submitted per frame, as floats vs. packed\n";
+    for(auto & scene: kScenes) {
+        for(bool pack: {false, true}) {
+            size_t bytes = 0, vertices = 0, frames = 0;
+            string name = (format("%s, %s") % scene.name % (pack? "packed" : "floats")).str();
+            TimeFrames(name.c_str(), w, h, 0, [&](int f) {
+                GL_GraphicsDriver * driver = GL_GraphicsDriver::current();
+                driver->pack_vertices(pack);
+                driver->antialiasing(GL_GraphicsDriver::COVERAGE_AA);
+                scene.draw(w, h, f);
+                driver->flush();
+                bytes += driver->batch_stats().bytes;
+                vertices += driver->batch_stats().vertices;
+                ++frames;
+            });
+            cout << format("%24s %8.1f KB/frame, %.1f bytes/vertex\n")
+                % "" % (bytes/1024.0/frames) % ((double)bytes/vertices);
+        }
+    }
+}
+
+
+// ****************************************************************************
+// Readback
+// ****************************************************************************
+
+static void BenchReadback(int w, int h)
+{
+    cout << format("Reading back each frame, %s pixel buffers%s\n")
+        % (GL_HavePixelBuffers()? "with" : "without") % (GL_HaveSync()? " and fences" : "");
+    TimeFrames("no readback", w, h, 0, [&](int f) {WidgetScene(w, h, f);});
+    
+    vector<uint8_t> pixels(4*w*h);
+    TimeFrames("glReadPixels", w, h, 4*w*h, [&](int f) {
+        WidgetScene(w, h, f);
+        GL_GraphicsDriver::current()->flush();
+        glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+    });
+    
+    GL_FrameCapture capture;
+    uint64_t reads = 0, frames = 0, lag = 0;
+    TimeFrames("GL_FrameCapture", w, h, 4*w*h, [&](int f) {
+        WidgetScene(w, h, f);
+        GL_GraphicsDriver::current()->flush();
+        capture.read(0, 0, w, h);
+        ++reads;
+        // Frames drawn since each came back
+        while(GL_FrameCapture::FramePtr frame = capture.next()) {
+            lag += reads - 1 - frame->number;
+            ++frames;
+        }
+    });
+    while(capture.next(true))
+        ;
+    cout << format("%24s %.2f frames behind on average\n") % "" % (frames? (double)lag/frames : 0.0);
+}
+
+
+// ****************************************************************************
+// Image differences
+// ****************************************************************************
+
+// Time compare(a, b) of w*h images, a bottom up RGBA like a GL readback and b
+// top down RGB like DiffWindow's image B
+static void TimeCompare(const char * name, const vector<uint8_t> & a, const vector<uint8_t> & b,
+                        int w, int h, const imagediff::Options & options, vector<uint8_t> & difference)
+{
+    const int kFrames = 60;
+    double psnr = 0;
+    auto t0 = Clock::now();
+    for(int f = 0; f < kFrames; ++f) {
+        imagediff::Result r = imagediff::compare(imagediff::bottom_up(&a[0], w, h, 4),
+                                                 imagediff::top_down(&b[0], w, h, 3),
+                                                 options, &difference[0]);
+        psnr += r.psnr;
+    }
+    double total = Seconds(t0);
+    cout << format("%-24s %8.1f frames/s %8.1f MPixel/s, PSNR %.1f dB\n")
+        % name % (kFrames/total) % (kFrames*(double)w*h/total/1e6) % (psnr/kFrames);
+}
+
+static void BenchImageDiff(int w, int h)
+{
+    // Rendered scenes aren't needed, only pixels that mostly agree
+    vector<uint8_t> a(4*w*h), b(3*w*h), difference(4*w*h);
+    uint32_t seed = 1;
+    for(int y = 0; y < h; ++y)
+    for(int x = 0; x < w; ++x) {
+        for(int c = 0; c < 3; ++c) {
+            seed = seed*1664525 + 1013904223;
+            int v = (x*(c + 1) + y) & 255;
+            a[4*((h - 1 - y)*w + x) + c] = v;
+            b[3*(y*w + x) + c] = (seed >> 28) == 0? 255 - v : v;
+        }
+        a[4*((h - 1 - y)*w + x) + 3] = 255;
+    }
+    
+    cout << format("Comparing %dx%d frames on %d threads\n") % w % h % WorkerPool::shared().size();
+    // As DiffWindow::draw() did: column by column, channel 0 only
+    {
+        const int kFrames = 60;
+        vector<uint8_t> buf(3*w*h);
+        auto t0 = Clock::now();
+        for(int f = 0; f < kFrames; ++f) {
+            for(int x = 0; x < w; ++x)
+            for(int y = 0; y < h; ++y) {
+                int va = a[4*((h - 1 - y)*w + x)];
+                int vb = b[3*(y*w + x)];
+                buf[3*(y*w + x)] = min(255, abs(va - vb));
+            }
+        }
+        double total = Seconds(t0);
+        cout << format("%-24s %8.1f frames/s %8.1f MPixel/s\n")
+            % "column loop, 1 channel" % (kFrames/total) % (kFrames*(double)w*h/total/1e6);
+    }
+    
+    imagediff::Options options;
+    TimeCompare("compare", a, b, w, h, options, difference);
+    options.ssim = false;
+    TimeCompare("compare, no SSIM", a, b, w, h, options, difference);
+    options.pool = &WorkerPool::shared();
+    TimeCompare("compare, no SSIM, pool", a, b, w, h, options, difference);
+    options.ssim = true;
+    TimeCompare("compare, pool", a, b, w, h, options, difference);
+}
+
+
+// ****************************************************************************
+// Software rendering
+// ****************************************************************************
+
+// Time frames drawn by draw(frame) into pixels with a fresh SW_GraphicsDriver
+// each, rasterized by pool
+template<typename fn_t>
+static void TimeSoftwareFrames(const char * name, int w, int h, vector<uint8_t> & pixels,
+                               WorkerPool & pool, const fn_t & draw)
+{
+    const int kFrames = 120;
+    fltk3::Rectangle rect(w, h);
+    pixels.assign(4*w*h, 0);
+    
+    auto t0 = Clock::now();
+    for(int f = 0; f < kFrames; ++f) {
+        SW_GraphicsDriver swgd(&rect, &pixels[0]);
+        swgd.workers(&pool);
+        draw(f);
+    }
+    double total = Seconds(t0);
+    cout << format("%-24s %s %8.3f ms/frame\n") % name % string(14, ' ') % (1000*total/kFrames);
+}
+
+static void BenchSoftware(int w, int h)
+{
+    static const struct {
+        const char * name;
+        void (*draw)(int w, int h, int f);
+    } kScenes[] = {
+        {"widgets", WidgetScene},
+        {"shapes", AAScene},
+    };
+    if(!GL_HaveFramebuffers()) {
+        cout << "Needs framebuffer objects" << endl;
+        return;
+    }
+    
+    RenderTarget target(w, h, 0);
+    WorkerPool serial(0);
+    vector<uint8_t> gl, sw;
+    cout << format("GL coverage antialiasing vs. SW_GraphicsDriver on %d threads\n") % WorkerPool::shared().size();
+    for(auto & scene: kScenes) {
+        glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+        string name = (format("%s, GL") % scene.name).str();
+        TimeFrames(name.c_str(), w, h, 0, [&](int f) {
+            GL_GraphicsDriver::current()->antialiasing(GL_GraphicsDriver::COVERAGE_AA);
+            scene.draw(w, h, f);
+        });
+        // The last frame, to compare with SW_GraphicsDriver's
+        target.read(gl);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    
+        name = (format("%s, SW serial") % scene.name).str();
+        TimeSoftwareFrames(name.c_str(), w, h, sw, serial, [&](int f) {scene.draw(w, h, f);});
+        name = (format("%s, SW parallel") % scene.name).str();
+        TimeSoftwareFrames(name.c_str(), w, h, sw, WorkerPool::shared(), [&](int f) {scene.draw(w, h, f);});
+        name = (format("%s, SW vs. GL") % scene.name).str();
+        ImageDifference(name.c_str(), imagediff::top_down(&sw[0], w, h, 4), imagediff::bottom_up(&gl[0], w, h, 4));
+    }
+}
+
+// ****************************************************************************
+
+struct Benchmark {
+    const char * name;
+    void (*run)(int w, int h);
+    const char * description;
+};
+
+static const Benchmark kBenchmarks[] = {
+    {"stream", BenchImageStream, "Image upload rate and latency, draw_image() vs. GL_ImageStream"},
+    {"callback", BenchImageCallback, "draw_image() with a line callback, serial vs. WorkerPool"},
+    {"tess", BenchComplexPolygon, "end_complex_polygon() with cached and uncached triangulations"},
+    {"fill", BenchComplexFill, "end_complex_polygon() by tessellation vs. stencil-then-cover"},
+    {"aa", BenchAntialiasing, "Multisampling vs. coverage antialiasing, frame time and image difference"},
+    {"state", BenchStateSave, "Frame time saving all GL state, just what the driver touches, or none"},
+    {"clip", BenchClipRegions, "Redrawing through a bounding box, a set of rectangles or a path"},
+    {"pack", BenchVertexPacking, "Vertex bytes per frame and frame time, float vs. packed vertices"},
+    {"readback", BenchReadback, "Frame time reading back every frame, glReadPixels() vs. GL_FrameCapture"},
+    {"diff", BenchImageDiff, "imagediff::compare() vs. DiffWindow's old loop, serial and on WorkerPool"},
+    {"software", BenchSoftware, "SW_GraphicsDriver vs. GL frame time, serial and parallel, and image difference"},
+};
+
+bool RunBenchmark(const std::string & name, int w, int h)
+{
+    for(const Benchmark & bench: kBenchmarks) {
+        if(name == bench.name || name == "all") {
+            bench.run(w, h);
+            if(name != "all")
+                return true;
+        }
+    }
+    return name == "all";
+}
+
+void ListBenchmarks(std::ostream & out)
+{
+    out << "Benchmarks:" << endl;
+    for(const Benchmark & bench: kBenchmarks)
+        out << format("  %-12s %s\n") % bench.name % bench.description;
+    out << format("  %-12s %s\n") % "all" % "Run all of the above";
+}
@@ -0,0 +1,16 @@
+
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <ostream>
+#include <string>
+
+// Performance measurements of GL_GraphicsDriver and SW_GraphicsDriver, run
+// with "fltktest --bench <name>". Each runs in the current GL context, drawing
+// to a w*h viewport, and prints its results to stdout.
+
+// Returns false if there is no benchmark called name
+bool RunBenchmark(const std::string & name, int w, int h);
+void ListBenchmarks(std::ostream & out);
+
+#endif // BENCHMARKS_H
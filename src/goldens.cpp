@@ -0,0 +1,991 @@
+#include "goldens.h"
+#include "GL_GraphicsDriver.h"
+#include "GL_Offscreen.h"
+#include "SW_GraphicsDriver.h"
+#include "imagediff.h"
+#include "fltk3/draw.h"
+
+#include <iostream>
+#include <algorithm>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <cmath>
+
+#include <boost/format.hpp>
+
+using namespace std;
+using boost::format;
+
+typedef std::chrono::steady_clock Clock;
+
+static double Seconds(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+// How far an image may be from another and still pass
+struct Tolerance {
+    int threshold;// a pixel differs if a channel is off by more than this
+    double pixels;// fraction of pixels that may differ
+    double psnr;// least PSNR, dB
+};
+
+// Each driver against its own goldens: as much as another GPU, libm or
+// FreeType might move things, not a primitive drawn differently
+static const Tolerance kGoldenTolerance = {24, 0.005, 34};
+// GL_GraphicsDriver against SW_GraphicsDriver, compared at half size. They
+// agree on where shapes are but not quite on how their edges are
+// antialiased: a pixel an edge runs along can be covered by one and not the
+// other, which halved is an error of 64. Anything more is a pixel drawn by
+// only one of them, or out of place.
+static const Tolerance kDriverTolerance = {64, 0.02, 26};
+// Where that happens along most edges: the ends of short dashes, and holes,
+// fringed on one side of their outline by GL and on both by SW
+static const Tolerance kEdgeTolerance = {64, 0.04, 23};
+
+// A case is slow if it takes this many times as long as recorded, and at
+// least kSlowMs longer, as tiny cases are mostly noise
+static const double kSlowdown = 1.5;
+static const double kSlowMs = 0.25;
+
+struct Case {
+    std::string name;
+    int w, h;
+    std::function<void(int w, int h)> draw;
+    bool software;// SW_GraphicsDriver can draw it too
+    Tolerance drivers;
+};
+
+// A repeatable pseudo-random number from seed, for cases drawing many things
+static uint32_t Random(uint32_t & seed)
+{
+    seed = seed*1664525 + 1013904223;
+    return seed >> 8;
+}
+
+// Clip to rects with whichever driver is drawing, as neither regions nor rect
+// sets go through fltk3's calls
+static void PushClipRects(const fltk3::Rectangle * rects, int n)
+{
+    if(GL_GraphicsDriver * glgd = GL_GraphicsDriver::current())
+        glgd->push_clip(rects, n);
+    else if(SW_GraphicsDriver * swgd = SW_GraphicsDriver::current())
+        swgd->push_clip(rects, n);
+}
+
+
+// ****************************************************************************
+// Cases
+// ****************************************************************************
+
+static void AddCase(vector<Case> & cases, const string & name, int w, int h,
+                    const std::function<void(int w, int h)> & draw,
+                    bool software = true, const Tolerance & drivers = kDriverTolerance)
+{
+    Case c = {name, w, h, draw, software, drivers};
+    cases.push_back(c);
+}
+
+static void AddRects(vector<Case> & cases)
+{
+    static const int kSizes[][2] = {{1, 1}, {1, 9}, {9, 1}, {2, 2}, {16, 16}, {37, 21}, {62, 62}};
+    for(auto & size: kSizes) {
+        int rw = size[0], rh = size[1];
+        AddCase(cases, (format("rect/%dx%d") % rw % rh).str(), 64, 64, [=](int, int) {
+            fltk3::rect(1, 1, rw, rh);
+        });
+        AddCase(cases, (format("rectf/%dx%d") % rw % rh).str(), 64, 64, [=](int, int) {
+            fltk3::rectf(1, 1, rw, rh);
+        });
+    }
+    AddCase(cases, "rect/edges", 64, 64, [](int w, int h) {
+        fltk3::color(200, 0, 0);
+        fltk3::rectf(-8, -8, 24, 24);
+        fltk3::rectf(w - 16, h - 16, 24, 24);
+        fltk3::color(0, 0, 200);
+        fltk3::rect(-4, h/2, w + 8, 8);
+        fltk3::rect(0, 0, w, h);
+    });
+    AddCase(cases, "rect/empty", 64, 64, [](int, int) {
+        fltk3::rect(8, 8, 0, 16);
+        fltk3::rectf(8, 8, 16, 0);
+        fltk3::rectf(40, 40, -8, -8);
+    });
+}
+
+// A polyline, a diagonal, a loop and FLTK's axis-aligned lines, to stroke in
+// each style
+static void LineFigure(int, int)
+{
+    fltk3::begin_line();
+    fltk3::vertex(6, 40);
+    fltk3::vertex(18, 10);
+    fltk3::vertex(30, 40);
+    fltk3::vertex(58, 30);
+    fltk3::end_line();
+    fltk3::line(4, 58, 60, 46);
+    fltk3::loop(36, 6, 58, 6, 58, 22);
+    fltk3::xyline(4, 50, 30, 62);
+    fltk3::yxline(62, 34, 60, 40);
+}
+
+static void AddLines(vector<Case> & cases)
+{
+    static char kDashes[] = {6, 2, 2, 2, 0};
+    static const struct {
+        const char * name;
+        int style;
+        char * dashes;
+    } kStyles[] = {
+        {"solid", fltk3::SOLID, nullptr},
+        {"dash", fltk3::DASH, nullptr},
+        {"dot", fltk3::DOT, nullptr},
+        {"dashdot", fltk3::DASHDOT, nullptr},
+        {"dashdotdot", fltk3::DASHDOTDOT, nullptr},
+        {"dashes", fltk3::SOLID, kDashes},
+    };
+    static const int kWidths[] = {0, 1, 2, 5};
+    for(auto & style: kStyles)
+    for(int width: kWidths) {
+        int s = style.style;
+        char * dashes = style.dashes;
+        AddCase(cases, (format("line/%s/%d") % style.name % width).str(), 64, 64, [=](int w, int h) {
+            fltk3::line_style(s, width, dashes);
+            LineFigure(w, h);
+        }, true, (dashes && width > 2)? kEdgeTolerance : kDriverTolerance);
+    }
+    
+    static const struct {
+        const char * name;
+        int style;
+    } kCaps[] = {
+        {"flat", fltk3::CAP_FLAT},
+        {"round", fltk3::CAP_ROUND},
+        {"square", fltk3::CAP_SQUARE},
+    }, kJoins[] = {
+        {"miter", fltk3::JOIN_MITER},
+        {"round", fltk3::JOIN_ROUND},
+        {"bevel", fltk3::JOIN_BEVEL},
+    };
+    for(auto & cap: kCaps)
+    for(auto & join: kJoins) {
+        int s = cap.style | join.style;
+        AddCase(cases, (format("line/%s-%s/7") % cap.name % join.name).str(), 64, 64, [=](int w, int h) {
+            fltk3::line_style(s, 7);
+            LineFigure(w, h);
+        });
+    }
+    
+    AddCase(cases, "line/fan", 64, 64, [](int, int) {
+        for(int j = 0, n = 24; j < n; ++j) {
+            double th = (2.0*M_PI*j)/n;
+            double c = cos(th), s = sin(th);
+            fltk3::line(32 + c*6, 32 + s*6, 32 + c*30, 32 + s*30);
+        }
+    });
+    AddCase(cases, "point/grid", 64, 64, [](int w, int h) {
+        for(int y = 2; y < h; y += 5)
+        for(int x = 2; x < w; x += 5)
+            fltk3::point(x, y);
+        fltk3::begin_points();
+        for(int j = 0; j < 16; ++j)
+            fltk3::vertex(4 + j*3.5, 60 - j*0.5);
+        fltk3::end_points();
+    });
+}
+
+static void AddShapes(vector<Case> & cases)
+{
+    AddCase(cases, "polygon/3", 64, 64, [](int, int) {
+        fltk3::polygon(4, 4, 60, 20, 20, 60);
+    });
+    AddCase(cases, "polygon/4", 64, 64, [](int, int) {
+        fltk3::polygon(4, 30, 30, 4, 60, 34, 34, 60);
+    });
+    AddCase(cases, "polygon/path", 64, 64, [](int, int) {
+        fltk3::begin_polygon();
+        for(int j = 0; j < 7; ++j)
+            fltk3::vertex(32 + 28*cos(2*M_PI*j/7), 32 + 28*sin(2*M_PI*j/7));
+        fltk3::end_polygon();
+    });
+    AddCase(cases, "loop/3", 64, 64, [](int, int) {
+        fltk3::loop(4, 4, 60, 20, 20, 60);
+    });
+    AddCase(cases, "loop/4", 64, 64, [](int, int) {
+        fltk3::loop(4, 30, 30, 4, 60, 34, 34, 60);
+    });
+    AddCase(cases, "complex/star", 64, 64, [](int, int) {
+        fltk3::begin_complex_polygon();
+        for(int j = 0; j < 5; ++j)
+            fltk3::vertex(32 + 28*cos(-M_PI/2 + 4*M_PI*j/5), 32 + 28*sin(-M_PI/2 + 4*M_PI*j/5));
+        fltk3::end_complex_polygon();
+    });
+    AddCase(cases, "complex/holes", 64, 64, [](int, int) {
+        fltk3::begin_complex_polygon();
+        fltk3::vertex(4, 4);
+        fltk3::vertex(60, 4);
+        fltk3::vertex(60, 60);
+        fltk3::vertex(4, 60);
+        fltk3::gap();
+        fltk3::vertex(12, 12);
+        fltk3::vertex(28, 12);
+        fltk3::vertex(28, 28);
+        fltk3::vertex(12, 28);
+        fltk3::gap();
+        fltk3::circle(42, 42, 10);
+        fltk3::end_complex_polygon();
+    }, true, kEdgeTolerance);
+    AddCase(cases, "curve/line", 64, 64, [](int, int) {
+        fltk3::begin_line();
+        fltk3::curve(4, 60, 4, 4, 60, 60, 60, 4);
+        fltk3::end_line();
+    });
+    AddCase(cases, "curve/polygon", 64, 64, [](int, int) {
+        fltk3::begin_complex_polygon();
+        fltk3::curve(4, 32, 20, -10, 44, 74, 60, 32);
+        fltk3::vertex(32, 60);
+        fltk3::end_complex_polygon();
+    });
+    
+    static const double kRadii[] = {1, 3.5, 10, 30};
+    for(double r: kRadii) {
+        AddCase(cases, (format("circle/%g") % r).str(), 64, 64, [=](int, int) {
+            fltk3::begin_loop();
+            fltk3::circle(32, 32, r);
+            fltk3::end_loop();
+        });
+        AddCase(cases, (format("circle/%g/filled") % r).str(), 64, 64, [=](int, int) {
+            fltk3::begin_polygon();
+            fltk3::circle(32, 32, r);
+            fltk3::end_polygon();
+        });
+    }
+    
+    static const double kAngles[][2] = {{0, 90}, {45, 270}, {0, 360}, {-90, 30}, {200, 100}};
+    for(auto & angles: kAngles) {
+        double a1 = angles[0], a2 = angles[1];
+        AddCase(cases, (format("arc/%g_%g") % a1 % a2).str(), 64, 64, [=](int, int) {
+            fltk3::arc(4, 4, 56, 56, a1, a2);
+            fltk3::arc(16, 20, 32, 24, a1, a2);
+        });
+        AddCase(cases, (format("pie/%g_%g") % a1 % a2).str(), 64, 64, [=](int, int) {
+            fltk3::pie(4, 12, 56, 40, a1, a2);
+        });
+        AddCase(cases, (format("arc/path/%g_%g") % a1 % a2).str(), 64, 64, [=](int, int) {
+            fltk3::begin_line();
+            fltk3::arc(32.0, 32.0, 24.0, a1, a2);
+            fltk3::end_line();
+        });
+    }
+}
+
+static void AddText(vector<Case> & cases)
+{
+    static const char * kText = "Hamburgefonstiv 0123";
+    static const struct {
+        const char * name;
+        fltk3::Font font;
+    } kFonts[] = {
+        {"helvetica", fltk3::HELVETICA},
+        {"bold", fltk3::HELVETICA + fltk3::BOLD},
+        {"italic", fltk3::HELVETICA + fltk3::ITALIC},
+        {"times", fltk3::TIMES},
+        {"courier", fltk3::COURIER},
+    };
+    static const int kSizes[] = {8, 12, 20, 36};
+    for(auto & font: kFonts)
+    for(int size: kSizes) {
+        fltk3::Font f = font.font;
+        AddCase(cases, (format("text/%s/%d") % font.name % size).str(), 256, 48, [=](int, int h) {
+            fltk3::font(f, size);
+            fltk3::draw(kText, 4, h - 10);
+        });
+    }
+    
+    static const int kAngles[] = {30, 90, 180, 270};
+    for(int angle: kAngles) {
+        AddCase(cases, (format("text/angle/%d") % angle).str(), 128, 128, [=](int w, int h) {
+            fltk3::font(fltk3::HELVETICA, 14);
+            fltk3::draw(angle, kText, strlen(kText), w/2, h/2);
+        });
+    }
+    AddCase(cases, "text/rtl", 256, 48, [](int w, int h) {
+        fltk3::font(fltk3::HELVETICA, 14);
+        fltk3::rtl_draw(kText, strlen(kText), w - 4, h - 10);
+    });
+    AddCase(cases, "text/colors", 256, 48, [](int w, int h) {
+        fltk3::font(fltk3::HELVETICA + fltk3::BOLD, 20);
+        fltk3::color(0, 0, 160);
+        fltk3::rectf(0, h/2, w, h/2);
+        fltk3::color(255, 200, 0);
+        fltk3::draw(kText, 4, h - 12);
+    });
+}
+
+// A pattern with a different value in each channel, for images of every
+// depth
+static uint8_t ImageByte(int x, int y, int c)
+{
+    switch(c) {
+        case 0: return x*17 + y*3;
+        case 1: return y*23;
+        case 2: return (x ^ y)*31;
+        default: return 255 - ((x + y) & 7)*32;
+    }
+}
+
+static void ImageLine(void * data, int x, int y, int w, uchar * buf)
+{
+    int d = *(int *)data;
+    for(int j = 0; j < w; ++j)
+    for(int c = 0; c < d; ++c)
+        buf[d*j + c] = ImageByte(x + j, y, c);
+}
+
+static void AddImages(vector<Case> & cases)
+{
+    // Behind images with alpha, so it shows
+    auto background = [](int w, int h) {
+        fltk3::color(0, 128, 0);
+        fltk3::rectf(w/2, 0, w/2, h);
+    };
+    
+    static const int kSizes[][2] = {{1, 1}, {13, 7}, {56, 40}};
+    static const int kDepths[] = {1, 2, 3, 4, -3};
+    static const struct {
+        const char * name;
+        int padding;// bytes after each row
+        bool flip;// a negative stride, so drawn bottom row first
+    } kStrides[] = {
+        {"packed", 0, false},
+        {"padded", 5, false},
+        {"flipped", 0, true},
+    };
+    for(auto & size: kSizes)
+    for(int d: kDepths)
+    for(auto & stride: kStrides) {
+        int iw = size[0], ih = size[1], depth = abs(d);
+        int L = iw*depth + stride.padding;
+        auto pixels = make_shared<vector<uint8_t> >(L*ih);
+        for(int y = 0; y < ih; ++y)
+        for(int x = 0; x < iw; ++x)
+        for(int c = 0; c < depth; ++c)
+            (*pixels)[y*L + x*depth + c] = ImageByte(x, y, c);
+    
+        // Pixels are reached from the first by D and L, so with negative
+        // ones that's the last in memory
+        const uint8_t * first = &(*pixels)[0];
+        if(d < 0)
+            first += (iw - 1)*depth;
+        if(stride.flip)
+            first += (ih - 1)*L;
+        int D = d, stepL = stride.flip? -L : L;
+        string name = (format("image/%dx%d/%d/%s") % iw % ih % d % stride.name).str();
+        AddCase(cases, name, 64, 48, [=](int w, int h) {
+            background(w, h);
+            (void)pixels;// kept alive with the case
+            fltk3::draw_image(first, 4, 4, iw, ih, D, stepL);
+        });
+    }
+    
+    static const int kCallbackDepths[] = {1, 3, 4};
+    for(int d: kCallbackDepths) {
+        AddCase(cases, (format("image/callback/%d") % d).str(), 64, 48, [=](int w, int h) {
+            background(w, h);
+            int depth = d;
+            fltk3::draw_image(ImageLine, &depth, 4, 4, 56, 40, depth);
+        });
+    }
+    AddCase(cases, "image/edges", 64, 48, [](int w, int h) {
+        int depth = 3;
+        fltk3::draw_image(ImageLine, &depth, -20, -10, 40, 30, depth);
+        fltk3::draw_image(ImageLine, &depth, w - 20, h - 20, 40, 30, depth);
+    });
+    
+    // Negative strides over every edge, drawn from the right or bottom
+    auto flipped = make_shared<vector<uint8_t> >(40*30*3);
+    for(int y = 0; y < 30; ++y)
+    for(int x = 0; x < 40; ++x)
+    for(int c = 0; c < 3; ++c)
+        (*flipped)[3*(40*y + x) + c] = ImageByte(x, y, c);
+    AddCase(cases, "image/edges/flipped", 64, 48, [=](int w, int h) {
+        const uint8_t * last = &(*flipped)[flipped->size() - 3];
+        fltk3::draw_image(last, -20, -10, 40, 30, -3, -40*3);
+        fltk3::draw_image(last, w - 20, -10, 40, 30, -3, -40*3);
+        fltk3::draw_image(last, -20, h - 20, 40, 30, -3, -40*3);
+        fltk3::draw_image(last, w - 20, h - 20, 40, 30, -3, -40*3);
+    });
+}
+
+// Something of everything that's clipped, over the whole canvas
+static void ClipFigure(int w, int h)
+{
+    fltk3::color(0, 0, 200);
+    fltk3::rectf(0, 0, w, h/2);
+    fltk3::color(200, 0, 0);
+    fltk3::begin_polygon();
+    fltk3::circle(w/2, h/2, w/3);
+    fltk3::end_polygon();
+    fltk3::color(0, 0, 0);
+    fltk3::line_style(fltk3::SOLID, 3);
+    fltk3::line(0, 0, w, h);
+    fltk3::line(0, h, w, 0);
+    fltk3::line_style(0);
+    int depth = 3;
+    fltk3::draw_image(ImageLine, &depth, w/4, h/2, w/2, h/4, depth);
+    fltk3::font(fltk3::HELVETICA, 12);
+    fltk3::draw("Clipped", 2, h - 4);
+}
+
+static void AddClips(vector<Case> & cases)
+{
+    AddCase(cases, "clip/rect", 64, 64, [](int w, int h) {
+        fltk3::push_clip(10, 14, 37, 29);
+        ClipFigure(w, h);
+        fltk3::pop_clip();
+    });
+    AddCase(cases, "clip/nested", 64, 64, [](int w, int h) {
+        fltk3::push_clip(6, 6, 40, 40);
+        fltk3::push_clip(22, 22, 40, 40);
+        ClipFigure(w, h);
+        fltk3::pop_clip();
+        fltk3::color(0, 160, 0);
+        fltk3::rectf(0, 40, 64, 4);
+        fltk3::pop_clip();
+    });
+    AddCase(cases, "clip/none", 64, 64, [](int w, int h) {
+        fltk3::push_clip(20, 20, 8, 8);
+        fltk3::push_no_clip();
+        ClipFigure(w, h);
+        fltk3::pop_clip();
+        fltk3::pop_clip();
+    });
+    AddCase(cases, "clip/empty", 64, 64, [](int w, int h) {
+        fltk3::push_clip(20, 20, 0, 0);
+        ClipFigure(w, h);
+        fltk3::pop_clip();
+    });
+    AddCase(cases, "clip/outside", 64, 64, [](int w, int h) {
+        fltk3::push_clip(-10, 40, 100, 100);
+        ClipFigure(w, h);
+        fltk3::pop_clip();
+    });
+    
+    static const int kGrids[] = {1, 2, 4, 8};
+    for(int n: kGrids) {
+        AddCase(cases, (format("clip/rects/%d") % (n*n)).str(), 64, 64, [=](int w, int h) {
+            // A checkerboard of n*n squares
+            vector<fltk3::Rectangle> rects;
+            int s = w/(2*n);
+            for(int y = 0; y < 2*n; ++y)
+            for(int x = (y & 1); x < 2*n; x += 2)
+                rects.push_back(fltk3::Rectangle(x*s, y*s, s, s));
+            PushClipRects(&rects[0], rects.size());
+            ClipFigure(w, h);
+            fltk3::pop_clip();
+        });
+    }
+    AddCase(cases, "clip/rects/overlapping", 64, 64, [](int w, int h) {
+        fltk3::Rectangle rects[] = {
+            fltk3::Rectangle(4, 4, 30, 30),
+            fltk3::Rectangle(20, 20, 30, 30),
+            fltk3::Rectangle(10, 40, 50, 6),
+        };
+        fltk3::push_clip(8, 0, 50, 64);
+        PushClipRects(rects, 3);
+        ClipFigure(w, h);
+        fltk3::pop_clip();
+        fltk3::pop_clip();
+    });
+    
+    // SW_GraphicsDriver has no path clips
+    AddCase(cases, "clip/path/star", 64, 64, [](int w, int h) {
+        GL_GraphicsDriver * glgd = GL_GraphicsDriver::current();
+        fltk3::begin_complex_polygon();
+        for(int j = 0; j < 5; ++j)
+            fltk3::vertex(32 + 30*cos(-M_PI/2 + 4*M_PI*j/5), 32 + 30*sin(-M_PI/2 + 4*M_PI*j/5));
+        glgd->push_clip_path();
+        ClipFigure(w, h);
+        fltk3::pop_clip();
+    }, false);
+    AddCase(cases, "clip/path/nested", 64, 64, [](int w, int h) {
+        GL_GraphicsDriver * glgd = GL_GraphicsDriver::current();
+        fltk3::push_clip(0, 0, 40, 64);
+        fltk3::begin_complex_polygon();
+        fltk3::circle(32, 32, 28);
+        fltk3::gap();
+        fltk3::circle(32, 32, 12);
+        glgd->push_clip_path();
+        ClipFigure(w, h);
+        fltk3::pop_clip();
+        fltk3::pop_clip();
+    }, false);
+}
+
+// A filled shape, strokes and a circle about the origin, to transform
+static void TransformFigure()
+{
+    fltk3::color(200, 0, 0);
+    fltk3::begin_complex_polygon();
+    fltk3::vertex(-20, -4);
+    fltk3::vertex(4, -4);
+    fltk3::vertex(4, -14);
+    fltk3::vertex(22, 0);
+    fltk3::vertex(4, 14);
+    fltk3::vertex(4, 4);
+    fltk3::vertex(-20, 4);
+    fltk3::end_complex_polygon();
+    fltk3::color(0, 0, 0);
+    fltk3::line_style(fltk3::SOLID, 2);
+    fltk3::begin_loop();
+    fltk3::vertex(-24, -20);
+    fltk3::vertex(24, -20);
+    fltk3::vertex(24, 20);
+    fltk3::vertex(-24, 20);
+    fltk3::end_loop();
+    fltk3::line_style(0);
+    fltk3::begin_line();
+    fltk3::circle(-14, 12, 5);
+    fltk3::end_line();
+    fltk3::begin_points();
+    for(int j = 0; j < 5; ++j)
+        fltk3::vertex(10 + 2*j, -16);
+    fltk3::end_points();
+}
+
+static void AddTransforms(vector<Case> & cases)
+{
+    static const struct {
+        const char * name;
+        void (*transform)();
+    } kTransforms[] = {
+        {"identity", []{}},
+        {"translate", []{fltk3::translate(3.5, -2.25);}},
+        {"scale/2", []{fltk3::scale(2, 2);}},
+        {"scale/0.5", []{fltk3::scale(0.5, 0.5);}},
+        {"scale/1.3x0.7", []{fltk3::scale(1.3, 0.7);}},
+        {"mirror", []{fltk3::scale(-1, 1);}},
+        {"rotate/30", []{fltk3::rotate(30);}},
+        {"rotate/90", []{fltk3::rotate(90);}},
+        {"rotate/-135", []{fltk3::rotate(-135);}},
+        {"rotate-scale", []{fltk3::rotate(20); fltk3::scale(1.2, 0.8);}},
+    };
+    for(auto & t: kTransforms) {
+        void (*transform)() = t.transform;
+        AddCase(cases, (format("transform/%s") % t.name).str(), 64, 64, [=](int w, int h) {
+            fltk3::push_matrix();
+            fltk3::translate(w/2, h/2);
+            transform();
+            TransformFigure();
+            fltk3::pop_matrix();
+        });
+    }
+    AddCase(cases, "transform/nested", 64, 64, [](int w, int h) {
+        fltk3::push_matrix();
+        fltk3::translate(w/2, h/2);
+        fltk3::scale(0.5, 0.5);
+        for(int j = 0; j < 4; ++j) {
+            fltk3::push_matrix();
+            fltk3::rotate(90*j);
+            fltk3::translate(28, 0);
+            TransformFigure();
+            fltk3::pop_matrix();
+        }
+        fltk3::pop_matrix();
+    });
+    AddCase(cases, "transform/transformed_vertex", 64, 64, [](int, int) {
+        fltk3::push_matrix();
+        fltk3::rotate(45);
+        fltk3::begin_line();
+        for(int j = 0; j < 8; ++j) {
+            fltk3::transformed_vertex(8 + j*6, 8);
+            fltk3::transformed_vertex(8 + j*6, 56);
+        }
+        fltk3::end_line();
+        fltk3::pop_matrix();
+    });
+}
+
+// Many primitives at once, where render times mean more than in the cases
+// above
+static void AddLoads(vector<Case> & cases)
+{
+    AddCase(cases, "load/lines", 256, 256, [](int w, int h) {
+        uint32_t seed = 1;
+        for(int j = 0; j < 2000; ++j) {
+            fltk3::color(Random(seed) & 255, Random(seed) & 255, Random(seed) & 255);
+            fltk3::line(Random(seed)%w, Random(seed)%h, Random(seed)%w, Random(seed)%h);
+        }
+    });
+    AddCase(cases, "load/rects", 256, 256, [](int w, int h) {
+        uint32_t seed = 2;
+        for(int j = 0; j < 2000; ++j) {
+            fltk3::color(Random(seed) & 255, Random(seed) & 255, Random(seed) & 255);
+            fltk3::rectf(Random(seed)%w, Random(seed)%h, Random(seed)%32, Random(seed)%32);
+        }
+    });
+    AddCase(cases, "load/polygons", 256, 256, [](int w, int h) {
+        uint32_t seed = 3;
+        for(int j = 0; j < 500; ++j) {
+            fltk3::color(Random(seed) & 255, Random(seed) & 255, Random(seed) & 255);
+            double x = Random(seed)%w, y = Random(seed)%h;
+            fltk3::begin_complex_polygon();
+            for(int k = 0; k < 6; ++k)
+                fltk3::vertex(x + (int)(Random(seed)%41) - 20, y + (int)(Random(seed)%41) - 20);
+            fltk3::end_complex_polygon();
+        }
+    });
+    AddCase(cases, "load/text", 256, 256, [](int, int h) {
+        fltk3::font(fltk3::HELVETICA, 12);
+        for(int y = 12; y < h; y += 14)
+            fltk3::draw("The quick brown fox jumps over the lazy dog", 2, y);
+    });
+}
+
+static const vector<Case> & Cases()
+{
+    static vector<Case> cases;
+    if(cases.empty()) {
+        AddRects(cases);
+        AddLines(cases);
+        AddShapes(cases);
+        AddText(cases);
+        AddImages(cases);
+        AddClips(cases);
+        AddTransforms(cases);
+        AddLoads(cases);
+    }
+    return cases;
+}
+
+
+// ****************************************************************************
+// Running cases
+// ****************************************************************************
+
+// Draw c with whichever driver is installed, over white
+static void Draw(const Case & c)
+{
+    fltk3::color(255, 255, 255);
+    fltk3::rectf(0, 0, c.w, c.h);
+    fltk3::color(0, 0, 0);
+    c.draw(c.w, c.h);
+    fltk3::line_style(0);
+}
+
+// Milliseconds per run(), in the best of a few batches each run as often as
+// it takes to measure, so the odd slow one doesn't count
+template<typename fn_t, typename finish_t>
+static double TimeRuns(const fn_t & run, const finish_t & finish)
+{
+    const int kBatches = 3, kMinRuns = 2, kMaxRuns = 100;
+    const double kMinSeconds = 0.01;
+    double best = INFINITY;
+    for(int batch = 0; batch < kBatches; ++batch) {
+        int runs = 0;
+        auto t0 = Clock::now();
+        do {
+            run();
+            ++runs;
+        } while(runs < kMaxRuns && (runs < kMinRuns || Seconds(t0) < kMinSeconds));
+        finish();
+        best = min(best, 1000*Seconds(t0)/runs);
+    }
+    return best;
+}
+
+// Draw c with a GL_GraphicsDriver into an offscreen the size of c, antialiased
+// by coverage as SW_GraphicsDriver is, and read it back top down. Returns the
+// time per frame.
+static double RenderGL(const Case & c, vector<uint8_t> & rgba)
+{
+    fltk3::Offscreen off = GL_Offscreen::create(c.w, c.h);
+    auto run = [&](bool read) {
+        GL_Offscreen::begin(off);
+        GL_GraphicsDriver * glgd = GL_GraphicsDriver::current();
+        glgd->antialiasing(GL_GraphicsDriver::COVERAGE_AA);
+        Draw(c);
+        if(read) {
+            glgd->flush();
+            vector<uint8_t> rows(4*c.w*c.h);
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            glReadPixels(0, 0, c.w, c.h, GL_RGBA, GL_UNSIGNED_BYTE, &rows[0]);
+            rgba.resize(rows.size());
+            for(int y = 0; y < c.h; ++y)
+                copy(&rows[4*c.w*(c.h - 1 - y)], &rows[4*c.w*(c.h - y)], &rgba[4*c.w*y]);
+        }
+        GL_Offscreen::end();
+    };
+    // The first run is read, and fills caches before the timed ones
+    run(true);
+    double ms = TimeRuns([&]{run(false);}, []{glFinish();});
+    GL_Offscreen::destroy(off);
+    return ms;
+}
+
+// Draw c with SW_GraphicsDriver, rasterized on the shared WorkerPool. Returns
+// the time per frame.
+static double RenderSW(const Case & c, vector<uint8_t> & rgba)
+{
+    fltk3::Rectangle rect(c.w, c.h);
+    vector<uint8_t> pixels(4*c.w*c.h);
+    auto run = [&](uint8_t * into) {
+        SW_GraphicsDriver swgd(&rect, into);
+        Draw(c);
+    };
+    rgba.assign(pixels.size(), 0);
+    run(&rgba[0]);
+    return TimeRuns([&]{run(&pixels[0]);}, []{});
+}
+
+// Golden image files are named for the case, with its slashes as dashes
+static string GoldenPath(const string & dir, const Case & c, const char * driver, const char * suffix = "")
+{
+    string name = c.name;
+    replace(name.begin(), name.end(), '/', '-');
+    return (format("%s/%s.%s%s.pam") % dir % name % driver % suffix).str();
+}
+
+// A driver's times are a line per case of its name and milliseconds
+static string TimesPath(const string & dir, const char * driver)
+{
+    return (format("%s/times.%s.txt") % dir % driver).str();
+}
+
+static map<string, double> LoadTimes(const string & path)
+{
+    map<string, double> times;
+    FILE * f = fopen(path.c_str(), "r");
+    if(!f)
+        return times;
+    char name[256];
+    double ms;
+    while(fscanf(f, "%255s %lf", name, &ms) == 2)
+        times[name] = ms;
+    fclose(f);
+    return times;
+}
+
+static bool SaveTimes(const string & path, const map<string, double> & times)
+{
+    FILE * f = fopen(path.c_str(), "w");
+    if(!f)
+        return false;
+    for(auto & t: times)
+        fprintf(f, "%s %.4f\n", t.first.c_str(), t.second);
+    return fclose(f) == 0;
+}
+
+// Compare w*h images a and b, and say whether they're within t
+static bool Compare(const vector<uint8_t> & a, const vector<uint8_t> & b, int w, int h,
+                    const Tolerance & t, imagediff::Result & r, vector<uint8_t> * difference = nullptr)
+{
+    imagediff::Options options;
+    options.threshold = t.threshold;
+    options.ssim = false;
+    if(difference)
+        difference->resize(4*w*h);
+    r = imagediff::compare(imagediff::top_down(&a[0], w, h, 4), imagediff::top_down(&b[0], w, h, 4),
+                           options, difference? &(*difference)[0] : nullptr);
+    return r.differing <= t.pixels*w*h && r.psnr >= t.psnr;
+}
+
+// w*h RGBA pixels averaged in 2x2 blocks, dropping an odd last row or column
+static vector<uint8_t> Halve(const vector<uint8_t> & rgba, int w, int h)
+{
+    int hw = w/2, hh = h/2;
+    vector<uint8_t> half(4*hw*hh);
+    for(int y = 0; y < hh; ++y)
+    for(int x = 0; x < hw; ++x)
+    for(int c = 0; c < 4; ++c) {
+        const uint8_t * p = &rgba[4*(2*y*w + 2*x) + c];
+        half[4*(y*hw + x) + c] = (p[0] + p[4] + p[4*w] + p[4*w + 4] + 2)/4;
+    }
+    return half;
+}
+
+// Check rgba against the driver's golden, or write it if update, or if it's
+// missing and record. Returns a column for the report, starting with '!' if
+// it fails.
+static string CheckGolden(const string & dir, const Case & c, const char * driver,
+                          const vector<uint8_t> & rgba, bool update, bool record, bool & failed)
+{
+    string path = GoldenPath(dir, c, driver);
+    vector<uint8_t> golden;
+    int gw, gh;
+    bool missing = !update && !LoadPAM(path, golden, gw, gh);
+    if(update || (missing && record)) {
+        if(SavePAM(path, rgba, c.w, c.h))
+            return update? "written" : "recorded";
+        failed = true;
+        return "!unwritable";
+    }
+    if(missing) {
+        failed = true;
+        return "!missing";
+    }
+    if(gw != c.w || gh != c.h) {
+        failed = true;
+        return "!size";
+    }
+    vector<uint8_t> difference;
+    imagediff::Result r;
+    bool within = Compare(rgba, golden, c.w, c.h, kGoldenTolerance, r, &difference);
+    string column = r.identical()? "same" : (format("%.1f dB") % r.psnr).str();
+    if(!within) {
+        // Kept next to the golden to look at
+        SavePAM(GoldenPath(dir, c, driver, ".out"), rgba, c.w, c.h);
+        SavePAM(GoldenPath(dir, c, driver, ".diff"), difference, c.w, c.h);
+        failed = true;
+        column = "!" + column;
+    }
+    return column;
+}
+
+int RunGoldens(const std::string & dir, bool update, const std::string & filter, std::ostream & out)
+{
+    if(!GL_HaveFramebuffers()) {
+        out << "Needs framebuffer objects" << endl;
+        return -1;
+    }
+    
+    // Core profiles draw through another pipeline, so have goldens and times
+    // of their own
+    const char * glName = GL_CoreProfile()? "glcore" : "gl";
+    map<string, double> glTimes = LoadTimes(TimesPath(dir, glName));
+    map<string, double> swTimes = LoadTimes(TimesPath(dir, "sw"));
+    bool timesChanged = update;
+    int run = 0, failures = 0, slow = 0;
+    out << format("%-32s %9s %9s %9s %9s  %-10s %-10s %-10s\n")
+        % "case" % "GL ms" % "was" % "SW ms" % "was" % "GL golden" % "SW golden" % "GL vs SW";
+    for(const Case & c: Cases()) {
+        if(c.name.compare(0, filter.size(), filter) != 0)
+            continue;
+        ++run;
+    
+        vector<uint8_t> gl, sw;
+        double glMs = RenderGL(c, gl), swMs = -1;
+        if(c.software)
+            swMs = RenderSW(c, sw);
+    
+        bool failed = false;
+        // GL goldens are particular to the machine, see goldens.h
+        string glColumn = CheckGolden(dir, c, glName, gl, update, true, failed);
+        string swColumn = "-", vsColumn = "-";
+        if(c.software) {
+            swColumn = CheckGolden(dir, c, "sw", sw, update, false, failed);
+            imagediff::Result r;
+            bool within = Compare(Halve(gl, c.w, c.h), Halve(sw, c.w, c.h), c.w/2, c.h/2, c.drivers, r);
+            vsColumn = (format("%.1f dB") % r.psnr).str();
+            if(!within) {
+                failed = true;
+                vsColumn = "!" + vsColumn;
+            }
+        }
+    
+        // Slower than recorded, by enough not to be noise. Times not
+        // recorded yet are.
+        bool slower = false;
+        auto compare = [&](map<string, double> & times, double ms) {
+            auto recorded = times.find(c.name);
+            double was = (recorded != times.end())? recorded->second : -1;
+            if(was >= 0 && !update)
+                slower = slower || (ms > was*kSlowdown && ms > was + kSlowMs);
+            if(update || was < 0) {
+                times[c.name] = ms;
+                timesChanged = true;
+            }
+            return was;
+        };
+        double wasGL = compare(glTimes, glMs), wasSW = -1;
+        if(c.software)
+            wasSW = compare(swTimes, swMs);
+    
+        auto ms = [](double t) {return (t < 0)? string("-") : (format("%.3f") % t).str();};
+        const char * status = failed? "FAIL" : slower? "SLOW" : "ok";
+        out << format("%-32s %9s %9s %9s %9s  %-10s %-10s %-10s %s\n")
+            % c.name % ms(glMs) % ms(wasGL) % ms(swMs) % ms(wasSW) % glColumn % swColumn % vsColumn % status;
+        failures += failed;
+        slow += slower;
+    }
+    
+    if(timesChanged) {
+        for(auto & t: {make_pair(glName, &glTimes), make_pair("sw", &swTimes)}) {
+            string path = TimesPath(dir, t.first);
+            if(!SaveTimes(path, *t.second)) {
+                out << "Can't write " << path << endl;
+                ++failures;
+            }
+        }
+    }
+    out << format("%d cases, %d failed, %d slower than recorded\n") % run % failures % slow;
+    return failures;
+}
+
+void ListGoldens(std::ostream & out)
+{
+    for(const Case & c: Cases())
+        out << format("  %-32s %dx%d%s\n") % c.name % c.w % c.h % (c.software? "" : ", GL only");
+}
+
+
+// ****************************************************************************
+// PAM images
+// ****************************************************************************
+
+bool SavePAM(const std::string & path, const std::vector<uint8_t> & rgba, int w, int h)
+{
+    FILE * f = fopen(path.c_str(), "wb");
+    if(!f)
+        return false;
+    fprintf(f, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", w, h);
+    bool ok = fwrite(&rgba[0], 1, rgba.size(), f) == rgba.size();
+    return fclose(f) == 0 && ok;
+}
+
+bool LoadPAM(const std::string & path, std::vector<uint8_t> & rgba, int & w, int & h)
+{
+    FILE * f = fopen(path.c_str(), "rb");
+    if(!f)
+        return false;
+    
+    char line[256];
+    int depth = 0, maxval = 0;
+    w = h = 0;
+    bool ok = fgets(line, sizeof(line), f) && strncmp(line, "P7", 2) == 0;
+    while(ok) {
+        if(!fgets(line, sizeof(line), f)) {
+            ok = false;
+            break;
+        }
+        if(strncmp(line, "ENDHDR", 6) == 0)
+            break;
+        sscanf(line, "WIDTH %d", &w);
+        sscanf(line, "HEIGHT %d", &h);
+        sscanf(line, "DEPTH %d", &depth);
+        sscanf(line, "MAXVAL %d", &maxval);
+    }
+    ok = ok && w > 0 && h > 0 && maxval == 255 && (depth == 1 || depth == 3 || depth == 4);
+    
+    vector<uint8_t> pixels;
+    if(ok) {
+        pixels.resize((size_t)depth*w*h);
+        ok = fread(&pixels[0], 1, pixels.size(), f) == pixels.size();
+    }
+    fclose(f);
+    if(!ok)
+        return false;
+    
+    rgba.resize(4*(size_t)w*h);
+    for(size_t j = 0, n = (size_t)w*h; j < n; ++j) {
+        const uint8_t * src = &pixels[depth*j];
+        rgba[4*j] = src[0];
+        rgba[4*j + 1] = src[depth >= 3? 1 : 0];
+        rgba[4*j + 2] = src[depth >= 3? 2 : 0];
+        rgba[4*j + 3] = (depth == 4)? src[3] : 255;
+    }
+    return true;
+}
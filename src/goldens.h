@@ -0,0 +1,42 @@
+#ifndef GOLDENS_H
+#define GOLDENS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Rendering regression checks of GL_GraphicsDriver and SW_GraphicsDriver, run
+// with "fltktest --headless --golden [--dir <dir>] [--update] [filter]" from
+// the top of the tree. Each case draws one primitive family under one set of
+// parameters with both drivers; FLTK's own driver needs a display, so
+// SW_GraphicsDriver stands in for it. Each driver's image is compared with
+// its golden image in dir, and the two drivers' images with each other, each
+// within a tolerance. Images that fail are saved next to their goldens as
+// .out.pam, with a .diff.pam. The time each driver took is compared with the
+// time recorded with the goldens, and reported if it's much slower.
+//
+// With update the goldens and times are written instead of checked. Only
+// cases whose names start with filter are run. Needs a current GL context.
+//
+// SW_GraphicsDriver draws the same on every machine, so its goldens and times
+// are kept with the tree in tests/goldens, the default dir. GL's output
+// varies a little with the GPU and its driver, so its goldens and times are
+// kept only on the machine they're from: any that are missing are recorded
+// instead of checked, so the first run on a machine records them. To record
+// them again after a change to what GL draws, delete tests/goldens/*.gl.pam,
+// *.glcore.pam and times.gl*.txt and run again, once per profile (--core).
+// --update rewrites the SW goldens as well, to be checked in if they changed
+// on purpose.
+
+// Prints a line per case and a summary to out, and returns the number of
+// cases that failed, or -1 if none could be run
+int RunGoldens(const std::string & dir, bool update, const std::string & filter, std::ostream & out);
+void ListGoldens(std::ostream & out);
+
+// w*h RGBA pixels, rows top down, as a PAM image
+bool SavePAM(const std::string & path, const std::vector<uint8_t> & rgba, int w, int h);
+// Reads RGBA, RGB and grayscale PAM images as RGBA, false if it can't
+bool LoadPAM(const std::string & path, std::vector<uint8_t> & rgba, int & w, int & h);
+
+#endif // GOLDENS_H
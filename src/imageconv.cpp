@@ -0,0 +1,249 @@
+
+#include "imageconv.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <smmintrin.h>
+
+namespace imageconv {
+
+struct NamedColor {
+    const char * name;
+    uint8_t r, g, b;
+};
+
+// The X11 colors that turn up in icons. Names are lower case, no spaces.
+static const NamedColor kNamedColors[] = {
+    {"black", 0, 0, 0},
+    {"white", 255, 255, 255},
+    {"red", 255, 0, 0},
+    {"green", 0, 255, 0},
+    {"blue", 0, 0, 255},
+    {"yellow", 255, 255, 0},
+    {"cyan", 0, 255, 255},
+    {"magenta", 255, 0, 255},
+    {"gray", 190, 190, 190},
+    {"grey", 190, 190, 190},
+    {"lightgray", 211, 211, 211},
+    {"lightgrey", 211, 211, 211},
+    {"darkgray", 169, 169, 169},
+    {"darkgrey", 169, 169, 169},
+    {"orange", 255, 165, 0},
+    {"brown", 165, 42, 42},
+    {"navy", 0, 0, 128},
+    {"maroon", 176, 48, 96},
+    {"darkgreen", 0, 100, 0},
+    {"darkblue", 0, 0, 139},
+    {"darkred", 139, 0, 0},
+    {nullptr, 0, 0, 0}
+};
+
+static int HexDigit(char c)
+{
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool ParseColor(const std::string & value, uint8_t * rgba)
+{
+    rgba[0] = rgba[1] = rgba[2] = 0;
+    rgba[3] = 255;
+    
+    if(value[0] == '#') {
+        // 1 to 4 hex digits per channel, keep the top 8 bits
+        int n = (value.size() - 1)/3;
+        if(n < 1 || n > 4 || value.size() != 1 + 3*(size_t)n)
+            return false;
+        for(int c = 0; c < 3; ++c) {
+            int v = 0;
+            for(int j = 0; j < n; ++j) {
+                int digit = HexDigit(value[1 + c*n + j]);
+                if(digit < 0)
+                    return false;
+                v = v*16 + digit;
+            }
+            rgba[c] = (n == 1)? v*17 : v >> (4*n - 8);
+        }
+        return true;
+    }
+    
+    std::string name;
+    for(char c: value)
+        if(!isspace((unsigned char)c))
+            name += tolower((unsigned char)c);
+    
+    if(name == "none" || name == "transparent") {
+        rgba[3] = 0;
+        return true;
+    }
+    int percent;
+    if((sscanf(name.c_str(), "gray%d", &percent) == 1 || sscanf(name.c_str(), "grey%d", &percent) == 1) &&
+       percent >= 0 && percent <= 100)
+    {
+        rgba[0] = rgba[1] = rgba[2] = (percent*255 + 50)/100;
+        return true;
+    }
+    for(const NamedColor * nc = kNamedColors; nc->name; ++nc) {
+        if(name == nc->name) {
+            rgba[0] = nc->r;
+            rgba[1] = nc->g;
+            rgba[2] = nc->b;
+            return true;
+        }
+    }
+    return false;// Unknown, left black
+}
+
+static bool IsColorKey(const std::string & token)
+{
+    return token == "c" || token == "m" || token == "g" || token == "g4" || token == "s";
+}
+
+// Parse the part of a color line after the pixel characters, preferring the
+// color visual ("c") over mono and grayscale.
+static void ParseColorLine(const char * line, uint8_t * rgba)
+{
+    std::vector<std::string> tokens;
+    char token[64];
+    int n;
+    while(sscanf(line, " %63s%n", token, &n) == 1) {
+        tokens.push_back(token);
+        line += n;
+    }
+    
+    std::string best;
+    for(size_t j = 0; j < tokens.size();) {
+        std::string key = tokens[j++];
+        std::string value;
+        while(j < tokens.size() && !IsColorKey(tokens[j])) {
+            if(!value.empty())
+                value += ' ';
+            value += tokens[j++];
+        }
+        if(key == "s" || value.empty())
+            continue;
+        if(best.empty() || key == "c")
+            best = value;
+    }
+    rgba[0] = rgba[1] = rgba[2] = 0;
+    rgba[3] = 255;
+    if(!best.empty())
+        ParseColor(best, rgba);
+}
+
+static uint32_t PixelKey(const char * chars, int cpp)
+{
+    uint32_t key = 0;
+    for(int j = 0; j < cpp; ++j)
+        key = (key << 8) | (uint8_t)chars[j];
+    return key;
+}
+
+bool xpm_to_rgba(const char * const * xpm, int w, int h, uint8_t * rgba)
+{
+    int xw, xh, ncolors, cpp;
+    if(!xpm || sscanf(xpm[0], "%d %d %d %d", &xw, &xh, &ncolors, &cpp) != 4)
+        return false;
+    if(xw != w || xh != h || cpp < 1 || cpp > 4 || ncolors == 0)
+        return false;
+    
+    // Colors by pixel characters. A flat table when there is one character
+    // per pixel, which is most icons.
+    uint32_t table[256];
+    std::unordered_map<uint32_t, uint32_t> colors;
+    memset(table, 0, sizeof(table));
+    const char * const * rows;
+    
+    if(ncolors < 0) {
+        // FLTK's binary colormap. A leading ' ' entry is transparent.
+        if(cpp != 1)
+            return false;
+        ncolors = -ncolors;
+        const uint8_t * p = (const uint8_t *)xpm[1];
+        if(*p == ' ') {
+            table[' '] = 0;
+            p += 4;
+            --ncolors;
+        }
+        for(int j = 0; j < ncolors; ++j, p += 4) {
+            uint8_t * c = (uint8_t *)&table[p[0]];
+            c[0] = p[1];
+            c[1] = p[2];
+            c[2] = p[3];
+            c[3] = 255;
+        }
+        rows = xpm + 2;
+    }
+    else {
+        for(int j = 0; j < ncolors; ++j) {
+            const char * line = xpm[1 + j];
+            if(strlen(line) < (size_t)cpp)
+                return false;
+            uint32_t color;
+            ParseColorLine(line + cpp, (uint8_t *)&color);
+            if(cpp == 1)
+                table[(uint8_t)line[0]] = color;
+            else
+                colors[PixelKey(line, cpp)] = color;
+        }
+        rows = xpm + 1 + ncolors;
+    }
+    
+    uint32_t * dst = (uint32_t *)rgba;
+    for(int y = 0; y < h; ++y) {
+        const char * row = rows[y];
+        if(!row || strlen(row) < (size_t)w*cpp)
+            return false;
+        if(cpp == 1) {
+            for(int x = 0; x < w; ++x)
+                *dst++ = table[(uint8_t)row[x]];
+        }
+        else {
+            for(int x = 0; x < w; ++x, row += cpp) {
+                auto c = colors.find(PixelKey(row, cpp));
+                *dst++ = (c != colors.end())? c->second : 0;
+            }
+        }
+    }
+    return true;
+}
+
+void bits_to_rgba(const uint8_t * bits, int w, int h, uint8_t * rgba)
+{
+    // 16 pixels at a time: spread the two source bytes over eight lanes each,
+    // test one bit per lane, then interleave the lane masks with white.
+    const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i bitMask = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i white = _mm_set1_epi8(-1);
+    
+    int stride = (w + 7)/8;
+    for(int y = 0; y < h; ++y) {
+        const uint8_t * src = bits + y*stride;
+        uint8_t * dst = rgba + 4*y*w;
+        int x = 0;
+        for(; x + 16 <= w; x += 16, dst += 64) {
+            __m128i b = _mm_cvtsi32_si128(src[x >> 3] | (src[(x >> 3) + 1] << 8));
+            b = _mm_shuffle_epi8(b, spread);
+            __m128i alpha = _mm_cmpeq_epi8(_mm_and_si128(b, bitMask), bitMask);
+            __m128i lo = _mm_unpacklo_epi8(white, alpha);// 8 x (ff, a)
+            __m128i hi = _mm_unpackhi_epi8(white, alpha);
+            _mm_storeu_si128((__m128i *)(dst + 0), _mm_unpacklo_epi16(white, lo));
+            _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(white, lo));
+            _mm_storeu_si128((__m128i *)(dst + 32), _mm_unpacklo_epi16(white, hi));
+            _mm_storeu_si128((__m128i *)(dst + 48), _mm_unpackhi_epi16(white, hi));
+        }
+        for(; x < w; ++x, dst += 4) {
+            dst[0] = dst[1] = dst[2] = 255;
+            dst[3] = (src[x >> 3] & (1 << (x & 7)))? 255 : 0;
+        }
+    }
+}
+
+} // namespace imageconv
@@ -0,0 +1,22 @@
+
+#ifndef IMAGECONV_H
+#define IMAGECONV_H
+
+#include <cstdint>
+
+// Conversion of FLTK's indexed image formats to RGBA for upload as textures
+namespace imageconv {
+
+// Decode an XPM, including FLTK's binary colormap variant (negative color
+// count, one string of index, r, g, b bytes). Transparent colors ("None")
+// become zero alpha. rgba must hold 4*w*h bytes, with w and h from the XPM
+// header. Returns false for malformed data.
+bool xpm_to_rgba(const char * const * xpm, int w, int h, uint8_t * rgba);
+
+// Expand an XBM-style bitmap (rows padded to whole bytes, least significant
+// bit leftmost) to white, with alpha 255 for set bits and 0 for clear bits.
+void bits_to_rgba(const uint8_t * bits, int w, int h, uint8_t * rgba);
+
+} // namespace imageconv
+
+#endif // IMAGECONV_H
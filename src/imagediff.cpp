@@ -0,0 +1,266 @@
+
+#include "imagediff.h"
+#include "WorkerPool.h"
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace imagediff {
+
+// Rows worked on at a time, and the side of the blocks SSIM is taken over
+static const int kBand = 8;
+// Bands handed to a worker at a time
+static const int kBandsPerChunk = 4;
+
+// SSIM's stabilizing constants, for 8 bit values
+static const double kC1 = (0.01*255)*(0.01*255);
+static const double kC2 = (0.03*255)*(0.03*255);
+
+// A band's share of the result
+struct Partial {
+    uint64_t sum[3];
+    uint64_t sumSq;
+    int max[3];
+    size_t differing;
+    int x0, y0, x1, y1;
+    double ssim;
+    size_t blocks;
+};
+
+int Result::max_error() const
+{
+    return std::max(max[0], std::max(max[1], max[2]));
+}
+
+// Row y of img, counting from the top
+static const uint8_t * Row(const Image & img, int y)
+{
+    ptrdiff_t stride = img.stride? img.stride : (ptrdiff_t)img.w*img.depth;
+    int row = img.bottom_up? img.h - 1 - y : y;
+    return img.pixels + row*stride;
+}
+
+// Row y of img as RGBA, expanded into buf if it's RGB
+static const uint8_t * RGBARow(const Image & img, int y, uint8_t * buf)
+{
+    const uint8_t * src = Row(img, y);
+    if(img.depth == 4)
+        return src;
+    for(int x = 0; x < img.w; ++x) {
+        buf[4*x] = src[3*x];
+        buf[4*x + 1] = src[3*x + 1];
+        buf[4*x + 2] = src[3*x + 2];
+        buf[4*x + 3] = 255;
+    }
+    return buf;
+}
+
+// Differences along n RGBA pixels of row y into p, and their absolute
+// values into diff if it isn't null
+static void DiffRow(const uint8_t * a, const uint8_t * b, int n, int y, int threshold,
+                    Partial & p, uint8_t * diff)
+{
+    int x = 0;
+    int first = n, last = -1;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+    const __m128i thresh = _mm_set1_epi8((char)min(max(threshold, 0), 255));
+    __m128i maxima = zero;
+    while(x + 4 <= n) {
+        // Sums of 16 bit lanes, one channel each, can take 128 steps of
+        // two pixels a lane before they could overflow
+        __m128i sums = zero, squares = zero;
+        int end = min(n, x + 4*128);
+        for(; x + 4 <= end; x += 4) {
+            __m128i va = _mm_loadu_si128((const __m128i *)(a + 4*x));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(b + 4*x));
+            __m128i d = _mm_and_si128(_mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va)), rgb);
+            if(diff)
+                _mm_storeu_si128((__m128i *)(diff + 4*x), _mm_or_si128(d, alpha));
+            maxima = _mm_max_epu8(maxima, d);
+    
+            __m128i lo = _mm_unpacklo_epi8(d, zero), hi = _mm_unpackhi_epi8(d, zero);
+            sums = _mm_add_epi16(sums, _mm_add_epi16(lo, hi));
+            squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+    
+            // Pixels with any channel over the threshold
+            __m128i over = _mm_cmpeq_epi32(_mm_subs_epu8(d, thresh), zero);
+            int mask = ~_mm_movemask_ps(_mm_castsi128_ps(over)) & 0xF;
+            if(mask) {
+                for(int k = 0; k < 4; ++k) {
+                    if(mask & (1 << k)) {
+                        ++p.differing;
+                        first = min(first, x + k);
+                        last = x + k;
+                    }
+                }
+            }
+        }
+        uint16_t s[8];
+        uint32_t sq[4];
+        _mm_storeu_si128((__m128i *)s, sums);
+        _mm_storeu_si128((__m128i *)sq, squares);
+        for(int c = 0; c < 3; ++c)
+            p.sum[c] += s[c] + s[c + 4];
+        p.sumSq += (uint64_t)sq[0] + sq[1] + sq[2] + sq[3];
+    }
+    uint8_t m[16];
+    _mm_storeu_si128((__m128i *)m, maxima);
+    for(int j = 0; j < 16; ++j) {
+        if(j%4 < 3)
+            p.max[j%4] = max(p.max[j%4], (int)m[j]);
+    }
+#endif
+    for(; x < n; ++x) {
+        int pixelMax = 0;
+        for(int c = 0; c < 3; ++c) {
+            int d = abs((int)a[4*x + c] - (int)b[4*x + c]);
+            p.sum[c] += d;
+            p.sumSq += d*d;
+            p.max[c] = max(p.max[c], d);
+            pixelMax = max(pixelMax, d);
+            if(diff)
+                diff[4*x + c] = d;
+        }
+        if(diff)
+            diff[4*x + 3] = 255;
+        if(pixelMax > threshold) {
+            ++p.differing;
+            first = min(first, x);
+            last = x;
+        }
+    }
+    
+    if(last >= 0) {
+        p.x0 = min(p.x0, first);
+        p.x1 = max(p.x1, last + 1);
+        p.y0 = min(p.y0, y);
+        p.y1 = y + 1;
+    }
+}
+
+// Luma of n RGBA pixels, by Rec. 601 weights
+static void Luma(const uint8_t * rgba, int n, uint8_t * luma)
+{
+    for(int x = 0; x < n; ++x)
+        luma[x] = (77*rgba[4*x] + 150*rgba[4*x + 1] + 29*rgba[4*x + 2]) >> 8;
+}
+
+// SSIM of the rows blocks of w luma values in a and b, summed over blocks
+static void SSIMBlocks(const uint8_t * a, const uint8_t * b, int w, int rows, Partial & p)
+{
+    for(int bx = 0; bx < w; bx += kBand) {
+        int bw = min(kBand, w - bx);
+        uint32_t sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+        for(int y = 0; y < rows; ++y)
+        for(int x = bx; x < bx + bw; ++x) {
+            uint32_t va = a[y*w + x], vb = b[y*w + x];
+            sa += va;
+            sb += vb;
+            saa += va*va;
+            sbb += vb*vb;
+            sab += va*vb;
+        }
+        double n = bw*rows;
+        double ma = sa/n, mb = sb/n;
+        double va = saa/n - ma*ma, vb = sbb/n - mb*mb, cov = sab/n - ma*mb;
+        p.ssim += ((2*ma*mb + kC1)*(2*cov + kC2))/((ma*ma + mb*mb + kC1)*(va + vb + kC2));
+        ++p.blocks;
+    }
+}
+
+Result compare(const Image & a, const Image & b, const Options & options, uint8_t * difference)
+{
+    Result r;
+    if(a.w != b.w || a.h != b.h || a.w <= 0 || a.h <= 0) {
+        // Nothing in common
+        for(int c = 0; c < 3; ++c) {
+            r.mean[c] = 255;
+            r.max[c] = 255;
+        }
+        r.mse = 255*255;
+        r.psnr = 0;
+        r.ssim = 0;
+        r.x0 = r.y0 = 0;
+        r.x1 = max(a.w, b.w);
+        r.y1 = max(a.h, b.h);
+        r.differing = (size_t)r.x1*r.y1;
+        return r;
+    }
+    
+    int w = a.w, h = a.h;
+    int bands = (h + kBand - 1)/kBand;
+    vector<Partial> partials(bands);
+    auto work = [&](int begin, int end) {
+        vector<uint8_t> rowA(4*w), rowB(4*w), lumaA(kBand*w), lumaB(kBand*w);
+        for(int band = begin; band < end; ++band) {
+            Partial & p = partials[band];
+            p = Partial();
+            p.x0 = w;
+            p.y0 = h;
+            p.x1 = p.y1 = 0;
+            int y0 = band*kBand, rows = min(kBand, h - y0);
+            for(int y = y0; y < y0 + rows; ++y) {
+                const uint8_t * ra = RGBARow(a, y, &rowA[0]);
+                const uint8_t * rb = RGBARow(b, y, &rowB[0]);
+                DiffRow(ra, rb, w, y, options.threshold, p, difference? difference + 4*(size_t)w*y : nullptr);
+                if(options.ssim) {
+                    Luma(ra, w, &lumaA[(y - y0)*w]);
+                    Luma(rb, w, &lumaB[(y - y0)*w]);
+                }
+            }
+            if(options.ssim)
+                SSIMBlocks(&lumaA[0], &lumaB[0], w, rows, p);
+        }
+    };
+    if(options.pool)
+        options.pool->parallel_for(bands, kBandsPerChunk, work);
+    else
+        work(0, bands);
+    
+    // Summed in order, so the result is the same however it was split
+    uint64_t sum[3] = {0, 0, 0}, sumSq = 0;
+    double ssim = 0;
+    size_t blocks = 0;
+    r.differing = 0;
+    r.x0 = w;
+    r.y0 = h;
+    r.x1 = r.y1 = 0;
+    for(int c = 0; c < 3; ++c)
+        r.max[c] = 0;
+    for(const Partial & p: partials) {
+        for(int c = 0; c < 3; ++c) {
+            sum[c] += p.sum[c];
+            r.max[c] = max(r.max[c], p.max[c]);
+        }
+        sumSq += p.sumSq;
+        r.differing += p.differing;
+        r.x0 = min(r.x0, p.x0);
+        r.y0 = min(r.y0, p.y0);
+        r.x1 = max(r.x1, p.x1);
+        r.y1 = max(r.y1, p.y1);
+        ssim += p.ssim;
+        blocks += p.blocks;
+    }
+    if(!r.differing)
+        r.x0 = r.y0 = r.x1 = r.y1 = 0;
+    
+    double pixels = (double)w*h;
+    for(int c = 0; c < 3; ++c)
+        r.mean[c] = sum[c]/pixels;
+    r.mse = sumSq/(3*pixels);
+    r.psnr = (r.mse > 0)? 10*log10(255*255/r.mse) : INFINITY;
+    r.ssim = blocks? ssim/blocks : 1;
+    return r;
+}
+
+} // namespace imagediff
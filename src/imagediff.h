@@ -0,0 +1,67 @@
+#ifndef IMAGEDIFF_H
+#define IMAGEDIFF_H
+
+#include <cstdint>
+#include <cstddef>
+
+class WorkerPool;
+
+// Comparison of two images of the same size, for DiffWindow, benchmarks and
+// image checks. Needs no GUI or GL.
+namespace imagediff {
+
+// w*h RGB or RGBA pixels, stride bytes from one row to the next (0 if
+// packed), top row first unless bottom_up, as GL reads them back. Alpha is
+// ignored.
+struct Image {
+    const uint8_t * pixels;
+    int w, h;
+    int depth;// 3 or 4
+    ptrdiff_t stride;
+    bool bottom_up;
+};
+
+inline Image top_down(const uint8_t * pixels, int w, int h, int depth, ptrdiff_t stride = 0) {
+    Image img = {pixels, w, h, depth, stride, false};
+    return img;
+}
+inline Image bottom_up(const uint8_t * pixels, int w, int h, int depth, ptrdiff_t stride = 0) {
+    Image img = {pixels, w, h, depth, stride, true};
+    return img;
+}
+
+struct Options {
+    int threshold;// a pixel differs if a channel is off by more than this
+    bool ssim;// compute ssim, the slowest part
+    WorkerPool * pool;// to split rows across, or null for the caller alone
+    Options(): threshold(0), ssim(true), pool(nullptr) {}
+};
+
+struct Result {
+    double mean[3];// mean absolute difference of R, G and B
+    int max[3];// largest absolute difference of each
+    double mse;// mean squared difference over R, G and B
+    double psnr;// dB, infinite if identical
+    // Mean structural similarity of luma over 8x8 blocks, 1 if identical or
+    // not asked for
+    double ssim;
+    size_t differing;// pixels with a channel off by more than the threshold
+    int x0, y0, x1, y1;// their bounds, top down, x1 and y1 exclusive; 0 if none
+    
+    // Nothing off by more than the threshold
+    bool identical() const {return differing == 0;}
+    int max_error() const;
+    double mean_error() const {return (mean[0] + mean[1] + mean[2])/3;}
+};
+
+// Compare a and b. If difference isn't null it gets the absolute difference
+// of each channel as w*h RGBA pixels, top down, with alpha 255. Images of
+// different sizes differ everywhere, and get no difference image. Rows are
+// worked on a band at a time with SSE2, each image turned the right way up
+// as it's read.
+Result compare(const Image & a, const Image & b, const Options & options = Options(),
+               uint8_t * difference = nullptr);
+
+} // namespace imagediff
+
+#endif // IMAGEDIFF_H
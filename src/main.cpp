@@ -1,11 +1,13 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <cstdio>
 #include <vector>
 #include <set>
 #include <map>
 #include <stack>
 #include <cfloat>
+#include <chrono>
 
 #include <boost/format.hpp>
 
@@ -17,7 +19,14 @@
 
 #include "OGL_Window.h"
 #include "GL_GraphicsDriver.h"
+#include "GL_FrameCapture.h"
+#include "GL_Headless.h"
+#include "SW_GraphicsDriver.h"
 #include "pixfmt.h"
+#include "imagediff.h"
+#include "WorkerPool.h"
+#include "benchmarks.h"
+#include "goldens.h"
 
 #include "fltk3utils.h"
 
@@ -39,49 +48,51 @@ uint8_t * GenTestImage(int w, int h, int depth, const genfn_t & fn) {
 }
 
 
+// Image A is a frame read back from GL, RGBA bottom up. Image B is RGB top
+// down, read into image_b(). Shows the absolute difference of each channel.
 class DiffWindow: public flu::Window {
-    uint8_t * imageA;
-    uint8_t * imageB;
+    GL_FrameCapture::FramePtr imageA;
+    std::vector<uint8_t> imageB;
+    bool haveB;
+    std::vector<uint8_t> difference;// RGBA, top down
   public:
     DiffWindow(int wx, int wy, int ww, int wh, const char * label = nullptr):
         flu::Window(wx, wy, ww, wh, label),
-        imageA(nullptr),
-        imageB(nullptr)
+        haveB(false)
     {}
     
-    void set_image_a(uint8_t * img) {
-        if(imageA) delete[] imageA;
-        imageA = img;
+    void set_image_a(const GL_FrameCapture::FramePtr & frame) {
+        if(frame->w != w() || frame->h != h())
+            return;
+        imageA = frame;
         redraw();
     }
-    void set_image_b(uint8_t * img) {
-        if(imageB) delete[] imageB;
-        imageB = img;
+    // Memory for image B, kept from frame to frame. Call image_b_changed()
+    // once it's filled in.
+    uint8_t * image_b() {
+        imageB.resize(3*w()*h());
+        return &imageB[0];
+    }
+    void image_b_changed() {
+        haveB = imageB.size() == 3*w()*h();
         redraw();
     }
     
     void draw() {
-        size_t n = 3*w()*h();
-        std::vector<uint8_t> buf(n, 0);
-        if(imageA && imageB) {
-            cerr << "Have images, computing difference" << endl;
-            for(size_t x = 0; x < w(); ++x)
-            for(size_t y = 0; y < h(); ++y)
-            {
-                // for(size_t c = 0; c < 3; ++c)
-                // {
-                //     int a = imageA[3*((h() - 1 - y)*w() + x) + c];
-                //     int b = imageB[3*(y*w() + x) + c];
-                //     buf[3*(y*w() + x) + c] = min(255, abs(a - b));
-                // }
-                int a = imageA[3*((h() - 1 - y)*w() + x) + 0];
-                int b = imageB[3*(y*w() + x) + 0];
-                buf[3*(y*w() + x) + 0] = a;
-                buf[3*(y*w() + x) + 1] = b;
-                buf[3*(y*w() + x) + 2] = 255;
-            }
+        difference.resize(4*w()*h());
+        if(imageA && haveB) {
+            imagediff::Options options;
+            options.pool = &WorkerPool::shared();
+            imagediff::Result r = imagediff::compare(imagediff::bottom_up(&imageA->rgba[0], w(), h(), 4),
+                                                     imagediff::top_down(&imageB[0], w(), h(), 3),
+                                                     options, &difference[0]);
+            cerr << format("DiffWindow: frame %d, max %d, PSNR %.1f dB, SSIM %.4f, %d pixels differ in %d,%d-%d,%d\n")
+                % imageA->number % r.max_error() % r.psnr % r.ssim % r.differing % r.x0 % r.y0 % r.x1 % r.y1;
+        }
+        else {
+            fill(difference.begin(), difference.end(), 0);
         }
-        fltk3::draw_image(&buf[0], 0, 0, w(), h(), 3, 0);
+        fltk3::draw_image(&difference[0], 0, 0, w(), h(), 4, 0);
     }
 };
 
@@ -99,6 +110,7 @@ class Sketch: public flu::Widget {
 };
 
 class GLView: public flu::FLU<OGL_Window> {
+    GL_FrameCapture capture;
   public:
     GLView(int wx, int wy, int ww, int wh, const char * label = nullptr);
     
@@ -110,6 +122,8 @@ GLView::GLView(int wx, int wy, int ww, int wh, const char * label):
     flu::FLU<OGL_Window>(wx, wy, ww, wh, label)
 {
     CustomGL_Visual(this);
+    // Its widgets only draw through FLTK
+    state_save(GL_GraphicsDriver::SAVE_TOUCHED);
 }
 
 
@@ -117,12 +131,14 @@ void GLView::InitGL()
 {
     glViewport(0, 0, w(), h());
     
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    if(!core_profile()) {
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
     
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(-1, 1, -1, 1, -1, 1);
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(-1, 1, -1, 1, -1, 1);
+    }
     
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glEnable(GL_BLEND);
@@ -138,29 +154,64 @@ void GLView::draw()
     
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    
     // cout << "GLView::draw()" << endl;
     
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, w(), 0, h(), -1, 1);
+    // The driver sets up its own projection in core profiles
+    if(!core_profile()) {
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+    
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(0, w(), 0, h(), -1, 1);
+    }
     
     {
-        GL_GraphicsDriver glgd(this);
+        GL_GraphicsDriver glgd(this, state_save());
+        if(samples() <= 1)
+            glgd.antialiasing(GL_GraphicsDriver::COVERAGE_AA);
         redraw();
         fltk3::Window::draw();
     }
     
-    size_t n = 4*w()*h();
-    uint8_t * buf = new uint8_t[n];
-    glReadPixels(0, 0, w(), h(), GL_RGB, GL_UNSIGNED_BYTE, buf);
-    diffWindow->set_image_a(buf);
+    // The newest of the frames that have come back, so drawing never waits
+    // on the readback
+    capture.read(0, 0, w(), h());
+    GL_FrameCapture::FramePtr newest;
+    while(GL_FrameCapture::FramePtr frame = capture.next())
+        newest = frame;
+    if(newest)
+        diffWindow->set_image_a(newest);
 }
 
 
 
+// Runs a benchmark once it has a GL context, then closes
+class BenchmarkWindow: public flu::FLU<OGL_Window> {
+    std::string benchmark;
+    bool done;
+  public:
+    BenchmarkWindow(const std::string & name, int wx, int wy, int ww, int wh):
+        flu::FLU<OGL_Window>(wx, wy, ww, wh, "Benchmark"),
+        benchmark(name),
+        done(false)
+    {}
+    
+    void draw() {
+        if(done)
+            return;
+        done = true;
+        glViewport(0, 0, w(), h());
+        if(!RunBenchmark(benchmark, w(), h())) {
+            cerr << "Unknown benchmark " << benchmark << endl;
+            ListBenchmarks(cerr);
+        }
+        hide();
+    }
+};
+
+
+
 class CaptureWindow: public flu::Window {
   public:
     CaptureWindow(int wx, int wy, int ww, int wh, const char * label = nullptr):
@@ -170,11 +221,49 @@ class CaptureWindow: public flu::Window {
     void draw() {
         redraw();
         flu::Window::draw();
-        size_t n = 4*w()*h();
-        uint8_t * buf = new uint8_t[n];
-        
-        fltk3::read_image(buf, 0, 0, w(), h(), 0);
-        diffWindow->set_image_b(buf);
+        fltk3::read_image(diffWindow->image_b(), 0, 0, w(), h(), 0);
+        diffWindow->image_b_changed();
+    }
+};
+
+// Draws with SW_GraphicsDriver into memory in place of the platform's driver,
+// showing the result and printing the average time to draw it
+class SoftwareView: public flu::Window {
+    std::vector<uint8_t> pixels;
+    int frames;
+    double seconds;
+  public:
+    SoftwareView(int wx, int wy, int ww, int wh, const char * label = nullptr):
+        flu::Window(wx, wy, ww, wh, label),
+        frames(0),
+        seconds(0)
+    {}
+    
+    void draw() {
+        redraw();
+        pixels.assign(4*w()*h(), 0);
+        auto t0 = std::chrono::steady_clock::now();
+        {
+            SW_GraphicsDriver swgd(this, &pixels[0]);
+            flu::Window::draw();
+        }
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if(++frames == 60) {
+            cerr << format("SoftwareView: %.3f ms/frame\n") % (1000*seconds/frames);
+            frames = 0;
+            seconds = 0;
+        }
+        fltk3::draw_image(&pixels[0], 0, 0, w(), h(), 4);
+    
+        // RGB, as CaptureWindow reads it
+        size_t n = w()*h();
+        uint8_t * buf = diffWindow->image_b();
+        for(size_t j = 0; j < n; ++j) {
+            buf[3*j] = pixels[4*j];
+            buf[3*j + 1] = pixels[4*j + 1];
+            buf[3*j + 2] = pixels[4*j + 2];
+        }
+        diffWindow->image_b_changed();
     }
 };
 
@@ -370,6 +459,68 @@ void PopulateWindow(fltk3::Window * win)
     win->end();
 }
 
+// The test window drawn frames times with no display, printing the time per
+// frame and saving the last to path if given. Or with "--bench <name>", a
+// benchmark run in the same context, or with "--golden [--dir <dir>]
+// [--update] [filter]", the golden image checks, or "--golden --list" their
+// cases.
+static int RunHeadless(int argc, char * argv[])
+{
+    GL_Headless headless(512, 720, CustomGL_Samples(), CustomGL_CoreProfile());
+    if(!headless.ok())
+        return 1;
+    
+    if(argc > 0 && string(argv[0]) == "--bench") {
+        if(argc < 2) {
+            ListBenchmarks(cout);
+            return 0;
+        }
+        if(!RunBenchmark(argv[1], headless.w(), headless.h())) {
+            cerr << "Unknown benchmark " << argv[1] << endl;
+            ListBenchmarks(cerr);
+            return 1;
+        }
+        return 0;
+    }
+    if(argc > 0 && string(argv[0]) == "--golden") {
+        if(argc > 1 && string(argv[1]) == "--list") {
+            cout << "Golden image cases:" << endl;
+            ListGoldens(cout);
+            return 0;
+        }
+        // Kept with the tree, so relative to its top
+        string dir = "tests/goldens";
+        int arg = 1;
+        if(argc > arg + 1 && string(argv[arg]) == "--dir") {
+            dir = argv[arg + 1];
+            arg += 2;
+        }
+        bool update = argc > arg && string(argv[arg]) == "--update";
+        arg += update;
+        string filter = (argc > arg)? argv[arg] : "";
+        return (RunGoldens(dir, update, filter, cout) == 0)? 0 : 1;
+    }
+    
+    int frames = (argc > 0)? max(1, atoi(argv[0])) : 1;
+    flu::Window * window = new flu::Window(headless.w(), headless.h());
+    PopulateWindow(window);
+    
+    std::vector<uint8_t> rgba;
+    auto t0 = std::chrono::steady_clock::now();
+    for(int f = 0; f < frames; ++f) {
+        headless.render(window);
+        headless.read(rgba);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    cout << format("%d frames, %.3f ms/frame\n") % frames % (1000*seconds/frames);
+    
+    if(argc > 1 && !SavePAM(argv[1], rgba, headless.w(), headless.h())) {
+        cerr << "Can't write " << argv[1] << endl;
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char * argv[])
 {
     testImg = GenTestImage(40, 40, 3, [](int x, int y, uint8_t * pix){
@@ -379,9 +530,49 @@ int main(int argc, char * argv[])
         pix[2] = 255*((sin(th - M_PI*2.0/3.0) + 1.0)/2.0);
     });
     
+    // --samples 1 for a visual without multisampling, antialiased by coverage.
+    // --core for core profile contexts, drawn without fixed-function state.
+    // --software to draw the second window with SW_GraphicsDriver.
+    // --headless [frames [file.pam]], --headless --bench <name> or
+    // --headless --golden [--dir <dir>] [--update] [filter] to draw without a
+    // display, see RunHeadless().
+    bool software = false;
+    int arg = 1;
+    while(argc > arg) {
+        if(argc > arg + 1 && string(argv[arg]) == "--samples") {
+            CustomGL_Samples(atoi(argv[arg + 1]));
+            arg += 2;
+        }
+        else if(string(argv[arg]) == "--core") {
+            CustomGL_CoreProfile(true);
+            arg += 1;
+        }
+        else if(string(argv[arg]) == "--software") {
+            software = true;
+            arg += 1;
+        }
+        else {
+            break;
+        }
+    }
+    
+    if(argc > arg && string(argv[arg]) == "--headless")
+        return RunHeadless(argc - arg - 1, argv + arg + 1);
+    
     CustomGL_Visual();
     flu::initialize();
     
+    if(argc > arg && string(argv[arg]) == "--bench") {
+        if(argc < arg + 2) {
+            ListBenchmarks(cout);
+            return 0;
+        }
+        BenchmarkWindow * benchWindow = new BenchmarkWindow(argv[arg + 1], 64, 0, 512, 720);
+        benchWindow->end();
+        benchWindow->show();
+        return fltk3::run();
+    }
+    
     diffWindow = new DiffWindow(1024+64, 0, 512, 720);
     diffWindow->end();
     diffWindow->show();
@@ -391,7 +582,11 @@ int main(int argc, char * argv[])
     PopulateWindow(glView);
     glView->show();
     
-    flu::Window * standardView = new CaptureWindow(512+64, 0, 512, 720);
+    flu::Window * standardView;
+    if(software)
+        standardView = new SoftwareView(512+64, 0, 512, 720);
+    else
+        standardView = new CaptureWindow(512+64, 0, 512, 720);
     PopulateWindow(standardView);
     standardView->show();
     
@@ -7,46 +7,86 @@
 #include <AGL/agl.h>
 #else
 #include <GL/glx.h>
+#include <fltk3/x.h>
 #endif
 
 #include "pixfmt.h"
 
 #include <iostream>
 
+static int samples = 8;
+static bool coreProfile = false;
+
 #if defined(USE_X11)
-static int glVisualDesc[64] = {
-    GLX_RGBA, GLX_GREEN_SIZE, 8, GLX_ALPHA_SIZE, 8,
+static int glVisualDesc[64];
+
+static const int * VisualDesc()
+{
+    int * a = glVisualDesc;
+    *a++ = GLX_RGBA; *a++ = GLX_GREEN_SIZE; *a++ = 8; *a++ = GLX_ALPHA_SIZE; *a++ = 8;
     // GLX_ACCUM_GREEN_SIZE, 8, GLX_ACCUM_ALPHA_SIZE, 8,
-    GLX_DEPTH_SIZE, 24,
-    // GLX_STENCIL_SIZE, 1,
+    *a++ = GLX_DEPTH_SIZE; *a++ = 24;
+    *a++ = GLX_STENCIL_SIZE; *a++ = 8;
 #if defined(GLX_VERSION_1_1) && defined(GLX_SGIS_multisample)
-    GLX_MULTISAMPLE, GLX_SAMPLES_SGIS, 8,
+    if(samples > 1) {
+        *a++ = GLX_MULTISAMPLE; *a++ = GLX_SAMPLES_SGIS; *a++ = samples;
+    }
 #endif
-    GLX_DOUBLEBUFFER,
+    *a++ = GLX_DOUBLEBUFFER;
     // GLX_STEREO,
-    (int)NULL
-};
+    *a++ = (int)NULL;
+    return glVisualDesc;
+}
 #elif defined(__APPLE_QUARTZ__)
-static int glVisualDesc[64] = {
+static int glVisualDesc[64];
+
+static const int * VisualDesc()
+{
+    int * a = glVisualDesc;
     // AGL_NO_RECOVERY,
-    AGL_RGBA,
-    AGL_GREEN_SIZE, 8,
-    AGL_ALPHA_SIZE, 8,
+    *a++ = AGL_RGBA;
+    *a++ = AGL_GREEN_SIZE; *a++ = 8;
+    *a++ = AGL_ALPHA_SIZE; *a++ = 8;
     // AGL_ACCUM_GREEN_SIZE, 8,
     // AGL_ACCUM_ALPHA_SIZE, 8,
-    AGL_DEPTH_SIZE, 24,
-    // AGL_STENCIL_SIZE, 1,
-    AGL_SAMPLE_BUFFERS_ARB, 1, AGL_SAMPLES_ARB, 8,
-    AGL_MULTISAMPLE,
-    AGL_DOUBLEBUFFER,
+    *a++ = AGL_DEPTH_SIZE; *a++ = 24;
+    *a++ = AGL_STENCIL_SIZE; *a++ = 8;
+    if(samples > 1) {
+        *a++ = AGL_SAMPLE_BUFFERS_ARB; *a++ = 1; *a++ = AGL_SAMPLES_ARB; *a++ = samples;
+        *a++ = AGL_MULTISAMPLE;
+    }
+    *a++ = AGL_DOUBLEBUFFER;
     // AGL_STEREO,
-    AGL_NONE
-};
+    *a++ = AGL_NONE;
+    return glVisualDesc;
+}
 #endif
 
+void CustomGL_Samples(int n)
+{
+    samples = n;
+}
+
+int CustomGL_Samples()
+{
+    return samples;
+}
+
+void CustomGL_CoreProfile(bool core)
+{
+    coreProfile = core;
+}
+
+bool CustomGL_CoreProfile()
+{
+    return coreProfile;
+}
+
 void CustomGL_Visual(OGL_Window * wind)
 {
-    uint32_t m = fltk3::DOUBLE | fltk3::RGB8 | fltk3::ALPHA | fltk3::DEPTH | fltk3::MULTISAMPLE;
+    uint32_t m = fltk3::DOUBLE | fltk3::RGB8 | fltk3::ALPHA | fltk3::DEPTH | fltk3::STENCIL;
+    if(samples > 1)
+        m |= fltk3::MULTISAMPLE;
 #if defined(WIN32)
     if(wind)
         wind->init_mode(m, NULL);
@@ -54,10 +94,60 @@ void CustomGL_Visual(OGL_Window * wind)
         fltk3::gl_visual(m);
 #else
     if(wind)
-        wind->init_mode(m, glVisualDesc);
+        wind->init_mode(m, VisualDesc());
     else
-        fltk3::gl_visual(m, glVisualDesc);
+        fltk3::gl_visual(m, VisualDesc());
 #endif
 }
 
+#if defined(USE_X11)
+typedef GLXContext (*CreateContextAttribsFn)(Display *, GLXFBConfig, GLXContext, Bool, const int *);
 
+bool CustomGL_CoreContext(OGL_Window * wind)
+{
+    CreateContextAttribsFn createContext =
+        (CreateContextAttribsFn)glXGetProcAddressARB((const GLubyte *)"glXCreateContextAttribsARB");
+    if(!createContext || !wind->shown())
+        return false;
+    
+    // The context has to suit the visual FLTK made the window with
+    XWindowAttributes attrs;
+    if(!XGetWindowAttributes(fl_display, fl_xid(wind), &attrs))
+        return false;
+    VisualID visual = XVisualIDFromVisual(attrs.visual);
+    int n = 0;
+    GLXFBConfig config = nullptr;
+    GLXFBConfig * configs = glXGetFBConfigs(fl_display, fl_screen, &n);
+    for(int j = 0; j < n && !config; ++j) {
+        int id;
+        if(glXGetFBConfigAttrib(fl_display, configs[j], GLX_VISUAL_ID, &id) == Success && (VisualID)id == visual)
+            config = configs[j];
+    }
+    if(configs)
+        XFree(configs);
+    if(!config)
+        return false;
+    
+    static const int attribs[] = {
+        GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
+        GLX_CONTEXT_MINOR_VERSION_ARB, 3,
+        GLX_CONTEXT_PROFILE_MASK_ARB, GLX_CONTEXT_CORE_PROFILE_BIT_ARB,
+        None
+    };
+    // Core contexts share objects with the first one, as FLTK's own contexts
+    // do, so that one is never destroyed.
+    static GLXContext first = nullptr;
+    GLXContext context = createContext(fl_display, config, first, True, attribs);
+    if(!context)
+        return false;
+    if(!first)
+        first = context;
+    wind->context(context, context != first);
+    return true;
+}
+#else
+bool CustomGL_CoreContext(OGL_Window * wind)
+{
+    return false;
+}
+#endif
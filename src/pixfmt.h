@@ -4,6 +4,22 @@
 
 #include "OGL_Window.h"
 
+// Samples per pixel for visuals chosen after this, default 8. At 1 there is no
+// multisample buffer, and OGL_Window antialiases by coverage instead.
+void CustomGL_Samples(int samples);
+int CustomGL_Samples();
+
+// Whether OGL_Windows constructed after this ask for a core profile (3.3)
+// context, drawn without the fixed-function pipeline. Default false. All
+// windows of a process should use the same profile, as they share textures.
+void CustomGL_CoreProfile(bool core);
+bool CustomGL_CoreProfile();
+
 void CustomGL_Visual(OGL_Window * wind = NULL);
 
+// Give a shown window a core profile context for its visual. Returns false
+// where that can't be done (only GLX is supported), leaving FLTK to make the
+// usual context.
+bool CustomGL_CoreContext(OGL_Window * wind);
+
 #endif // PIXFMT_H
@@ -0,0 +1,74 @@
+
+// UTF-8 decoding helpers for the text renderers.
+
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <cstdint>
+#include <cstddef>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace utf8 {
+
+// Decode one code point starting at p and advance p past it. Malformed or
+// truncated sequences decode as U+FFFD and consume a single byte, matching
+// how FLTK treats bad UTF-8 (one replacement per byte).
+inline uint32_t decode(const char *& p, const char * end)
+{
+    const uint8_t * s = (const uint8_t *)p;
+    uint32_t c = s[0];
+    if(c < 0x80) {
+        ++p;
+        return c;
+    }
+    
+    int n;
+    uint32_t min;
+    if((c & 0xE0) == 0xC0) {n = 1; c &= 0x1F; min = 0x80;}
+    else if((c & 0xF0) == 0xE0) {n = 2; c &= 0x0F; min = 0x800;}
+    else if((c & 0xF8) == 0xF0) {n = 3; c &= 0x07; min = 0x10000;}
+    else {++p; return 0xFFFD;}
+    
+    if(end - p <= n) {
+        ++p;
+        return 0xFFFD;
+    }
+    for(int j = 1; j <= n; ++j) {
+        if((s[j] & 0xC0) != 0x80) {
+            ++p;
+            return 0xFFFD;
+        }
+        c = (c << 6) | (s[j] & 0x3F);
+    }
+    if(c < min || c > 0x10FFFF || (c >= 0xD800 && c < 0xE000)) {
+        ++p;
+        return 0xFFFD;
+    }
+    p += n + 1;
+    return c;
+}
+
+// Number of bytes before the first non-ASCII byte (or end). Text in UIs is
+// mostly ASCII, so callers use this to take runs of single byte characters
+// straight to a lookup table, 16 bytes per test where SSE2 is available.
+inline size_t ascii_run(const char * p, const char * end)
+{
+    const char * s = p;
+#if defined(__SSE2__)
+    while(end - s >= 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)s));
+        if(mask)
+            return (s - p) + __builtin_ctz(mask);
+        s += 16;
+    }
+#endif
+    while(s < end && (uint8_t)*s < 0x80)
+        ++s;
+    return s - p;
+}
+
+} // namespace utf8
+
+#endif // UTF8_H